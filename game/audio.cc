@@ -1,19 +1,22 @@
 #include "audio.hh"
 
 #include "chrono.hh"
+#include "commandqueue.hh"
 #include "configuration.hh"
+#include "libda/mix.hpp"
 #include "libda/portaudio.hpp"
-#include "screen_songs.hh"
-#include "songs.hh"
+#include "log.hh"
+#include "musicstreams.hh"
+#include "seqlock.hh"
 #include "util.hh"
 
-#include "aubio/aubio.h"
 #include <boost/range/iterator_range.hpp>
 
 #include <cmath>
 #include <future>
 #include <iostream>
 #include <map>
+#include <sstream>
 #include <unordered_map>
 
 namespace {
@@ -70,49 +73,45 @@ namespace {
 
 void AudioClock::timeSync(Seconds audioPos, Seconds length) {
 	constexpr Seconds maxError = 100ms;  // Step the clock instead of skewing if over 100 ms off
-	// Full correction requires locking, but we can update max without lock too
-	std::unique_lock<std::mutex> l(m_mutex, std::defer_lock);
-	Seconds max = audioPos + length;
-	if (!l.try_lock()) {
-		if (max > m_max.load()) m_max = max; // Allow increasing m_max
-		return;
-	}
-	// Mutex locked - do a full update
+	State& st = m_state;
 	auto now = Clock::now();
-	const Seconds sys = pos_internal(now);  // Current position (based on system clock + corrections)
+	Seconds max = audioPos + length;
+	const Seconds sys = st.pos(now);  // Current position (based on system clock + corrections)
 	const Seconds audio = audioPos;  // Audio time
 	const Seconds diff = audio - sys;
 	// Skew-based correction only if going forward and relatively well synced
-	if (max > m_max.load() && std::abs(diff.count()) < maxError.count()) {
+	if (max > st.max && std::abs(diff.count()) < maxError.count()) {
 		constexpr double fudgeFactor = 0.001;  // Adjustment ratio
 		// Update base position (this should not affect the clock)
-		m_baseTime = now;
-		m_basePos = sys;
+		st.baseTime = now;
+		st.basePos = sys;
 		// Apply a VERY ARTIFICIAL correction for clock!
 		const Seconds valadj = length * 0.1 * rand() / RAND_MAX;  // Dither
-		m_skew += (diff < valadj ? -1.0 : 1.0) * fudgeFactor;
+		st.skew += (diff < valadj ? -1.0 : 1.0) * fudgeFactor;
 		// Limits to keep things sane in abnormal situations
-		m_skew = clamp(m_skew, -0.01, 0.01);
+		st.skew = clamp(st.skew, -0.01, 0.01);
 	} else {
 		// Off too much, step to correct time
-		m_baseTime = now;
-		m_basePos = audio;
-		m_skew = 0.0;
+		st.baseTime = now;
+		st.basePos = audio;
+		st.skew = 0.0;
 	}
-	m_max = max;
+	st.max = max;
 }
 
-Seconds AudioClock::pos_internal(Time now) const {
-	Seconds t = m_basePos + (1.0 + m_skew) * (now - m_baseTime);
-	return std::min<Seconds>(t, m_max);
+Seconds AudioClock::State::pos(Time now) const {
+	Seconds t = basePos + (1.0 + skew) * (now - baseTime);
+	return std::min<Seconds>(t, max);
 }
 
-Seconds AudioClock::pos() const {
-	std::lock_guard<std::mutex> l(m_mutex);
-	return pos_internal(Clock::now());
+namespace {
+	/// Size of the preallocated mixing buffers (in samples); larger callback blocks are mixed in pieces
+	const std::size_t MIXBUF_SIZE = 8192;
 }
 
-Music::Music(Audio::Files const& files, unsigned int sr, bool preview): srate(sr), m_preview(preview) {
+Music::Music(Audio::Files const& files, unsigned int sr, bool preview):
+  srate(sr), m_preview(preview), m_volume(config[preview ? "audio/preview_volume" : "audio/music_volume"]), m_mixbuf(MIXBUF_SIZE)
+{
 	for (auto const& tf /* trackname-filename pair */: files) {
 		if (tf.second.empty()) continue; // Skip tracks with no filenames; FIXME: Why do we even have those here, shouldn't they be eliminated earlier?
 		tracks.emplace(tf.first, std::make_unique<Track>(tf.second, sr));
@@ -120,31 +119,20 @@ Music::Music(Audio::Files const& files, unsigned int sr, bool preview): srate(sr
 	suppressCenterChannel = config["audio/suppress_center_channel"].b();
 }
 
-unsigned Audio::aubio_win_size = 1536;
-unsigned Audio::aubio_hop_size = 768;
-
-std::unique_ptr<aubio_tempo_t, void(*)(aubio_tempo_t*)> Audio::aubioTempo =
-					std::unique_ptr<aubio_tempo_t, void(*)(aubio_tempo_t*)>(
-						new_aubio_tempo(
-							"default",
-							Audio::aubio_win_size,
-							Audio::aubio_hop_size,
-							Audio::getSR()),[](aubio_tempo_t* p) {
-							if (p != nullptr) {
-								del_aubio_tempo(p);
-								}
-							}
-					);
-
-std::recursive_mutex Audio::aubio_mutex;
-
 bool Music::operator()(float* begin, float* end) {
 	size_t samples = end - begin;
 	m_clock.timeSync(durationOf(m_pos), durationOf(samples)); // Keep the clock synced
+	// Read settings only once per callback
+	const float volume = m_volume.i() / 100.0f;
+	const bool suppress = suppressCenterChannel && !m_preview;
 	bool eof = true;
-	Buffer mixbuf(samples);
-	for (auto& kv: tracks) {
-		Track& t = *kv.second;
+	// Mix in blocks that fit the preallocated buffer
+	for (float* block = begin; block != end;) {
+		size_t n = std::min<size_t>(end - block, m_mixbuf.size());
+		float* mixbuf = m_mixbuf.data();
+		std::fill(mixbuf, mixbuf + n, 0.0f);
+		for (auto& kv: tracks) {
+			Track& t = *kv.second;
 // #if 0 // FIXME: Include this code bit once there is a sane pitch shifting algorithm
 // //			if (it->first == "guitar") std::cout << t.pitchFactor << std::endl;
 // 			if (t.pitchFactor != 0) { // Pitch shift
@@ -161,27 +149,13 @@ bool Music::operator()(float* begin, float* end) {
 // 			// Otherwise just get the audio and mix it straight away
 // 			} else
 // #endif
-		if (t.mpeg.audioQueue(mixbuf.data(), mixbuf.data() + mixbuf.size(), m_pos, t.fadeLevel)) eof = false;
-		
-	}
-	m_pos += samples;
-	
-	for (size_t i = 0, iend = mixbuf.size(); i != iend; ++i) {
-		if (i % 2 == 0) {
-			fadeLevel += fadeRate;
-			if (fadeLevel <= 0.0) return false;
-			if (fadeLevel > 1.0) { fadeLevel = 1.0; fadeRate = 0.0; }
-		}
-		begin[i] += mixbuf[i] * fadeLevel * static_cast<float>(m_preview ? config["audio/preview_volume"].i() : config["audio/music_volume"].i())/100.0;
-	}
-	// suppress center channel vocals
-	if(suppressCenterChannel && !m_preview) {
-		float diffLR;
-		for (size_t i=0; i<mixbuf.size(); i+=2) {
-			diffLR = begin[i] - begin[i+1];
-			begin[i] = diffLR;
-			begin[i+1] = diffLR;
+			if (t.mpeg.audioQueue(mixbuf, mixbuf + n, m_pos, t.fadeLevel)) eof = false;
 		}
+		m_pos += n;
+		if (da::accumulate_fade_stereo(block, mixbuf, n / 2, volume, fadeLevel, fadeRate) < n / 2) return false;  // Faded out
+		// suppress center channel vocals
+		if (suppress) da::suppress_center_stereo(block, n / 2);
+		block += n;
 	}
 	return !eof;
 }
@@ -197,46 +171,7 @@ bool Music::prepare() {
 	for (auto& kv: tracks) {
 		FFmpeg& mpeg = kv.second->mpeg;
 		if (mpeg.terminating()) continue;  // Song loading failed or other error, won't ever get ready
-		if (mpeg.audioQueue.prepare(m_pos)) {
-			if (kv.first == "background" && m_preview && m_pos > 0) {
-				fvec_t* previewSamples = mpeg.audioQueue.makePreviewBuffer();
-				fvec_t* previewBeats = ScreenSongs::previewBeatsBuffer.get();
-				intptr_t readptr = 0;
-				fvec_t* tempoSamplePtr = new_fvec(Audio::aubio_hop_size);
-				std::lock_guard<std::recursive_mutex> l(Audio::aubio_mutex);
-				Game* gm = Game::getSingletonPtr();
-				ScreenSongs* sSongs = static_cast<ScreenSongs *>(gm->getScreen("Songs"));
-				double pstart = sSongs->getSongs().currentPtr()->preview_start;
-				pstart = (std::isnan(pstart) ? 0.0 : pstart);
-				double first_period, first_beat;
-				std::vector<double> extra_beats;
-				Song::Beats& beats = sSongs->getSongs().currentPtr()->beats;
-				if (!sSongs->getSongs().currentPtr()->hasControllers()) {
-				while ((readptr + Audio::aubio_hop_size) <= previewSamples->length) {
-					tempoSamplePtr->data = &previewSamples->data[readptr];
-					aubio_tempo_do(Audio::aubioTempo.get(),tempoSamplePtr,previewBeats);
-					if (previewBeats->data[0] != 0) {
-						double beatSecs = aubio_tempo_get_last_s(Audio::aubioTempo.get());
-							if (beats.empty()) { // Store time and period of first detected beat.
-								first_beat = beatSecs;
-								first_period = aubio_tempo_get_period_s(Audio::aubioTempo.get());
-							}
-						beats.push_back(beatSecs + pstart);
-					}
-					readptr += Audio::aubio_hop_size;
-				}
-					if (!beats.empty()) {
-						double newBeat = first_beat - first_period;
-						while (newBeat > 0.02) {
-							extra_beats.push_back(newBeat + pstart);
-							newBeat -= first_period;
-						}
-						beats.insert(beats.begin(),extra_beats.rbegin(),extra_beats.rend());
-					}
-				}
-			}	
-		continue;  // Buffering done
-		}
+		if (mpeg.audioQueue.prepare(m_pos)) continue;  // Buffering done
 		ready = false;  // Need to wait for buffering
 		break;
 	}
@@ -260,21 +195,24 @@ struct Sample {
 	double m_pos;
 	FFmpeg mpeg;
 	bool eof;
+	ConfigItem& m_volume;
+	std::vector<float> m_mixbuf;  ///< Preallocated mixing buffer
   public:
-	Sample(fs::path const& filename, unsigned sr) : m_pos(), mpeg(filename, sr), eof(true) { }
+	Sample(fs::path const& filename, unsigned sr) : m_pos(), mpeg(filename, sr), eof(true), m_volume(config["audio/fail_volume"]), m_mixbuf(MIXBUF_SIZE) { }
 	void operator()(float* begin, float* end) {
-		if(eof) {
-			// No more data to play in this sample
-			return;
-		}
-		std::vector<float> mixbuf(end - begin);
-		if(!mpeg.audioQueue(mixbuf.data(), mixbuf.data() + mixbuf.size(), m_pos, 1.0)) {
-			eof = true;
-		}
-		for (size_t i = 0, iend = end - begin; i != iend; ++i) {
-			begin[i] += mixbuf[i] * static_cast<float>(config["audio/fail_volume"].i())/100.0;
+		const float volume = m_volume.i() / 100.0f;
+		for (float* block = begin; block != end && !eof;) {
+			size_t n = std::min<size_t>(end - block, m_mixbuf.size());
+			float* mixbuf = m_mixbuf.data();
+			std::fill(mixbuf, mixbuf + n, 0.0f);
+			if(!mpeg.audioQueue(mixbuf, mixbuf + n, m_pos, 1.0)) {
+				// No more data to play in this sample
+				eof = true;
+			}
+			da::accumulate(block, mixbuf, n, volume);
+			m_pos += n;
+			block += n;
 		}
-		m_pos += end - begin;
 	}
 	void reset() {
 		eof = false;
@@ -292,7 +230,6 @@ struct Synth {
 		static double phase = 0.0;
 		for (float *i = begin; i < end; ++i) *i *= 0.3; // Decrease music volume
 
-		std::vector<float> mixbuf(end - begin);
 		Notes::const_iterator it = m_notes.begin();
 
 		while (it != m_notes.end() && it->end < position) ++it;
@@ -302,7 +239,7 @@ struct Synth {
 		double freq = MusicalScale().setNote(note + 4 * 12).getFreq();
 		double value = 0.0;
 		// Synthesize tones
-		for (size_t i = 0, iend = mixbuf.size(); i != iend; ++i) {
+		for (size_t i = 0, iend = end - begin; i != iend; ++i) {
 			if (i % 2 == 0) {
 				value = d * 0.2 * std::sin(phase) + 0.2 * std::sin(2 * phase) + (1.0 - d) * 0.2 * std::sin(4 * phase);
 				phase += TAU * freq / srate;
@@ -312,100 +249,186 @@ struct Synth {
 	}
 };
 
+using SampleMap = std::unordered_map<std::string, std::shared_ptr<Sample>>;
+
+/// A request from the API functions to the audio callback
 struct Command {
-	enum { TRACK_FADE, TRACK_PITCHBEND, SAMPLE_RESET } type;
+	enum Type { TRACK_FADE, TRACK_PITCHBEND, SAMPLE_RESET, SEEK, SEEK_POS, TOGGLE_CENTER, PLAY_MUSIC, SET_SAMPLES, SET_SYNTH } type;
 	std::string track;
 	double factor;
+	std::unique_ptr<Music> music;  ///< PLAY_MUSIC: the stream to preload
+	std::unique_ptr<SampleMap> samples;  ///< SET_SAMPLES: the new set of loaded samples
+	std::unique_ptr<Synth> synth;  ///< SET_SYNTH: the new synth (nullptr to stop it)
+	Command(Type type = TRACK_FADE, std::string track = std::string(), double factor = 0.0): type(type), track(std::move(track)), factor(factor) {}
+};
+
+/// Objects released by the audio callback, to be destroyed by another thread
+struct Garbage {
+	std::unique_ptr<Music> music;
+	std::unique_ptr<SampleMap> samples;
+	std::unique_ptr<Synth> synth;
+	char const* event = nullptr;  ///< Debug message, logged by collect() since the callback must not log
+	Music const* eventMusic = nullptr;  ///< The stream that the message is about
 };
 
-/// Audio output callback wrapper. The playback Device calls this when it needs samples.
+/**
+* Audio output callback wrapper. The playback Device calls this when it needs samples.
+* The callback thread owns the streams and never locks: other threads send it Commands, and it hands
+* everything that needs to be destroyed back as Garbage. It also publishes a Status snapshot after every
+* block, so that queries neither touch the streams nor wait for the callback (and vice versa).
+**/
 struct Output {
-	std::mutex mutex;
-	std::mutex samples_mutex;
-	std::mutex synth_mutex;
+	static const std::size_t QUEUE_SIZE = 256;
+	static const std::size_t MAX_PLAYING = 16;  ///< Streams mixed simultaneously (old ones fading out)
+	// Sender side (any thread but the callback, serialized by the mutex of commands)
+	typedef CommandQueue<Command, Garbage, QUEUE_SIZE> Commands;
+	Commands commands;
+	SampleMap samples;  ///< Loaded samples; the callback gets a copy of this map whenever it changes
+	bool synthEnabled = false;
+	std::atomic<unsigned> musicRequests{ 0 };  ///< Number of PLAY_MUSIC commands sent
+	// Callback side
 	std::unique_ptr<Synth> synth;
-	std::unique_ptr<Music> preloading;
-	std::vector<std::unique_ptr<Music>> playing, disposing;
+	MusicStreams<Music> music{ MAX_PLAYING };
+	std::unique_ptr<SampleMap> liveSamples;
 	std::vector<Analyzer*> mics;  // Used for audio pass-through
-	std::unordered_map<std::string, std::unique_ptr<Sample>> samples;
-	std::vector<Command> commands;
+	ConfigItem& passThrough = config["audio/pass-through"];  ///< Resolved once, not looked up in the callback
+	ConfigItem& passThroughRatio = config["audio/pass-through_ratio"];
+	unsigned musicHandled = 0;  ///< Number of PLAY_MUSIC commands processed
+	// Published by the callback
+	struct Status {
+		AudioClock::State clock;  ///< Of the current stream
+		double duration = getNaN();  ///< Of the current stream
+		unsigned musicHandled = 0;
+		bool current = false;  ///< Is a stream playing (rather than nothing or only preloading)
+		bool active = false;  ///< Preloading or playing something
+	};
+	SeqLock<Status> status;
 	std::atomic<bool> paused{ false };
 	Output(): paused(false) {}
 
-	void callbackUpdate() {
-		std::unique_lock<std::mutex> l(mutex, std::try_to_lock);
-		if (!l.owns_lock()) return;  // No update now, try again later (cannot stop and wait for mutex to be released)
-		// Move from preloading to playing, if ready
-		if (preloading && preloading->prepare()) {
-			std::clog << "audio/debug: preload done -> playing " << preloading.get() << std::endl;
-			if (!playing.empty()) playing[0]->fadeRate = -preloading->fadeRate;  // Fade out the old music
-			playing.insert(playing.begin(), std::move(preloading));
+	/// Holds the mutex for sending, and logs the events of what the callback has released
+	struct Lock: Commands::Lock {
+		explicit Lock(Output& o): Commands::Lock(o.commands) {}
+		~Lock() {
+			for (Garbage const& g: trash()) if (g.event) LOG("audio", debug, g.event << ' ' << g.eventMusic);
 		}
-		// Process commands
-		for (auto const& cmd: commands) {
-			switch (cmd.type) {
+	};
+
+	/// Queue a command for the callback, returns false if it could not be sent.
+	bool send(Lock& lock, Command&& cmd) {
+		bool stalled = commands.stalled();
+		if (commands.send(lock, std::move(cmd))) return true;
+		if (!stalled) std::clog << "audio/warning: Audio command queue not processed, dropping commands" << std::endl;  // Only once
+		return false;
+	}
+
+	/// Update the published status (callback only)
+	void publish() {
+		Status st;
+		if (music.current()) {
+			Music& m = *music.playing[0];
+			st.clock = m.clock();
+			st.duration = m.duration();
+			st.current = true;
+		}
+		st.musicHandled = musicHandled;
+		st.active = music.active();
+		status.store(st);
+	}
+
+	void callbackUpdate() {
+		// Process commands, but only while there is room to release what they replace
+		while (Command* cmd = commands.front()) {
+			switch (cmd->type) {
 			case Command::TRACK_FADE:
-				if (!playing.empty()) playing[0]->trackFade(cmd.track, cmd.factor);
+				if (!music.playing.empty()) music.playing[0]->trackFade(cmd->track, cmd->factor);
 				break;
 			case Command::TRACK_PITCHBEND:
-				if (!playing.empty()) playing[0]->trackPitchBend(cmd.track, cmd.factor);
+				if (!music.playing.empty()) music.playing[0]->trackPitchBend(cmd->track, cmd->factor);
 				break;
 			case Command::SAMPLE_RESET:
-				auto it = samples.find(cmd.track);
-				if (it != samples.end())
-					it->second->reset();
+				if (liveSamples) {
+					auto it = liveSamples->find(cmd->track);
+					if (it != liveSamples->end()) it->second->reset();
+				}
+				break;
+			case Command::SEEK:
+				for (auto& trk: music.playing) trk->seek(clamp(trk->pos() + cmd->factor, 0.0, trk->duration()));
+				break;
+			case Command::SEEK_POS:
+				for (auto& trk: music.playing) trk->seek(cmd->factor);
+				break;
+			case Command::TOGGLE_CENTER:
+				for (auto& trk: music.playing) trk->suppressCenterChannel = !trk->suppressCenterChannel;
+				break;
+			case Command::PLAY_MUSIC: {
+				Garbage g;
+				g.music = music.preload(std::move(cmd->music));
+				if (g.music) { g.event = "earlier music still preloading, disposing"; g.eventMusic = g.music.get(); }
+				++musicHandled;
+				if (g.music) commands.release(std::move(g));
+				break;
+			}
+			case Command::SET_SAMPLES: {
+				Garbage g;
+				g.samples = std::move(liveSamples);
+				liveSamples = std::move(cmd->samples);
+				if (g.samples) commands.release(std::move(g));
+				break;
+			}
+			case Command::SET_SYNTH: {
+				Garbage g;
+				g.synth = std::move(synth);
+				synth = std::move(cmd->synth);
+				if (g.synth) commands.release(std::move(g));
 				break;
 			}
+			}
+			commands.pop();
+		}
+		// Move from preloading to playing, if ready
+		if (Music* started = music.promote()) {
+			Garbage g;
+			g.event = "preload done -> playing";
+			g.eventMusic = started;
+			commands.release(std::move(g));  // Only for logging, so it may be lost
 		}
-		commands.clear();
 	}
 
 	void callback(float* begin, float* end, double rate) {
 		callbackUpdate();
 		std::fill(begin, end, 0.0f);
-		if (paused) return;
+		if (paused) { publish(); return; }
 		// Mix in from the streams currently playing
-		auto arrayEnd = playing.end();
-		for (auto i = playing.begin(); i != arrayEnd;) {
+		for (auto i = music.playing.begin(); i != music.playing.end();) {
 			bool keep = (*i->get())(begin, end);  // Do the actual mixing
-			std::unique_lock<std::mutex> l(mutex, std::defer_lock);
-			if (!keep && l.try_lock()) {
-				// Dispose streams no longer needed by moving them to another container (that will be cleared by another thread).
-				disposing.push_back(std::move(*i));
-				i = playing.erase(i);
-				arrayEnd = playing.end();
+			if (!keep && commands.canRelease()) {
+				// Dispose streams no longer needed by handing them to another thread for deletion.
+				Garbage g;
+				g.music = std::move(*i);
+				i = music.playing.erase(i);
+				commands.release(std::move(g));
 			}
 			else { ++i; }
 		}
 		// Mix in microphones (if pass-through is enabled)
-		if (mics.size() > 0 && config["audio/pass-through"].b()) {
+		if (mics.size() > 0 && passThrough.b()) {
 			// Decrease music volume
-			float amp = 1.0f / config["audio/pass-through_ratio"].f();
+			float amp = 1.0f / passThroughRatio.f();
 			if (amp != 1.0f) for (auto& s: boost::make_iterator_range(begin, end)) s *= amp;
 			// Do the mixing
 			for (auto& m: mics) if (m) m->output(begin, end, rate);
 		}
 		// Mix in the samples currently playing
-		{
-			// samples should not be created/destroyed on the fly
-			std::unique_lock<std::mutex> l(samples_mutex, std::defer_lock);
-			if(l.try_lock()) {
-				for(auto it = samples.begin() ; it != samples.end() ; ++it) {
-					(*it->second)(begin, end);
-				}
-			}
+		if (liveSamples) {
+			for (auto& kv: *liveSamples) (*kv.second)(begin, end);
 		}
 		// Mix synth if available (should be done at the end)
-		{
-			std::unique_lock<std::mutex> l(synth_mutex, std::defer_lock);
-			if(l.try_lock() && synth.get() && !playing.empty()) {
-				(*synth.get())(begin, end, playing[0]->pos());
-			}
-		}
+		if (synth && !music.playing.empty()) (*synth)(begin, end, music.playing[0]->pos());
+		publish();
 	}
 };
 
-
 Device::Device(unsigned int in, unsigned int out, double rate, unsigned int dev):
   in(in), out(out), rate(rate), dev(dev),
   stream(*this,
@@ -421,11 +444,20 @@ void Device::start() {
 }
 
 void Device::stop() {
+	std::clog << "audio/info: Device " << dev << " " << stats.dump() << std::endl;
 	PaError err = Pa_StopStream(stream);
 	if (err != paNoError) throw std::runtime_error(std::string("Pa_StopStream: ") + Pa_GetErrorText(err));
 }
 
-int Device::operator()(void const* input, void* output, unsigned long frames, const PaStreamCallbackTimeInfo*, PaStreamCallbackFlags) try {
+int Device::operator()(void const* input, void* output, unsigned long frames, const PaStreamCallbackTimeInfo*, PaStreamCallbackFlags flags) try {
+	struct Timer {
+		CallbackStats& stats;
+		Seconds block;
+		bool xrun;
+		Time start = Clock::now();
+		~Timer() { stats.add(Clock::now() - start, block, xrun); }
+	} timer{ stats, 1.0s * frames / rate, (flags & (paInputOverflow | paOutputUnderflow)) != 0 };
+	Logger::realtimeThread();  // PortAudio has no thread start hook, and this is only a thread_local store
 	float const* inbuf = static_cast<float const*>(input);
 	float* outbuf = static_cast<float*>(output);
 	for (std::size_t i = 0; i < mics.size(); ++i) {
@@ -457,12 +489,14 @@ struct Audio::Impl {
 				struct Params {
 					unsigned out, in;
 					unsigned int rate;
+					std::size_t fft;
 					std::string dev;
 					std::vector<std::string> mics;
 				} params = Params();
 				params.out = 0;
 				params.in = 0;
 				params.rate = 48000;
+				params.fft = FFT_N;
 				// Break into tokens:
 				for (auto& kv: parseKeyValuePairs(*it)) {
 					// Handle keys
@@ -471,6 +505,7 @@ struct Audio::Impl {
 					if (key == "out") iss >> params.out;
 					else if (key == "in") iss >> params.in;
 					else if (key == "rate") iss >> params.rate;
+					else if (key == "fft") iss >> params.fft;
 					else if (key == "dev") std::getline(iss, params.dev);
 					else if (key == "mics") {
 						// Parse a comma-separated list of mics
@@ -482,6 +517,7 @@ struct Audio::Impl {
 					if (!iss.eof()) throw std::runtime_error("Syntax error parsing device parameter " + key);
 				}
 				if (params.mics.size() < params.in) { params.mics.resize(params.in); }
+				if (!Analyzer::isValidFFTSize(params.fft)) throw std::runtime_error("Invalid FFT size " + std::to_string(params.fft) + " (must be 512, 1024, 2048 or 4096)");
 				portaudio::AudioDevices ad(PaHostApiTypeId(PaHostApiNameToHostApiTypeId(selectedBackend)));
 					bool wantOutput = (params.in == 0) ? true : false;
 					unsigned num;
@@ -518,7 +554,7 @@ struct Audio::Impl {
 					}
 					if (mic_used) continue;
 					// Add the new analyzer
-					analyzers.emplace_back(d.rate, m);
+					analyzers.emplace_back(d.rate, m, params.fft);
 					d.mics[j] = &analyzers.back();
 					++assigned_mics;
 				}
@@ -548,10 +584,7 @@ struct Audio::Impl {
 	}
 };
 
-Audio::Audio(): self(std::make_unique<Impl>()) {
-	aubio_tempo_set_silence(Audio::aubioTempo.get(), -50.0);
-	aubio_tempo_set_threshold(Audio::aubioTempo.get(), 0.4);
-}
+Audio::Audio(): self(std::make_unique<Impl>()) {}
 Audio::~Audio() { close(); }
 
 ConfigItem& Audio::backendConfig() {
@@ -579,20 +612,28 @@ bool Audio::hasPlayback() const {
 }
 
 void Audio::loadSample(std::string const& streamId, fs::path const& filename) {
-	std::lock_guard<std::mutex> l(self->output.samples_mutex);
-	self->output.samples.emplace(streamId, std::unique_ptr<Sample>(new Sample(filename, getSR())));
+	Output& o = self->output;
+	auto sample = std::make_shared<Sample>(filename, getSR());
+	Output::Lock l(o);
+	if (!o.samples.emplace(streamId, std::move(sample)).second) return;
+	Command cmd(Command::SET_SAMPLES);
+	cmd.samples = std::make_unique<SampleMap>(o.samples);
+	o.send(l, std::move(cmd));
 }
 
 void Audio::playSample(std::string const& streamId) {
 	Output& o = self->output;
-	std::lock_guard<std::mutex> l(o.mutex);
-	Command cmd = { Command::SAMPLE_RESET, streamId, 0.0 };
-	o.commands.push_back(cmd);
+	Output::Lock l(o);
+	o.send(l, Command(Command::SAMPLE_RESET, streamId));
 }
 
 void Audio::unloadSample(std::string const& streamId) {
-	std::lock_guard<std::mutex> l(self->output.samples_mutex);
-	self->output.samples.erase(streamId);
+	Output& o = self->output;
+	Output::Lock l(o);
+	if (o.samples.erase(streamId) == 0) return;
+	Command cmd(Command::SET_SAMPLES);
+	cmd.samples = std::make_unique<SampleMap>(o.samples);
+	o.send(l, std::move(cmd));
 }
 
 void Audio::playMusic(Audio::Files const& filenames, bool preview, double fadeTime, double startPos) {
@@ -606,11 +647,10 @@ void Audio::playMusic(Audio::Files const& filenames, bool preview, double fadeTi
 	logmsg += ") -> ";
 	std::clog << logmsg << m.get() << std::endl;
 	// Send to audio playback thread
-	std::lock_guard<std::mutex> l(o.mutex);
-	if (o.preloading) std::clog << "audio/debug: earlier music still preloading, disposing " << o.preloading.get() << std::endl;
-	o.preloading = std::move(m);
-	o.disposing.clear();  // Delete disposed streams
-	o.commands.clear();  // Remove old unprocessed commands (they should not apply to the new music)
+	Command cmd(Command::PLAY_MUSIC);
+	cmd.music = std::move(m);
+	Output::Lock l(o);
+	if (o.send(l, std::move(cmd))) ++o.musicRequests;
 }
 
 void Audio::playMusic(fs::path const& filename, bool preview, double fadeTime, double startPos) {
@@ -620,54 +660,53 @@ void Audio::playMusic(fs::path const& filename, bool preview, double fadeTime, d
 }
 
 void Audio::stopMusic() {
-	playMusic(Audio::Files(), false, 0.0);
-	{
-		Output& o = self->output;
-		// stop synth when music is stopped
-		std::lock_guard<std::mutex> l(o.synth_mutex);
-		o.synth.reset();
-	}
+	fadeout(0.0);
 }
 
 void Audio::fadeout(double fadeTime) {
 	playMusic(Audio::Files(), false, fadeTime);
-	{
-		Output& o = self->output;
-		// stop synth when music is stopped
-		std::lock_guard<std::mutex> l(o.synth_mutex);
-		o.synth.reset();
-	}
+	// stop synth when music is stopped
+	Output& o = self->output;
+	Output::Lock l(o);
+	if (o.synthEnabled && o.send(l, Command(Command::SET_SYNTH))) o.synthEnabled = false;
 }
 
 double Audio::getPosition() const {
 	Output& o = self->output;
-	std::lock_guard<std::mutex> l(o.mutex);
-	return (o.playing.empty() || o.preloading.get()) ? getNaN() : o.playing[0]->pos();
+	Output::Status st = o.status.load();
+	if (st.musicHandled != o.musicRequests) return getNaN();  // New music not received yet
+	return st.current ? st.clock.pos(Clock::now()).count() : getNaN();
 }
 
 double Audio::getLength() const {
 	Output& o = self->output;
-	std::lock_guard<std::mutex> l(o.mutex);
-	return (o.playing.empty() || o.preloading.get()) ? getNaN() : o.playing[0]->duration();
+	Output::Status st = o.status.load();
+	if (st.musicHandled != o.musicRequests) return getNaN();
+	return st.current ? st.duration : getNaN();
 }
 
 bool Audio::isPlaying() const {
 	Output& o = self->output;
-	std::lock_guard<std::mutex> l(o.mutex);
-	return o.preloading || !o.playing.empty();
+	Output::Status st = o.status.load();
+	if (st.musicHandled != o.musicRequests) return true;  // Still to be preloaded
+	return st.active;
 }
 
 void Audio::seek(double offset) {
 	Output& o = self->output;
-	std::lock_guard<std::mutex> l(o.mutex);
-	for (auto& trk: o.playing) trk->seek(clamp(trk->pos() + offset, 0.0, trk->duration()));
+	{
+		Output::Lock l(o);
+		o.send(l, Command(Command::SEEK, std::string(), offset));
+	}
 	pause(false);
 }
 
 void Audio::seekPos(double pos) {
 	Output& o = self->output;
-	std::lock_guard<std::mutex> l(o.mutex);
-	for (auto& trk: o.playing) trk->seek(pos);
+	{
+		Output::Lock l(o);
+		o.send(l, Command(Command::SEEK_POS, std::string(), pos));
+	}
 	pause(false);
 }
 
@@ -676,31 +715,28 @@ bool Audio::isPaused() const { return self->output.paused; }
 
 void Audio::streamFade(std::string track, double fadeLevel) {
 	Output& o = self->output;
-	std::lock_guard<std::mutex> l(o.mutex);
-	Command cmd = { Command::TRACK_FADE, track, fadeLevel };
-	o.commands.push_back(cmd);
+	Output::Lock l(o);
+	o.send(l, Command(Command::TRACK_FADE, std::move(track), fadeLevel));
 }
 
 void Audio::streamBend(std::string track, double pitchFactor) {
 	Output& o = self->output;
-	std::lock_guard<std::mutex> l(o.mutex);
-	Command cmd = { Command::TRACK_PITCHBEND, track, pitchFactor };
-	o.commands.push_back(cmd);
+	Output::Lock l(o);
+	o.send(l, Command(Command::TRACK_PITCHBEND, std::move(track), pitchFactor));
 }
 
 void Audio::toggleSynth(Notes const& notes) {
 	Output& o = self->output;
-	std::lock_guard<std::mutex> l(o.synth_mutex);
-	if (o.synth.get()) o.synth.reset();
-	else o.synth = std::make_unique<Synth>(notes, getSR());
+	Command cmd(Command::SET_SYNTH);
+	Output::Lock l(o);
+	if (!o.synthEnabled) cmd.synth = std::make_unique<Synth>(notes, getSR());
+	if (o.send(l, std::move(cmd))) o.synthEnabled = !o.synthEnabled;
 }
 
 void Audio::toggleCenterChannelSuppressor() {
 	Output& o = self->output;
-	std::lock_guard<std::mutex> l(o.mutex);
-	for (size_t i = 0; i < o.playing.size(); i++) {
-		o.playing[i]->suppressCenterChannel = !o.playing[i]->suppressCenterChannel;
-	}
+	Output::Lock l(o);
+	o.send(l, Command(Command::TOGGLE_CENTER));
 }
 
 std::deque<Analyzer>& Audio::analyzers() { return self->analyzers; }
@@ -1,11 +1,11 @@
 #pragma once
 
+#include "callbackstats.hh"
 #include "configuration.hh"
 #include "ffmpeg.hh"
 #include "notes.hh"
 #include "pitch.hh"
 #include "libda/portaudio.hpp"
-#include "aubio/aubio.h"
 #include <deque>
 #include <map>
 #include <memory>
@@ -23,16 +23,19 @@ struct Output;
 * Produces precise monotonic clock synced to audio output callback (which may suffer of major jitter).
 * Uses system clock as timebase but the clock is skewed (made slower or faster) depending on whether
 * it is late or early. The clock is also stopped if audio output pauses.
+* The clock belongs to the audio callback; other threads read the State that it publishes.
 **/
 class AudioClock {
-	mutable std::mutex m_mutex;
-	Time m_baseTime; ///< A reference time (corresponds to m_basePos)
-	Seconds m_basePos = 0.0s; ///< A reference position in song
-	double m_skew = 0.0; ///< The skew ratio applied to system time (since baseTime)
-	std::atomic<Seconds> m_max{ 0.0s }; ///< Maximum output value for the clock (end of the current audio block)
-	/// Get the current position (current time via parameter, no locking)
-	Seconds pos_internal(Time now) const;
 public:
+	/// Everything needed for calculating the position at any time
+	struct State {
+		Time baseTime; ///< A reference time (corresponds to basePos)
+		Seconds basePos = 0.0s; ///< A reference position in song
+		double skew = 0.0; ///< The skew ratio applied to system time (since baseTime)
+		Seconds max = 0.0s; ///< Maximum output value for the clock (end of the current audio block)
+		/// Get the position at given time
+		Seconds pos(Time now) const;
+	};
 	/**
 	* Called from audio callback to keep the clock synced.
 	* @param audioPos the current position in the song
@@ -40,7 +43,10 @@ public:
 	*/
 	void timeSync(Seconds audioPos, Seconds length);
 	/// Get the current position in seconds
-	Seconds pos() const;
+	Seconds pos() const { return m_state.pos(Clock::now()); }
+	State const& state() const { return m_state; }
+private:
+	State m_state;
 };
 
 struct Device {
@@ -51,6 +57,7 @@ struct Device {
 	portaudio::Stream stream;
 	std::vector<Analyzer*> mics;
 	Output* outptr;
+	CallbackStats stats;
 
 	Device(unsigned int in, unsigned int out, double rate, unsigned int dev);
 	/// Start
@@ -79,7 +86,6 @@ class Audio {
 	std::unique_ptr<Impl> self;
 	friend class ScreenSongs;
 	friend class Music;
-	static std::recursive_mutex aubio_mutex;
 public:
 	typedef std::map<std::string, fs::path> Files;
 	static ConfigItem& backendConfig();
@@ -135,9 +141,6 @@ public:
 	void streamBend(std::string track, double pitchFactor);
 	/** Get sample rate */
 	static double getSR() { return 48000.0; }
-	static unsigned aubio_hop_size;
-	static unsigned aubio_win_size;
-	static std::unique_ptr<aubio_tempo_t, void(*)(aubio_tempo_t*)> aubioTempo;
 };
 
 class Music {
@@ -157,6 +160,8 @@ struct Track {
 	Seconds durationOf(int64_t samples) const { return 1.0s * samples / srate / 2.0; }
 	float* sampleStartPtr = nullptr;
 	float* sampleEndPtr = nullptr;
+	ConfigItem& m_volume;  ///< Volume setting that applies to this stream
+	std::vector<float> m_mixbuf;  ///< Preallocated mixing buffer, so that the audio callback never allocates
 public:
 	bool suppressCenterChannel = false;
 	double fadeLevel = 0.0;
@@ -166,8 +171,9 @@ public:
 	/// Sums the stream to output sample range, returns true if the stream still has audio left afterwards.
 	bool operator()(float* begin, float* end);
 	void seek(double time) { m_pos = time * srate * 2.0; }
-	/// Get the current position in seconds
+	/// Get the current position in seconds (audio callback only, others use Audio::getPosition)
 	double pos() const { return m_clock.pos().count(); }
+	AudioClock::State const& clock() const { return m_clock.state(); }
 	double duration() const;
 	/// Prepare (seek) all tracks to current position, return true when done (nonblocking)
 	bool prepare();
@@ -0,0 +1,66 @@
+#include "beatdetector.hh"
+
+#include "audio.hh"
+#include "cache.hh"
+#include "chrono.hh"
+#include "ffmpeg.hh"
+#include "aubio/aubio.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <stdexcept>
+
+namespace {
+	unsigned const WIN_SIZE = 1536;
+	unsigned const HOP_SIZE = 768;
+	double const ANALYZE_SECONDS = 20.0;  ///< Length of preview to analyze
+	Seconds const TIMEOUT = 30s;  ///< Give up if decoding takes longer than this (e.g. the file cannot be opened)
+}
+
+bool detectBeats(fs::path const& music, double start, std::atomic<bool> const& abort, std::vector<double>& beats) {
+	if (cache::loadBeats(music, start, beats)) return true;
+	Time begin = Clock::now();
+	unsigned const rate = Audio::getSR();
+	FFmpeg mpeg(music, rate);  // Decodes in its own thread (or plays from the PCM cache)
+	std::unique_ptr<aubio_tempo_t, void(*)(aubio_tempo_t*)> tempo(new_aubio_tempo("default", WIN_SIZE, HOP_SIZE, rate), del_aubio_tempo);
+	std::unique_ptr<fvec_t, void(*)(fvec_t*)> input(new_fvec(HOP_SIZE), del_fvec);
+	std::unique_ptr<fvec_t, void(*)(fvec_t*)> output(new_fvec(1), del_fvec);
+	aubio_tempo_set_silence(tempo.get(), -50.0);
+	aubio_tempo_set_threshold(tempo.get(), 0.4);
+	std::vector<float> stereo(2 * HOP_SIZE);
+	double firstBeat = 0.0, firstPeriod = 0.0;
+	// Positions in samples of both channels, like AudioBuffer
+	std::int64_t pos = 2 * std::llround(start * rate);
+	std::int64_t end = pos + 2 * std::int64_t(ANALYZE_SECONDS * rate);
+	for (; pos < end; pos += stereo.size()) {
+		while (!mpeg.audioQueue.prepare(pos)) {
+			if (abort) return false;
+			if (Clock::now() - begin > TIMEOUT) throw std::runtime_error("Timed out");
+			std::this_thread::sleep_for(10ms);
+		}
+		std::fill(stereo.begin(), stereo.end(), 0.0f);
+		bool more = mpeg.audioQueue(stereo.data(), stereo.data() + stereo.size(), pos);
+		for (unsigned i = 0; i < HOP_SIZE; ++i) input->data[i] = 0.5f * (stereo[2 * i] + stereo[2 * i + 1]);
+		aubio_tempo_do(tempo.get(), input.get(), output.get());
+		if (output->data[0] != 0) {
+			double beat = aubio_tempo_get_last_s(tempo.get());
+			if (beats.empty()) {  // Store time and period of first detected beat
+				firstBeat = beat;
+				firstPeriod = aubio_tempo_get_period_s(tempo.get());
+			}
+			beats.push_back(start + beat);
+		}
+		if (!more) break;  // EOF
+	}
+	// Extend to the beginning of the analyzed part with the tempo of the first beat
+	if (!beats.empty() && firstPeriod > 0.0) {
+		std::vector<double> extra;
+		for (double beat = firstBeat - firstPeriod; beat > 0.02; beat -= firstPeriod) extra.push_back(start + beat);
+		beats.insert(beats.begin(), extra.rbegin(), extra.rend());
+	}
+	std::clog << "audio/debug: Detected " << beats.size() << " beats in " << music.filename().string() << std::endl;
+	cache::saveBeats(music, start, beats);
+	return true;
+}
+
@@ -0,0 +1,92 @@
+#pragma once
+
+#include "fs.hh"
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/// Beats of music from start seconds on, by tempo analysis of the decoded audio (cached, so each song is
+/// analyzed once). Returns false if abort was set meanwhile or nothing could be detected.
+bool detectBeats(fs::path const& music, double start, std::atomic<bool> const& abort, std::vector<double>& beats);
+
+/**
+* Detects the beats of song previews in a background thread, for pulsing the song browser in time with music
+* that has no beat information of its own. Only the latest request matters: a new request cancels the analysis
+* in progress. Target is the class whose beats receive the results (Song); the analysis is a function like
+* detectBeats, so that the threading does not depend on audio decoding.
+**/
+template <typename Target> class BeatDetector {
+  public:
+	typedef std::function<bool(fs::path const& music, double start, std::atomic<bool> const& abort, std::vector<double>& beats)> Analyze;
+	explicit BeatDetector(Analyze analyze): m_analyze(std::move(analyze)), m_thread(&BeatDetector::run, this) {}
+	~BeatDetector() {
+		{
+			std::lock_guard<std::mutex> l(m_mutex);
+			m_quit = true;
+			m_abort = true;
+		}
+		m_cond.notify_one();
+		m_thread.join();
+	}
+	BeatDetector(BeatDetector const&) = delete;
+	BeatDetector& operator=(BeatDetector const&) = delete;
+	/// Detect the beats of music from start seconds on, for target (does nothing if it already has beats)
+	void request(std::shared_ptr<Target> const& target, fs::path const& music, double start) {
+		if (!target->beats.empty()) return;
+		std::lock_guard<std::mutex> l(m_mutex);
+		m_request.reset(new Request{ target, music, start });
+		m_abort = true;
+		m_cond.notify_one();
+	}
+	/// Store finished results in Target::beats (call from the thread that reads them)
+	void update() {
+		std::vector<std::pair<std::shared_ptr<Target>, std::vector<double>>> results;
+		{
+			std::lock_guard<std::mutex> l(m_mutex);
+			results.swap(m_results);
+		}
+		for (auto& r: results) {
+			if (r.first->beats.empty()) r.first->beats = std::move(r.second);
+		}
+	}
+  private:
+	struct Request {
+		std::shared_ptr<Target> target;
+		fs::path music;
+		double start;
+	};
+	void run() {
+		std::unique_lock<std::mutex> l(m_mutex);
+		while (true) {
+			m_cond.wait(l, [this]{ return m_quit || m_request; });
+			if (m_quit) return;
+			std::unique_ptr<Request> req = std::move(m_request);
+			m_abort = false;
+			l.unlock();
+			std::vector<double> beats;
+			bool ok = false;
+			try {
+				ok = m_analyze(req->music, req->start, m_abort, beats);
+			} catch (std::exception& e) {
+				std::clog << "audio/warning: Beat detection of " << req->music << " failed: " << e.what() << std::endl;
+			}
+			l.lock();
+			if (ok) m_results.emplace_back(req->target, std::move(beats));
+		}
+	}
+	Analyze m_analyze;
+	std::mutex m_mutex;
+	std::condition_variable m_cond;
+	std::unique_ptr<Request> m_request;  ///< Waiting for the worker
+	std::vector<std::pair<std::shared_ptr<Target>, std::vector<double>>> m_results;  ///< Waiting for update()
+	std::atomic<bool> m_abort{ false };  ///< Stop the analysis in progress (new request or quitting)
+	bool m_quit = false;
+	std::thread m_thread;  ///< Last, so that it starts after everything else is constructed
+};
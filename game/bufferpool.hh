@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+/**
+* Bounded stack of spare buffers (e.g. std::vector), so that a producer can decode into the memory of buffers
+* already consumed instead of allocating new ones. The pool itself never allocates after construction. Not
+* thread-safe; the owner must lock.
+**/
+template <typename Buffer> class BufferPool {
+  public:
+	explicit BufferPool(std::size_t max): m_max(max) { m_pool.reserve(max); }
+	/// Keep the storage of buf for reuse if there is room (otherwise it is freed); leaves buf empty
+	void release(Buffer& buf) {
+		if (buf.capacity() > 0 && m_pool.size() < m_max) {
+			m_pool.emplace_back();
+			m_pool.back().swap(buf);
+		}
+		Buffer().swap(buf);
+	}
+	/// Swap a spare buffer into buf, if there is any (buf is expected to be empty)
+	void reuse(Buffer& buf) {
+		if (m_pool.empty()) return;
+		buf.swap(m_pool.back());
+		m_pool.pop_back();
+	}
+	/// Number of spare buffers
+	std::size_t size() const { return m_pool.size(); }
+  private:
+	std::vector<Buffer> m_pool;
+	std::size_t m_max;
+};
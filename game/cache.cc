@@ -1,11 +1,67 @@
 #include "cache.hh"
 #include "fs.hh"
+#include "util.hh"
 
 #include <boost/format.hpp>
 #include <algorithm>
 #include <boost/algorithm/string/classification.hpp>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
 
 namespace cache {
+	namespace {
+		/// Beat cache file of music file (64-bit FNV-1a of the path), changed files reuse the same entry
+		fs::path beatsFileName(fs::path const& music) {
+			std::ostringstream name;
+			name << std::hex << std::setw(16) << std::setfill('0') << fnv1a64(fs::absolute(music).string()) << ".beats";
+			return getCacheDir() / "beats" / name.str();
+		}
+
+		/// First line of a beat cache file, identifies the version of the music and the analyzed part
+		std::string beatsHeader(fs::path const& music, double start) {
+			std::ostringstream oss;
+			oss << std::setprecision(17) << fs::absolute(music).string() << '\t' << std::int64_t(fs::last_write_time(music))
+			  << '\t' << fs::file_size(music) << '\t' << start;
+			return oss.str();
+		}
+	}
+
+	bool loadBeats(fs::path const& music, double start, std::vector<double>& beats) {
+		try {
+			std::ifstream file(beatsFileName(music).string());
+			std::string header;
+			if (!std::getline(file, header) || header != beatsHeader(music, start)) return false;
+			std::vector<double> result;
+			for (double beat; file >> beat;) result.push_back(beat);
+			if (!file.eof()) return false;  // Damaged
+			beats.swap(result);
+			return true;
+		} catch (std::exception& e) {
+			std::clog << "cache/warning: Cached beats of " << music << " not usable: " << e.what() << std::endl;
+		}
+		return false;
+	}
+
+	void saveBeats(fs::path const& music, double start, std::vector<double> const& beats) {
+		try {
+			fs::path target = beatsFileName(music);
+			fs::create_directories(target.parent_path());
+			fs::path tmp = target.parent_path() / fs::unique_path(target.stem().string() + "-%%%%%%%%.tmp");
+			{
+				std::ofstream file(tmp.string());
+				file << beatsHeader(music, start) << '\n' << std::setprecision(17);
+				for (double beat: beats) file << beat << '\n';
+				if (!file.flush()) { fs::remove(tmp); throw std::runtime_error("Write failed"); }
+			}
+			fs::rename(tmp, target);
+		} catch (std::exception& e) {
+			std::clog << "cache/warning: Cannot store beats of " << music << ": " << e.what() << std::endl;
+		}
+	}
+
 	fs::path constructSVGCacheFileName(fs::path const& svgfilename, double factor){
 		fs::path cache_filename;
 		std::string const lod = (boost::format("%.2f") % factor).str();
@@ -5,12 +5,19 @@
 #include <boost/filesystem.hpp>
 #include <cstring>
 #include <stdexcept>
+#include <vector>
 
 namespace cache {
 
 	/** Builds the full path and file name for the SVG cache resource **/
 	fs::path constructSVGCacheFileName(fs::path const& svgfilename, double factor);
 
+	/** Load beats detected from music (analyzed from start seconds on), returns false if not cached **/
+	bool loadBeats(fs::path const& music, double start, std::vector<double>& beats);
+
+	/** Store beats detected from music for loadBeats **/
+	void saveBeats(fs::path const& music, double start, std::vector<double> const& beats);
+
 	/** Load an SVG from the cache, if loading fails invalid_cache_error is thrown **/
 	template <typename T> bool loadSVG(T& target, fs::path const& source_filename, double factor) {
 		fs::path const cache_filename = cache::constructSVGCacheFileName(source_filename, factor);
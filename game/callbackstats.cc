@@ -0,0 +1,22 @@
+#include "callbackstats.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+
+void CallbackStats::add(Seconds elapsed, Seconds block, bool xrun) {
+	double load = elapsed / block;
+	unsigned bucket = std::min<unsigned>(BUCKETS - 1, load * 4.0);
+	m_histogram[bucket].fetch_add(1, std::memory_order_relaxed);
+	if (xrun) m_xruns.fetch_add(1, std::memory_order_relaxed);
+	if (load > m_worst.load(std::memory_order_relaxed)) m_worst.store(load, std::memory_order_relaxed);
+}
+
+std::string CallbackStats::dump() const {
+	static char const* labels[BUCKETS] = { "<25%", "<50%", "<75%", "<100%", ">=100%" };
+	std::ostringstream oss;
+	oss << "callback load";
+	for (unsigned i = 0; i < BUCKETS; ++i) oss << " " << labels[i] << ": " << m_histogram[i].load();
+	oss << ", worst: " << std::lround(100.0 * m_worst.load()) << "%, xruns: " << m_xruns.load();
+	return oss.str();
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "chrono.hh"
+#include <array>
+#include <atomic>
+#include <string>
+
+/**
+* Histogram of audio callback execution times relative to the duration of the audio block,
+* so that buffer under/overruns can be attributed to slow callbacks (or to something else).
+* Updated by the callback thread only, read by anyone.
+**/
+class CallbackStats {
+  public:
+	static const unsigned BUCKETS = 5;  ///< <25 %, <50 %, <75 %, <100 %, >=100 % of the block duration
+	/// Record one callback that took elapsed to process a block of given duration
+	void add(Seconds elapsed, Seconds block, bool xrun);
+	/// Callbacks recorded in a bucket
+	unsigned count(unsigned bucket) const { return m_histogram[bucket].load(std::memory_order_relaxed); }
+	/// Callbacks flagged with an input overflow or an output underflow
+	unsigned xruns() const { return m_xruns.load(std::memory_order_relaxed); }
+	/// Highest execution time relative to the block duration
+	double worst() const { return m_worst.load(std::memory_order_relaxed); }
+	/// Human-readable summary for logging
+	std::string dump() const;
+  private:
+	std::array<std::atomic<unsigned>, BUCKETS> m_histogram{};
+	std::atomic<unsigned> m_xruns{ 0 };
+	std::atomic<double> m_worst{ 0.0 };  ///< Highest load ratio seen
+};
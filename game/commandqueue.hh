@@ -0,0 +1,70 @@
+#pragma once
+
+#include "chrono.hh"
+#include "spscqueue.hh"
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+* Commands from any thread to a real-time callback, and the objects that the callback releases back to be
+* destroyed by the senders. Senders are serialized by a mutex, while the callback side neither locks nor
+* allocates. The callback only takes a command while there is room for releasing what the command replaces.
+**/
+template <typename Command, typename Garbage, std::size_t SIZE> class CommandQueue {
+  public:
+	/// Holds the mutex for sending. What the callback has released is destroyed only after unlocking, as
+	/// destroying it may be slow (e.g. joining decoder threads).
+	class Lock {
+		std::vector<Garbage> m_trash;  // Declared before the lock, so that it is destroyed after unlocking
+		std::lock_guard<std::mutex> m_lock;
+		friend class CommandQueue;
+	  public:
+		explicit Lock(CommandQueue& queue): m_lock(queue.m_mutex) {}
+		/// What has been collected so far, destroyed with the Lock
+		std::vector<Garbage>& trash() { return m_trash; }
+	};
+
+	/// Senders wait up to timeout for the callback to make room
+	explicit CommandQueue(Clock::duration timeout = 200ms): m_timeout(timeout) {}
+
+	/// Queue a command, returns false if it could not be sent. Waits for the callback to make room rather than
+	/// lose the command, unless the callback is not running at all (e.g. no playback device), which showed in
+	/// the previous attempt already.
+	bool send(Lock& lock, Command&& cmd) {
+		Time timeout = Clock::now() + m_timeout;
+		while (true) {
+			collect(lock);  // The callback only takes commands while it has room for garbage
+			if (m_commands.push(std::move(cmd))) { m_stalled = false; return true; }
+			if (m_stalled || Clock::now() > timeout) break;
+			std::this_thread::sleep_for(1ms);
+		}
+		m_stalled = true;
+		return false;
+	}
+	/// Did the previous send fail (the callback is not emptying the queue)
+	bool stalled() const { return m_stalled; }
+	/// Move whatever the callback has released to lock
+	void collect(Lock& lock) {
+		while (Garbage* g = m_garbage.front()) {
+			lock.m_trash.push_back(std::move(*g));
+			m_garbage.pop();
+		}
+	}
+
+	// Callback side
+	/// The oldest command if any, and if there is room for releasing what it replaces (remove it with pop)
+	Command* front() { return canRelease() ? m_commands.front() : nullptr; }
+	void pop() { m_commands.pop(); }
+	/// Is there room for releasing an object
+	bool canRelease() const { return m_garbage.size() < m_garbage.capacity(); }
+	/// Hand an object to the senders for destruction, returns false if there is no room
+	bool release(Garbage&& garbage) { return m_garbage.push(std::move(garbage)); }
+
+  private:
+	std::mutex m_mutex;
+	SPSCQueue<Command, SIZE> m_commands;
+	SPSCQueue<Garbage, SIZE> m_garbage;
+	Clock::duration const m_timeout;
+	bool m_stalled = false;
+};
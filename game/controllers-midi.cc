@@ -1,13 +1,23 @@
 #ifdef USE_PORTMIDI
 
 #include "controllers.hh"
+#include "controllers-midi.hh"
 #include "fs.hh"
+#include "log.hh"
 #include "portmidi.hh"
 #include "regex.hh"
+#include <atomic>
+#include <cmath>
+#include <thread>
 #include <unordered_map>
 
 namespace input {
 
+	/**
+	* MIDI input is read by a thread of its own that polls the devices about once per millisecond, so that
+	* events are timestamped when they arrive rather than when the next frame happens to poll them. Events are
+	* handed to the main thread through a wait-free queue and delivered by process() with their original time.
+	**/
 	class Midi: public Hardware {
 	public:
 		Midi() {
@@ -20,12 +30,18 @@ namespace input {
 					std::string name = getName(dev);
 					if (!regex_search(name, re)) continue;
 					// Now actually open the device
-					m_streams.emplace(dev, std::unique_ptr<pm::Input>(new pm::Input(dev)));
+					m_streams.emplace(dev, std::unique_ptr<pm::Input>(new pm::Input(dev, timeProc, this)));
 					std::clog << "controller-midi/info: Opened MIDI device " << name << std::endl;
 				} catch (std::runtime_error& e) {
 					std::clog << "controller-midi/warning: " << e.what() << std::endl;
 				}
 			}
+			if (!m_streams.empty()) m_thread = std::thread(&Midi::run, this);
+		}
+		~Midi() override {
+			m_quit = true;
+			if (m_thread.joinable()) m_thread.join();
+			if (m_queue.events()) std::clog << "controller-midi/info: " << m_queue.events() << " events, delivery delay avg " << 1e3 * m_queue.delayAvg() << " ms, max " << 1e3 * m_queue.delayMax() << " ms" << std::endl;
 		}
 		std::string getName(unsigned dev) const override {
 			PmDeviceInfo const* info = Pm_GetDeviceInfo(dev);
@@ -35,26 +51,37 @@ namespace input {
 			return name.str();
 		}
 		bool process(Event& event) override {
-			PmEvent ev;
-			for (auto it = m_streams.begin(); it != m_streams.end(); ++it) {
-				if (Pm_Read(*it->second, &ev, 1) != 1) continue;
-				unsigned char evnt = ev.message & 0xF0;
-				unsigned char note = ev.message >> 8;
-				unsigned char vel  = ev.message >> 16;
-				unsigned chan = (ev.message & 0x0F) + 1;  // It is conventional to use one-based indexing
-				if (evnt == 0x80 /* NOTE OFF */) { evnt = 0x90; vel = 0; }  // Translate NOTE OFF into NOTE ON with zero-velocity
-				if (evnt != 0x90 /* NOTE ON */) continue;  // Ignore anything that isn't NOTE ON/OFF
-				std::clog << "controller-midi/info: MIDI NOTE ON/OFF event: ch=" << unsigned(chan) << " note=" << unsigned(note) << " vel=" << unsigned(vel) << std::endl;
-				event.source = SourceId(SOURCETYPE_MIDI, it->first, chan);
-				event.hw = note;
-				event.value = vel / 127.0;
-				return true;
-			}
-			return false;
+			if (unsigned dropped = m_queue.dropped()) std::clog << "controller-midi/warning: " << dropped << " MIDI events dropped (queue full)" << std::endl;
+			if (!m_queue.pop(event)) return false;
+			LOG("controller-midi", info, "MIDI NOTE ON/OFF event: ch=" << event.source.channel << " note=" << event.hw << " vel=" << unsigned(std::lround(event.value * 127.0)));
+			return true;
 		}
 	private:
+		/// PortMidi time source
+		static PmTimestamp timeProc(void* info) {
+			return static_cast<Midi const*>(info)->m_clock.timestamp(Clock::now());
+		}
+		/// Input thread: all PortMidi reads happen here
+		void run() {
+			while (!m_quit) {
+				PmEvent ev;
+				for (auto it = m_streams.begin(); it != m_streams.end(); ++it) {
+					while (Pm_Read(*it->second, &ev, 1) == 1) {
+						Event event;
+						if (!decodeMidi(ev.message, it->first, event)) continue;
+						event.time = m_clock.time(ev.timestamp);
+						m_queue.push(event);
+					}
+				}
+				std::this_thread::sleep_for(1ms);
+			}
+		}
 		pm::Initialize m_init;
+		MidiClock const m_clock;
 		std::unordered_map<unsigned, std::unique_ptr<pm::Input>> m_streams;
+		MidiQueue m_queue;  ///< Input thread to main thread
+		std::atomic<bool> m_quit{ false };
+		std::thread m_thread;
 	};
 
 	Hardware::ptr constructMidi() { return Hardware::ptr(new Midi()); }
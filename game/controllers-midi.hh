@@ -0,0 +1,79 @@
+#pragma once
+
+#include "controllers-events.hh"
+#include "spscqueue.hh"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+
+namespace input {
+	/// Time base of MIDI input: PortMidi timestamps are milliseconds since construction, so they map directly to Clock
+	class MidiClock {
+	public:
+		explicit MidiClock(Time base = Clock::now()): m_base(base) {}
+		/// Timestamp of t in PortMidi units (the time proc returns timestamp(Clock::now()))
+		std::int32_t timestamp(Time t) const { return std::int32_t(std::chrono::duration_cast<std::chrono::milliseconds>(t - m_base).count()); }
+		/// Game time of a PortMidi timestamp
+		Time time(std::int32_t timestamp) const { return m_base + std::chrono::milliseconds(timestamp); }
+	private:
+		Time m_base;  ///< Zero of PortMidi timestamps
+	};
+
+	/**
+	* Decode a short MIDI message into event (source channel, hw and value). NOTE OFF becomes NOTE ON with zero
+	* velocity. Returns false for anything other than NOTE ON/OFF.
+	**/
+	static inline bool decodeMidi(std::uint32_t message, unsigned device, Event& event) {
+		unsigned char evnt = message & 0xF0;
+		unsigned char note = message >> 8;
+		unsigned char vel  = message >> 16;
+		unsigned chan = (message & 0x0F) + 1;  // It is conventional to use one-based indexing
+		if (evnt == 0x80 /* NOTE OFF */) { evnt = 0x90; vel = 0; }  // Translate NOTE OFF into NOTE ON with zero-velocity
+		if (evnt != 0x90 /* NOTE ON */) return false;  // Ignore anything that isn't NOTE ON/OFF
+		event.source = SourceId(SOURCETYPE_MIDI, device, chan);
+		event.hw = note;
+		event.value = vel / 127.0;
+		return true;
+	}
+
+	/**
+	* Hand-off of timestamped MIDI events from the input thread to the main thread. push() is wait-free and counts
+	* events lost to a full queue; pop() keeps statistics of the delay from arrival to processing.
+	**/
+	class MidiQueue {
+	public:
+		/// Input thread: returns false (and counts the event as dropped) if the queue is full
+		bool push(Event const& event) {
+			if (m_queue.push(event)) return true;
+			++m_dropped;
+			return false;
+		}
+		/// Main thread: take the oldest event, processed at time now
+		bool pop(Event& event, Time now = Clock::now()) {
+			Event* ev = m_queue.front();
+			if (!ev) return false;
+			event.source = ev->source;
+			event.hw = ev->hw;
+			event.value = ev->value;
+			event.time = ev->time;
+			m_queue.pop();
+			double delay = std::chrono::duration<double>(now - event.time).count();
+			++m_events;
+			m_delaySum += delay;
+			m_delayMax = std::max(m_delayMax, delay);
+			return true;
+		}
+		/// Number of events dropped since the last call
+		unsigned dropped() { return m_dropped.exchange(0); }
+		// Delivery statistics (main thread only)
+		unsigned events() const { return m_events; }
+		double delayAvg() const { return m_events ? m_delaySum / m_events : 0.0; }
+		double delayMax() const { return m_delayMax; }
+	private:
+		SPSCQueue<Event, 1024> m_queue;
+		std::atomic<unsigned> m_dropped{ 0 };
+		unsigned m_events = 0;
+		double m_delaySum = 0.0;
+		double m_delayMax = 0.0;
+	};
+}
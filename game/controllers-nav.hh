@@ -0,0 +1,117 @@
+#pragma once
+
+#include "controllers-events.hh"
+#include "util.hh"
+#include <algorithm>
+#include <deque>
+#include <stdexcept>
+#include <vector>
+
+/// Button state and menu navigation of the input layer, independent of any hardware backend
+namespace input {
+	/// Return a NavButton corresponding to an Event
+	inline NavButton navigation(Event const& ev) {
+		#define DEFINE_BUTTON(dt, btn, num, nav) if ((DEVTYPE_##dt == DEVTYPE_GENERIC || ev.devType == DEVTYPE_##dt) && ev.button == dt##_##btn) return nav;
+		#include "controllers-buttons.ii"
+		return NAV_NONE;
+	}
+
+	/// Number of button planes used by instruments (see controllers-buttons.ii), generic buttons use one more
+	constexpr unsigned instrumentPlanes() {
+		unsigned planes = 0;
+		#define DEFINE_BUTTON(dt, btn, num, nav) if ((num) < 0x10000 && ((num) >> 8) >= planes) planes = ((num) >> 8) + 1;
+		#include "controllers-buttons.ii"
+		return planes;
+	}
+	unsigned const BUTTON_INDICES = (instrumentPlanes() + 1) << 8;
+	/// Dense index of a button, for flat per-button arrays
+	inline unsigned buttonIndex(Button b) {
+		unsigned plane = (b.generic() ? instrumentPlanes() : b.layer());
+		if (plane > instrumentPlanes()) throw std::logic_error("Invalid Button value in controllers-nav.hh buttonIndex");
+		return plane << 8 | b.num();
+	}
+
+	/// Last value of every button of every source
+	class ButtonValues {
+	public:
+		/// Test if button's value has changed since the last call to this function
+		bool changed(Event const& ev) {
+			// Find the source or add it with all values NaN
+			auto it = std::find_if(m_values.begin(), m_values.end(), [&ev](SourceValues const& sv) { return sv.source == ev.source; });
+			if (it == m_values.end()) it = m_values.insert(it, SourceValues{ ev.source, std::vector<double>(BUTTON_INDICES, getNaN()) });
+			double& value = it->values[buttonIndex(ev.button)];
+			// Check and update value
+			if (value == ev.value) return false;
+			value = ev.value;
+			return true;
+		}
+	private:
+		/// Values of a source, indexed by buttonIndex (NaN if not seen yet)
+		struct SourceValues {
+			SourceId source;
+			std::vector<double> values;
+		};
+		/// Only a handful of sources are ever seen, so a linear search beats any map here
+		std::vector<SourceValues> m_values;
+	};
+
+	/// Queue of NavEvents with auto-repeat of held navigation buttons
+	class NavEvents {
+	public:
+		/// Handle a mapped event whose nav is set (not NAV_NONE)
+		void push(Event const& ev) {
+			NavEvent ne(ev);
+			// Menu navigation mapping
+			{
+				bool vertical = (ev.devType == DEVTYPE_GUITAR);
+				if (ne.button == NAV_UP) ne.menu = (vertical ? NAVMENU_A_PREV : NAVMENU_B_PREV);
+				else if (ne.button == NAV_DOWN) ne.menu = (vertical ? NAVMENU_A_NEXT : NAVMENU_B_NEXT);
+				else if (ne.button == NAV_LEFT) ne.menu = (vertical ? NAVMENU_B_PREV : NAVMENU_A_PREV);
+				else if (ne.button == NAV_RIGHT) ne.menu = (vertical ? NAVMENU_B_NEXT : NAVMENU_A_NEXT);
+			}
+			unsigned repeat = ne.button - NAV_REPEAT - 1;
+			if (ev.value != 0.0) {
+				m_events.push_back(ne);
+				if (ne.button > NAV_REPEAT && !m_repeating[repeat]) {
+					m_repeat[repeat] = ne;
+					m_repeating[repeat] = true;
+				}
+			} else {
+				if (ne.button > NAV_REPEAT) m_repeating[repeat] = false;
+			}
+		}
+		/// Spawn key repeat events for held buttons, called once per frame
+		void repeat(Time now) {
+			// Reset all key repeat timers if there is a latency spike
+			if (now - m_prevRepeat > 50ms) {
+				for (auto& ne: m_repeat) ne.time = now;
+			}
+			m_prevRepeat = now;
+			for (unsigned i = 0; i < REPEATS; ++i) {
+				if (!m_repeating[i]) continue;
+				NavEvent& ne = m_repeat[i];
+				Seconds delay(2.0 / (10 + ne.repeat));
+				if (now - ne.time < delay) continue;  // Not yet time to repeat
+				// Emit auto-repeated event
+				// Note: We intentionally only emit one per frame (call to repeat) to avoid surprises when latency spikes occur.
+				++ne.repeat;
+				ne.time += clockDur(delay);  // Increment rather than set to now, so that repeating is smoother.
+				m_events.push_back(ne);
+			}
+		}
+		/// Return the next available navigation event from queue, if available
+		bool get(NavEvent& ev) {
+			if (m_events.empty()) return false;
+			ev = m_events.front();
+			m_events.pop_front();
+			return true;
+		}
+	private:
+		std::deque<NavEvent> m_events;
+		/// Held buttons that auto-repeat (indexed by NavButton - NAV_REPEAT - 1)
+		static const unsigned REPEATS = NAV_VOLUME_DOWN - NAV_REPEAT;
+		NavEvent m_repeat[REPEATS];
+		bool m_repeating[REPEATS] = {};
+		Time m_prevRepeat{};
+	};
+}
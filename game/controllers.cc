@@ -1,14 +1,15 @@
 #include "controllers.hh"
 
 #include "chrono.hh"
+#include "controllers-nav.hh"
 #include "fs.hh"
 #include "libxml++-impl.hh"
+#include "log.hh"
 #include "unicode.hh"
 #include <boost/filesystem.hpp>
 #include <SDL2/SDL_joystick.h>
 #include "regex.hh"
 
-#include <deque>
 #include <stdexcept>
 #include <algorithm>
 
@@ -39,13 +40,6 @@ namespace {
 		tryGetAttribute(elem, "min", range.min);
 		tryGetAttribute(elem, "max", range.max);
 	}
-	// Return a NavButton corresponding to an Event
-	NavButton navigation(Event const& ev) {
-		#define DEFINE_BUTTON(dt, btn, num, nav) if ((DEVTYPE_##dt == DEVTYPE_GENERIC || ev.devType == DEVTYPE_##dt) && ev.button == dt##_##btn) return nav;
-		#include "controllers-buttons.ii"
-		return NAV_NONE;
-	}
-
 	std::ostream& operator<<(std::ostream& os, SourceId const& source) {
 		switch (source.type) {
 			case SOURCETYPE_NONE: return os << "(none)";
@@ -129,18 +123,12 @@ struct Controllers::Impl {
 	typedef std::map<SourceType, Hardware::ptr> HW;
 	HW m_hw;
 
-	std::deque<NavEvent> m_navEvents;
+	NavEvents m_navEvents;
+	ButtonValues m_values;
 	std::map<SourceId, DevicePtr> m_orphans;
 	std::map<SourceId, std::weak_ptr<Device> > m_devices;
 	bool m_eventsEnabled;
 	
-	typedef std::pair<SourceId, ButtonId> UniqueButton;
-	std::map<UniqueButton, double> m_values;
-
-	std::map<NavButton, NavEvent> m_navRepeat;
-
-	Time m_prevProcess{};
-
 	Impl(): m_eventsEnabled() {
 		#define DEFINE_BUTTON(devtype, button, num, nav) m_buttons[DEVTYPE_##devtype][#button] = devtype##_##button;
 		#include "controllers-buttons.ii"
@@ -255,9 +243,8 @@ struct Controllers::Impl {
 	}
 	/// Return the next available navigation event from queue, if available
 	bool getNav(NavEvent& ev) {
-		if (m_navEvents.empty()) return false;
-		ev = m_navEvents.front();
-		m_navEvents.pop_front();
+		if (!m_navEvents.get(ev)) return false;
+		if (ev.repeat) LOG("controllers", debug, "NavEvent auto repeat " << ev.repeat);
 		return true;
 	}
 	/// Register an orphan device
@@ -282,24 +269,7 @@ struct Controllers::Impl {
 				pushHWEvent(event);
 			}
 		}
-		// Reset all key repeat timers if there is a latency spike
-		if (now - m_prevProcess > 50ms) {
-			for (auto& kv: m_navRepeat) kv.second.time = now;
-		}
-		m_prevProcess = now;
-		// Spawn key repeat events when holding buttons
-		for (auto& kv: m_navRepeat) {
-			NavEvent& ne = kv.second;
-			Seconds delay(2.0 / (10 + ne.repeat));
-			Seconds since = now - ne.time;
-			if (since < delay) continue;  // Not yet time to repeat
-			// Emit auto-repeated event
-			// Note: We intentionally only emit one per frame (call to process) to avoid surprises when latency spikes occur.
-			++ne.repeat;
-			ne.time += clockDur(delay);  // Increment rather than set to now, so that repeating is smoother.
-			std::clog << "controllers/debug: NavEvent auto repeat " << ne.repeat << " after " << since.count() << " s, next delay " << delay.count() << "s " << std::endl;
-			m_navEvents.push_back(ne);
-		}
+		m_navEvents.repeat(now);
 	}
 	/// Handle an incoming SDL event
 	bool pushEvent(SDL_Event const& sdlEv, Time t) {
@@ -358,27 +328,11 @@ struct Controllers::Impl {
 	}
 	bool pushMappedEvent(Event& ev) {
 		if (ev.button == GENERIC_UNASSIGNED) return false;
-		if (!valueChanged(ev)) return false;  // Avoid repeated or other useless events
-		std::clog << "controllers/debug: processing " << ev << std::endl;
+		if (!m_values.changed(ev)) return false;  // Avoid repeated or other useless events
+		LOG("controllers", debug, "processing " << ev);
 		ev.nav = navigation(ev);
 		// Emit nav event (except if device is currently registered for events)
-		if (ev.nav != NAV_NONE) {
-			NavEvent ne(ev);
-			// Menu navigation mapping
-			{
-				bool vertical = (ev.devType == DEVTYPE_GUITAR);
-				if (ne.button == NAV_UP) ne.menu = (vertical ? NAVMENU_A_PREV : NAVMENU_B_PREV);
-				else if (ne.button == NAV_DOWN) ne.menu = (vertical ? NAVMENU_A_NEXT : NAVMENU_B_NEXT);
-				else if (ne.button == NAV_LEFT) ne.menu = (vertical ? NAVMENU_B_PREV : NAVMENU_A_PREV);
-				else if (ne.button == NAV_RIGHT) ne.menu = (vertical ? NAVMENU_B_NEXT : NAVMENU_A_NEXT);
-			}
-			if (ev.value != 0.0) {
-				m_navEvents.push_back(ne);
-				if (ne.button >= NAV_REPEAT) m_navRepeat.insert(std::make_pair(ne.button, ne));
-			} else {
-				if (ne.button >= NAV_REPEAT) m_navRepeat.erase(ne.button);
-			}
-		}
+		if (ev.nav != NAV_NONE) m_navEvents.push(ev);
 		if (m_eventsEnabled) {
 			// Emit Event and construct a new Device first if needed
 			DevicePtr ptr = m_devices[ev.source].lock();
@@ -391,16 +345,6 @@ struct Controllers::Impl {
 		}
 		return true;
 	}
-	/// Test if button's value has changed since the last call to this function
-	bool valueChanged(Event const& ev) {
-		// Find the matching UniqueButton or add a new one with NaN value
-		auto res = m_values.insert(std::make_pair(UniqueButton(ev.source, ev.button), getNaN()));
-		double& value = res.first->second;
-		// Check and update value
-		if (value == ev.value) return false;
-		value = ev.value;
-		return true;
-	}
 };
 
 // External API simply wraps self (pImpl)
@@ -413,13 +357,14 @@ void Controllers::process(Time now) { self->process(now); }
 bool Controllers::pushEvent(SDL_Event const& ev, Time t) { return self->pushEvent(ev, t); }
 
 bool Device::getEvent(Event& ev) {
-	if (m_events.empty()) return false;
-	ev = m_events.front();
-	m_events.pop_front();
+	Event const* front = m_events.front();
+	if (!front) return false;
+	ev = *front;
+	m_events.pop();
 	return true;
 }
 
 void Device::pushEvent(Event const& ev) {
-	m_events.push_back(ev);
+	m_events.push(ev);
 }
 
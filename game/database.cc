@@ -4,6 +4,24 @@
 #include "i18n.hh"
 #include <boost/filesystem.hpp>
 #include <iostream>
+#include <stdexcept>
+
+namespace {
+	const std::size_t COMPACT_RECORDS = 100;  ///< Journal length that triggers writing a new snapshot
+
+	bool write(xmlpp::Document& doc, fs::path const& file) {
+		try {
+			create_directories(file.parent_path());
+			fs::path tmp = file.string() + ".tmp";
+			doc.write_to_file_formatted(tmp.string(), "UTF-8");
+			rename(tmp, file);
+		} catch (std::exception const& e) {
+			std::clog << "database/error: Could not save " + file.string() + ": " + e.what() << std::endl;
+			return false;
+		}
+		return true;
+	}
+}
 
 Database::Database(fs::path const& filename): m_filename(filename) {
 	load();
@@ -11,13 +29,17 @@ Database::Database(fs::path const& filename): m_filename(filename) {
 
 Database::~Database() {
 	save();
+	m_journal.reset();
 }
 
 void Database::load() {
-	if (!exists(m_filename)) return;
-	try {
+	m_journal.reset();
+	Journal::Seq seq = 0;  // Journal records up to this are included in the xml
+	if (exists(m_filename)) try {
 		xmlpp::DomParser domParser(m_filename.string());
-		xmlpp::Node* nodeRoot = domParser.get_document()->get_root_node();
+		xmlpp::Element* nodeRoot = domParser.get_document()->get_root_node();
+		std::string journal = nodeRoot->get_attribute_value("journal");
+		if (!journal.empty()) seq = std::stoull(journal);
 		m_players.load(nodeRoot->find("/performous/players/player"));
 		m_songs.load(nodeRoot->find("/performous/songs/song"));
 		m_hiscores.load(nodeRoot->find("/performous/hiscores/hiscore"));
@@ -25,34 +47,60 @@ void Database::load() {
 	} catch (std::exception& e) {
 		std::clog << "database/error: Error loading " + m_filename.string() + ": " + e.what() << std::endl;
 	}
+	m_journal = std::make_unique<Journal>(fs::path(m_filename).replace_extension(".journal"), seq, [this](Journal::Fields const& fields) { replay(fields); });
+}
+
+std::unique_ptr<xmlpp::Document> Database::snapshot(Journal::Seq seq) {
+	auto doc = std::make_unique<xmlpp::Document>();
+	auto nodeRoot = doc->create_root_node("performous");
+	nodeRoot->set_attribute("journal", std::to_string(seq));
+	m_players.save(xmlpp::add_child_element(nodeRoot, "players"));
+	m_songs.save(xmlpp::add_child_element(nodeRoot, "songs"));
+	m_hiscores.save(xmlpp::add_child_element(nodeRoot, "hiscores"));
+	return doc;
 }
 
 void Database::save() {
-	try {
-		create_directories(m_filename.parent_path());
-		fs::path tmp = m_filename.string() + ".tmp";
-		{
-			xmlpp::Document doc;
-			auto nodeRoot = doc.create_root_node("performous");
-			m_players.save(xmlpp::add_child_element(nodeRoot, "players"));
-			m_songs.save(xmlpp::add_child_element(nodeRoot, "songs"));
-			m_hiscores.save(xmlpp::add_child_element(nodeRoot, "hiscores"));
-			doc.write_to_file_formatted(tmp.string(), "UTF-8");
-		}
-		rename(tmp, m_filename);
-		std::clog << "database/info: Saved " << m_players.size() << " players, " << m_songs.size() << " songs and " << m_hiscores.size() << " hiscores to " << m_filename.string() << std::endl;
-	} catch (std::exception const& e) {
-		std::clog << "database/error: Could not save " + m_filename.string() + ": " + e.what() << std::endl;
-		return;
-	}
+	if (m_compactor.joinable()) m_compactor.join();
+	Journal::Seq seq = m_journal ? m_journal->seq() : 0;
+	if (!write(*snapshot(seq), m_filename)) return;
+	if (m_journal) m_journal->drop(seq);
+	std::clog << "database/info: Saved " << m_players.size() << " players, " << m_songs.size() << " songs and " << m_hiscores.size() << " hiscores to " << m_filename.string() << std::endl;
+}
+
+void Database::compact() {
+	if (m_compactor.joinable()) m_compactor.join();
+	if (!m_journal) return;
+	Journal::Seq seq = m_journal->seq();
+	std::shared_ptr<xmlpp::Document> doc = snapshot(seq);  // Collected here, the data is not thread-safe
+	m_compactor = std::thread([this, doc, seq] {
+		if (write(*doc, m_filename)) m_journal->drop(seq);
+	});
+}
+
+void Database::journal(Journal::Fields const& fields) {
+	if (!m_journal) return;
+	m_journal->append(fields);
+	if (m_journal->size() >= COMPACT_RECORDS) compact();
+}
+
+void Database::replay(Journal::Fields const& fields) {
+	std::string const& type = fields.at(0);
+	if (type == "player") m_players.addPlayer(fields.at(2), fields.at(3), std::stoi(fields.at(1)));
+	else if (type == "song") m_songs.addSongItem(fields.at(2), fields.at(3), std::stoi(fields.at(1)));
+	else if (type == "hiscore") m_hiscores.addHiscore(std::stoi(fields.at(1)), std::stoi(fields.at(2)), std::stoi(fields.at(3)), fields.at(4));
+	else throw std::runtime_error("Unknown record type " + type);
 }
 
 void Database::addPlayer(std::string const& name, std::string const& picture, int id) {
-	m_players.addPlayer(name, picture, id);
+	id = m_players.addPlayer(name, picture, id);
+	journal({ "player", std::to_string(id), name, picture });
 }
 
 void Database::addSong(std::shared_ptr<Song> s) {
+	bool known = m_songs.lookup(s) != -1;
 	m_songs.addSong(s);
+	if (!known) journal({ "song", std::to_string(m_songs.lookup(s)), s->collateByArtistOnly, s->collateByTitleOnly });
 }
 
 void Database::addHiscore(std::shared_ptr<Song> s) {
@@ -62,6 +110,7 @@ void Database::addHiscore(std::shared_ptr<Song> s) {
 	int songid = m_songs.lookup(s);
 
 	m_hiscores.addHiscore(score, playerid, songid, track);
+	journal({ "hiscore", std::to_string(score), std::to_string(playerid), std::to_string(songid), track });
 	std::clog << "database/info: Added new hiscore " << score << " points on track " << track << " of songid " << songid << std::endl;
 }
 
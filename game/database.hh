@@ -4,10 +4,13 @@
 #include "controllers.hh"
 #include "fs.hh"
 #include "hiscore.hh"
+#include "journal.hh"
 #include "players.hh"
 #include "songitems.hh"
+#include <memory>
 #include <string>
 #include <ostream>
+#include <thread>
 
 struct ScoreItem {
 	int score;
@@ -30,6 +33,11 @@ struct ScoreItem {
   The current lists (Players and scores) are used
   to pass the information which players have won
   to the ScoreScreen and then to the players window.
+
+  Changes are appended to a journal next to the xml
+  file as they happen, so that they survive a crash.
+  The xml file is a snapshot that gets rewritten in
+  the background once the journal has grown.
  */
 class Database {
 public:
@@ -44,7 +52,7 @@ public:
 	  */
 	~Database();
 
-	/**Loads the whole database from xml.
+	/**Loads the whole database from xml and replays the journal.
 	  @exception bad_cast may be thrown if xml element is not of correct type
 	  @exception xmlpp exceptions may be thrown on any parse errors
 	  @exception PlayersException if some conditions of players fail (e.g. no id)
@@ -57,6 +65,8 @@ public:
 	  Will write out everything to the file given in the constructor, @see file()
 	*/
 	void save();
+	/**Like save() but writes the file in the background.*/
+	void compact();
 
 	friend class ScreenHiscore;
 	friend class ScreenPlayers;
@@ -99,7 +109,13 @@ public: // methods for database queries
 	bool noPlayers() const;
 
 private:
+	std::unique_ptr<xmlpp::Document> snapshot(Journal::Seq seq);
+	void journal(Journal::Fields const& fields);
+	void replay(Journal::Fields const& fields);
+
 	fs::path m_filename;
+	std::unique_ptr<Journal> m_journal;
+	std::thread m_compactor;
 
 	Players m_players;
 	Hiscore m_hiscores;
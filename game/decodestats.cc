@@ -0,0 +1,23 @@
+#include "decodestats.hh"
+
+#include <algorithm>
+#include <sstream>
+
+void DecodeStats::frame(bool degraded) {
+	++m_frames;
+	if (degraded) ++m_degraded;
+	m_total += m_current;
+	m_worst = std::max(m_worst, m_current);
+	m_current = Seconds();
+}
+
+std::string DecodeStats::dump() const {
+	std::ostringstream oss;
+	oss.precision(2);
+	oss << std::fixed << m_frames << " frames";
+	if (!m_frames) return oss.str();
+	oss << ", decode avg " << 1e3 * m_total.count() / m_frames << " ms, worst " << 1e3 * m_worst.count() << " ms";
+	if (m_convert > Seconds()) oss << ", convert avg " << 1e3 * m_convert.count() / m_frames << " ms";
+	oss << ", degraded: " << m_degraded;
+	return oss.str();
+}
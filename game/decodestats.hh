@@ -0,0 +1,47 @@
+#pragma once
+
+#include "chrono.hh"
+#include <cstddef>
+#include <string>
+
+/**
+* Decoding time statistics of a stream, for telling whether the decoder keeps up.
+* Decoding time is accumulated until the decoder outputs a frame and then attributed to that frame.
+* Updated and read by the decoder thread only.
+**/
+class DecodeStats {
+  public:
+	/// Record time spent in the decoder
+	void decoding(Clock::duration elapsed) { m_current += elapsed; }
+	/// Record time spent converting a decoded frame
+	void converting(Clock::duration elapsed) { m_convert += elapsed; }
+	/// Count a decoded frame (degraded if decoded with reduced quality)
+	void frame(bool degraded);
+	unsigned frames() const { return m_frames; }
+	unsigned degraded() const { return m_degraded; }
+	/// Average decoding time per frame
+	Seconds average() const { return m_frames ? m_total / m_frames : Seconds(); }
+	/// Longest decoding time of a frame
+	Seconds worst() const { return m_worst; }
+	/// Human-readable summary for logging
+	std::string dump() const;
+  private:
+	unsigned m_frames = 0;
+	unsigned m_degraded = 0;
+	Seconds m_current{};  ///< Decoding time not yet attributed to a frame
+	Seconds m_total{};
+	Seconds m_worst{};
+	Seconds m_convert{};
+};
+
+/**
+* Decoding quality reduction level (0 = full quality) for a decoder that is lag seconds behind the displayed
+* position (NaN if nothing is displayed). Level i is entered when lag exceeds levels[i].lag; the level rises as far
+* as needed at once, and drops one step at a time once the decoder has caught up (lag <= 0).
+**/
+template <typename Level, std::size_t N> unsigned degradeLevel(unsigned level, double lag, Level const (&levels)[N]) {
+	unsigned next = level;
+	while (next + 1 < N && lag > levels[next + 1].lag) ++next;
+	if (next == level && level > 0 && lag <= 0.0) --next;  // Caught up, try one step better quality
+	return next;
+}
@@ -4,6 +4,7 @@
 #include "song.hh"
 #include "database.hh"
 #include "configuration.hh"
+#include "threadpool.hh"
 #include <iostream>
 #include <list>
 
@@ -24,12 +25,30 @@ Engine::Engine(Audio& audio, VocalTrackPtrs vocals, Database& database):
 		m_database.cur.push_back(Player(*vocals[i], a, frames));
 		++i;
 	}
+	unsigned threads = config["audio/analysis_threads"].i();
+	if (threads == 0) threads = ThreadPool::defaultSize(analyzers.size());
+	if (threads > 1 && analyzers.size() > 1) {
+		m_analysisPool.reset(new ThreadPool(std::min<unsigned>(threads, analyzers.size())));
+		std::clog << "engine/info: Pitch analysis using " << m_analysisPool->size() << " worker threads." << std::endl;
+	}
 	m_thread.reset(new std::thread(std::ref(*this)));
 }
 
+Engine::~Engine() { kill(); }
+
+/// Process all audio captured so far; each analyzer is independent, so they can be run in parallel
+void Engine::prepare() {
+	if (!m_analysisPool) {
+		for (Player& player: m_database.cur) player.prepare();
+		return;
+	}
+	for (Player& player: m_database.cur) m_analysisPool->run([&player] { player.prepare(); });
+	m_analysisPool->wait();  // All analysis must be complete before scoring
+}
+
 void Engine::operator()() {
 	while (!m_quit) {
-		for (Player& player: m_database.cur) player.prepare();
+		prepare();
 		double t = m_audio.getPosition() - config["audio/round-trip"].f();
 		double timeLeft = m_time - t;
 		if (timeLeft != timeLeft || timeLeft > 1.0) timeLeft = 1.0;  // FIXME: Workaround for NaN values and other weirdness (should fix the weirdness instead)
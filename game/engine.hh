@@ -6,6 +6,7 @@
 #include <vector>
 
 class Audio;
+class ThreadPool;
 class Database;
 class VocalTrack;
 
@@ -15,14 +16,16 @@ class Engine {
 	double m_time;
 	std::atomic<bool> m_quit{ false };
 	Database& m_database;
+	std::unique_ptr<ThreadPool> m_analysisPool;  ///< Runs pitch analysis of all players in parallel (nullptr = serial)
 	std::unique_ptr<std::thread> m_thread;
+	void prepare();
 
   public:
 	typedef std::vector<VocalTrack*> VocalTrackPtrs;
 	static const double TIMESTEP;  ///< The duration of one engine time step in seconds
 	/// Construct an engine thread with vocal tracks and players specified by parameters
 	Engine(Audio& audio, VocalTrackPtrs vocals, Database& database);
-	~Engine() { kill(); }
+	~Engine();
 	/// Terminates processing
 	void kill() { 
 		m_quit = true;
@@ -2,10 +2,11 @@
 
 #include "chrono.hh"
 #include "config.hh"
-#include "screen_songs.hh"
+#include "configuration.hh"
 #include "util.hh"
+#include "libda/mix.hpp"
 
-#include "aubio/aubio.h"
+#include <algorithm>
 #include <memory>
 #include <iostream>
 #include <sstream>
@@ -46,12 +47,37 @@ namespace {
 		oss << major << "." << minor << "." << micro << (micro >= 100 ? "(ff)" : "(lav)");
 		return oss.str();
 	}
+
+	/// Decoder multithreading as configured (video only, audio decoding is cheap)
+	void setupThreading(AVCodecContext* cc) {
+		cc->thread_count = std::max(0, config["graphic/video_decoder_threads"].i());  // 0 = one per CPU core
+		switch (config["graphic/video_decoder_threading"].i()) {
+			case 1: cc->thread_type = FF_THREAD_FRAME; break;
+			case 2: cc->thread_type = FF_THREAD_SLICE; break;
+			default: cc->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;  // Whatever the codec supports (frame preferred)
+		}
+	}
+
+	/// Video decoding quality reduction levels, entered when the decoder is more than lag seconds behind playback
+	struct Degrade {
+		double lag;
+		AVDiscard loopFilter;
+		AVDiscard frames;
+		char const* desc;
+	};
+	Degrade const degradeLevels[] = {
+		{ 0.0, AVDISCARD_DEFAULT, AVDISCARD_DEFAULT, "full quality" },
+		{ 0.1, AVDISCARD_ALL, AVDISCARD_DEFAULT, "skipping loop filter" },
+		{ 0.5, AVDISCARD_ALL, AVDISCARD_NONREF, "skipping non-reference frames" },
+		{ 2.0, AVDISCARD_ALL, AVDISCARD_NONKEY, "decoding keyframes only" },
+	};
 }
 
 bool VideoFifo::tryPop(Bitmap& f) {
 	std::unique_lock<std::mutex> l(m_mutex);
 	if (m_queue.empty()) return false; // Nothing to deliver
 	if (m_queue.front().buf.empty()) { m_eof = true; return false; }
+	m_pool.release(f.buf);
 	f = std::move(m_queue.front());
 	m_queue.pop_front();
 	m_cond.notify_all();
@@ -66,13 +92,29 @@ void VideoFifo::push(Bitmap&& f) {
 	m_queue.emplace_back(std::move(f));
 }
 
+void VideoFifo::release(Bitmap& f) {
+	std::unique_lock<std::mutex> l(m_mutex);
+	m_pool.release(f.buf);
+}
+
+void VideoFifo::reuse(Bitmap& f) {
+	std::unique_lock<std::mutex> l(m_mutex);
+	m_pool.reuse(f.buf);
+}
+
 void VideoFifo::reset() {
 	std::unique_lock<std::mutex> l(m_mutex);
+	for (auto& f: m_queue) m_pool.release(f.buf);
 	m_queue.clear();
 	m_cond.notify_all();
+	m_demand = getNaN();
 	m_eof = false;
 }
 
+AudioBuffer::AudioBuffer(std::unique_ptr<cache::PCMFile> pcm, unsigned sps): m_data(pcm ? 0 : DEFAULT_SIZE), m_sps(sps), m_pcm(std::move(pcm)) {
+	if (m_pcm) m_duration = double(m_pcm->size()) / m_sps;
+}
+
 void AudioBuffer::reset() {
 	{
 		std::unique_lock<mutex> l(m_mutex);
@@ -87,38 +129,43 @@ void AudioBuffer::quit() {
 	m_cond.notify_one();
 }
 
-fvec_t* AudioBuffer::makePreviewBuffer() {
+void AudioBuffer::push(std::vector<std::int16_t> const& data, double timestamp) {
+	size_t silence = 0;
+	bool restart = false;
 	{
 		std::unique_lock<mutex> l(m_mutex);
-		ScreenSongs::previewSamplesBuffer.reset(new_fvec(m_data.size() / 2));
-		float previewVol = float(config["audio/preview_volume"].i()) / 100.0;
-		for (size_t rpos = 0, bpos = 0; rpos < m_data.size(); rpos += 2, bpos ++) {
-			ScreenSongs::previewSamplesBuffer->data[bpos] = (((da::conv_from_s16(m_data[rpos]) + da::conv_from_s16(m_data[rpos + 1])) / 2) / previewVol);
+		while (!condition()) m_cond.wait_for(l, 10ms);  // The audio callback does not notify, see wakeups()
+		if (m_quit) return;
+		if (timestamp < 0.0) {
+			std::clog << "ffmpeg/warning: Negative audio timestamp " << timestamp << " seconds, frame ignored." << std::endl;
+			return;
 		}
+		// Insert silence at the beginning if the stream starts later than 0.0
+		if (m_pos == 0 && timestamp >= 0.0) {
+			m_pos = std::round(float(timestamp * getSamplesPerSecond()));
+			if (m_pos % 2 == 1) { m_pos++; timestamp = float(m_pos) / getSamplesPerSecond(); }
+			m_data.resize(m_pos, 0);
+			silence = m_pos;
+			restart = true;
+		}
+		m_data.insert(m_data.end(), data.begin(), data.end());
+		m_pos += data.size();
 	}
-	m_cond.notify_one();
-	return ScreenSongs::previewSamplesBuffer.get();
-};
-
-void AudioBuffer::push(std::vector<std::int16_t> const& data, double timestamp) {
-	std::unique_lock<mutex> l(m_mutex);
-	m_cond.wait(l, [this]{ return condition(); });
-	if (m_quit) return;
-	if (timestamp < 0.0) {
-		std::clog << "ffmpeg/warning: Negative audio timestamp " << timestamp << " seconds, frame ignored." << std::endl;
-		return;
-	}
-	// Insert silence at the beginning if the stream starts later than 0.0
-	if (m_pos == 0 && timestamp >= 0.0) {
-		m_pos = std::round(float(timestamp * getSamplesPerSecond()));
-		if (m_pos % 2 == 1) { m_pos++; timestamp = float(m_pos) / getSamplesPerSecond(); }
-		m_data.resize(m_pos, 0);
-	}
-	m_data.insert(m_data.end(), data.begin(), data.end());
-	m_pos += data.size();
+	// Write to cache without holding the lock (the audio callback needs it)
+	if (!m_writer) return;
+	if (restart) m_writer->restart();  // Beginning of song (again)
+	m_writer->silence(silence);
+	m_writer->write(data.data(), data.size());
 }
 
 bool AudioBuffer::prepare(std::int64_t pos) {
+	if (m_pcm) {
+		pos = std::max<std::int64_t>(0, pos);
+		m_pcmReq = pos;
+		// Ready once prefetch has paged in enough (or all that remains)
+		std::int64_t end = std::min<std::int64_t>(pos + m_sps / 4, m_pcm->size());
+		return pos >= m_pcmBegin && end <= m_pcmEnd;
+	}
 	std::unique_lock<mutex> l(m_mutex, std::try_to_lock);
 	if (!l.owns_lock()) return false;  // Didn't get lock, give up for now
 	if (eof(pos)) return true;
@@ -130,21 +177,69 @@ bool AudioBuffer::prepare(std::int64_t pos) {
 }
 
 bool AudioBuffer::operator()(float* begin, float* end, std::int64_t pos, float volume) {
-	std::unique_lock<mutex> l(m_mutex);
-	size_t idx = pos + m_data.size() - m_pos;
-	size_t samples = end - begin;
-	for (size_t s = 0; s < samples; ++s, ++idx) {
-		if (idx < m_data.size()) begin[s] += volume * da::conv_from_s16(m_data[idx]);
+	std::int64_t samples = end - begin;
+	if (m_pcm) {
+		// Read-only mapped data, no locking or decoder involved
+		std::int64_t first = clamp<std::int64_t>(-pos, 0, samples);
+		std::int64_t last = clamp<std::int64_t>(std::int64_t(m_pcm->size()) - pos, first, samples);
+		if (last > first) da::accumulate_s16(begin + first, m_pcm->data() + pos + first, last - first, volume);
+		m_pcmReq = std::max<std::int64_t>(0, pos + samples);
+		return !eof(pos);
+	}
+	// Never wait for the decoder in the callback: if it happens to be inserting, this block is silent
+	std::unique_lock<mutex> l(m_mutex, std::try_to_lock);
+	if (!l.owns_lock()) return !eof(pos);
+	// Buffer index of the first requested sample (may be outside of the buffer at either end)
+	std::int64_t idx = pos + std::int64_t(m_data.size()) - std::int64_t(m_pos);
+	std::int64_t first = clamp<std::int64_t>(-idx, 0, samples);
+	std::int64_t last = clamp<std::int64_t>(std::int64_t(m_data.size()) - idx, first, samples);
+	// The circular buffer consists of (at most) two contiguous arrays
+	auto one = m_data.array_one();
+	auto two = m_data.array_two();
+	for (std::int64_t s = first; s < last;) {
+		std::int64_t i = idx + s;
+		bool inOne = i < std::int64_t(one.second);
+		std::int16_t const* src = inOne ? one.first + i : two.first + (i - one.second);
+		std::int64_t avail = inOne ? one.second - i : two.second - (i - one.second);
+		std::int64_t n = std::min(avail, last - s);
+		da::accumulate_s16(begin + s, src, n, volume);
+		s += n;
 	}
 	m_posReq = std::max<std::int64_t>(0, pos + samples);
 	wakeups();
 	return !eof(pos);
 }
 
+void AudioBuffer::prefetch() {
+	std::int64_t const ahead = 4 * m_sps;  // Samples kept paged in ahead of playback
+	std::int64_t const size = m_pcm->size();
+	while (!m_quit) {
+		std::int64_t req = m_pcmReq;
+		std::int64_t begin = m_pcmBegin, end = m_pcmEnd;
+		if (req < begin || req > end) begin = end = std::min(req, size);  // Seeked, start over
+		std::int64_t want = std::min(req + ahead, size);
+		if (end < want) {
+			// Only page in what is new, in steps, so that the callback sees progress
+			std::int64_t step = std::min(want, end + m_sps / 4);
+			m_pcm->prefetch(end, step);
+			end = step;
+		}
+		m_pcmEnd = end;  // Before begin, so that a seek never looks ready early
+		m_pcmBegin = begin;
+		if (end < want) continue;
+		std::unique_lock<mutex> l(m_mutex);
+		m_cond.wait_for(l, 20ms, [this]{ return m_quit.load(); });
+	}
+}
+
 FFmpeg::FFmpeg(fs::path const& _filename, unsigned int rate):
+  audioQueue(cache::PCMFile::open(_filename, rate), AUDIO_CHANNELS * rate),
   m_filename(_filename), m_rate(rate),
+  m_duration(audioQueue.cached() ? audioQueue.duration() : 0.0),
   m_mediaType(rate ? AVMEDIA_TYPE_AUDIO : AVMEDIA_TYPE_VIDEO),
-  m_thread(std::make_unique<std::thread>(std::ref(*this)))
+  m_thread(audioQueue.cached()
+    ? std::make_unique<std::thread>([this]{ audioQueue.prefetch(); })  // No decoding needed, just paging in
+    : std::make_unique<std::thread>(std::ref(*this)))
 {
 	static bool versionChecked = false;
 	if (!versionChecked) {
@@ -178,13 +273,15 @@ FFmpeg::~FFmpeg() {
 	m_quit.set_value();
 	videoQueue.reset();
 	audioQueue.quit();
-	m_thread->join();
+	if (m_thread) m_thread->join();
 }
 
 void FFmpeg::open() {
-	std::lock_guard<std::mutex> l(s_avcodec_mutex);
 #if	(LIBAVFORMAT_VERSION_INT) < (AV_VERSION_INT(58,0,0))
-	av_register_all();
+	{
+		std::lock_guard<std::mutex> l(s_avcodec_mutex);
+		av_register_all();
+	}
 #endif
 	av_log_set_level(AV_LOG_ERROR);
 	if (avformat_open_input(&m_formatContext, m_filename.string().c_str(), nullptr, nullptr)) throw std::runtime_error("Cannot open input file");
@@ -199,12 +296,20 @@ void FFmpeg::open() {
 	AVCodec* pCodec = avcodec_find_decoder(m_formatContext->streams[m_streamId]->codecpar->codec_id);
 	AVCodecContext* pCodecCtx = avcodec_alloc_context3(pCodec);
 	avcodec_parameters_to_context(pCodecCtx, m_formatContext->streams[m_streamId]->codecpar);
-	if (avcodec_open2(pCodecCtx, pCodec, nullptr) < 0) throw std::runtime_error("Cannot open codec");
+	if (m_mediaType == AVMEDIA_TYPE_VIDEO) setupThreading(pCodecCtx);
+	{
+		std::lock_guard<std::mutex> l(s_avcodec_mutex);
+		if (avcodec_open2(pCodecCtx, pCodec, nullptr) < 0) throw std::runtime_error("Cannot open codec");
+	}
 	pCodecCtx->workaround_bugs = FF_BUG_AUTODETECT;
 	m_codecContext = pCodecCtx;
 #else
 	AVCodecContext* cc = m_formatContext->streams[m_streamId]->codec;
-	if (avcodec_open2(cc, codec, nullptr) < 0) throw std::runtime_error("Cannot open codec");
+	if (m_mediaType == AVMEDIA_TYPE_VIDEO) setupThreading(cc);
+	{
+		std::lock_guard<std::mutex> l(s_avcodec_mutex);
+		if (avcodec_open2(cc, codec, nullptr) < 0) throw std::runtime_error("Cannot open codec");
+	}
 	cc->workaround_bugs = FF_BUG_AUTODETECT;
 	m_codecContext = cc;
 #endif
@@ -230,6 +335,9 @@ void FFmpeg::open() {
 		  m_codecContext->width, m_codecContext->height, m_codecContext->pix_fmt,
 		  width, height, AV_PIX_FMT_RGB24,
 		  SWS_POINT, nullptr, nullptr, nullptr);
+		std::clog << "ffmpeg/debug: Decoding " << m_filename.filename().string() << " (" << width << "x" << height << ") using "
+		  << m_codecContext->thread_count << " threads" << (m_codecContext->active_thread_type & FF_THREAD_FRAME ? " (frame)" :
+		  m_codecContext->active_thread_type & FF_THREAD_SLICE ? " (slice)" : "") << std::endl;
 		break;
 	default:  // Should never be reached but avoids compile warnings
 		abort();
@@ -240,6 +348,7 @@ void FFmpeg::operator()() {
 	try { open(); } catch (std::exception const& e) { std::clog << "ffmpeg/error: Failed to open " << m_filename << ": " << e.what() << std::endl; return; }
 	m_duration = m_formatContext->duration / double(AV_TIME_BASE);
 	audioQueue.setDuration(m_duration);
+	if (m_mediaType == AVMEDIA_TYPE_AUDIO) audioQueue.setCacheWriter(cache::PCMWriter::create(m_filename, m_rate));
 	int errors = 0;
 	bool eof = false;
 	std::clog << "audio/debug: FFmpeg processing " << m_filename.filename().string() << std::endl;
@@ -252,20 +361,25 @@ void FFmpeg::operator()() {
 			errors = 0;
 		} catch (eof_error&) {
 			videoQueue.push(Bitmap()); // EOF marker
+			audioQueue.commitCache();  // Decoded everything, replays can use the cache
 			eof = true;
 			std::clog << "ffmpeg/debug: done loading " << m_filename << std::endl;
 		} catch (std::exception& e) {
 			std::clog << "ffmpeg/error: " << m_filename << ": " << e.what() << std::endl;
+			audioQueue.abortCache();  // May have lost data
 			if (++errors > 2) { std::clog << "ffmpeg/error: FFMPEG terminating due to multiple errors" << std::endl; break; }
 		}
 	}
+	std::clog << "ffmpeg/info: " << m_filename.filename().string() << (m_mediaType == AVMEDIA_TYPE_VIDEO ? " video: " : " audio: ") << m_stats.dump() << std::endl;
 	m_quit_future.wait();  // Wait until we are requested to quit before clearing queues
 	audioQueue.reset();
 	videoQueue.reset();
 	// TODO: use RAII for freeing resources (to prevent memory leaks)
-	std::lock_guard<std::mutex> l(s_avcodec_mutex); // avcodec_close is not thread-safe
 	if (m_resampleContext) swr_close(m_resampleContext);
-	if (m_codecContext) avcodec_close(m_codecContext);
+	if (m_codecContext) {
+		std::lock_guard<std::mutex> l(s_avcodec_mutex); // avcodec_close is not thread-safe
+		avcodec_close(m_codecContext);
+	}
 #if LIBAVFORMAT_VERSION_INT >= AV_VERSION_INT(53, 17, 0)
 	if (m_formatContext) avformat_close_input(&m_formatContext);
 #else
@@ -284,6 +398,7 @@ void FFmpeg::seek_internal() {
 	audioQueue.reset();
 	int flags = 0;
 	if (m_seekTarget < m_position) flags |= AVSEEK_FLAG_BACKWARD;
+	if (m_seekTarget > 0.0) audioQueue.abortCache();  // Only complete decodes from the beginning are cached
 	av_seek_frame(m_formatContext, -1, m_seekTarget * AV_TIME_BASE, flags);
 	m_seekTarget = getNaN(); // Signal that seeking is done
 }
@@ -304,6 +419,7 @@ private:
 void FFmpeg::decodePacket() {
 #if LIBAVCODEC_VERSION_INT >= (AV_VERSION_INT(57, 37, 0))
 	AVPacket pkt;
+	std::shared_ptr<AVFrame> frame(av_frame_alloc(), [](AVFrame* ptr) { av_frame_free(&ptr); });
 	while (true) {
 		// FIXME: we might want to take a look at m_quit.
 		int ret = av_read_frame(m_formatContext, &pkt);
@@ -315,7 +431,10 @@ void FFmpeg::decodePacket() {
 		}
 		if (terminating() || m_seekTarget == m_seekTarget) return; // something weird required
 		if (pkt.stream_index != m_streamId) return; // wrong stream
+		if (m_mediaType == AVMEDIA_TYPE_VIDEO) adaptDecoding();
+		Time start = Clock::now();
 		ret = avcodec_send_packet(m_codecContext, &pkt);
+		m_stats.decoding(Clock::now() - start);
 		if(ret == AVERROR_EOF) {
 			// End of file: no more data to read.
 			throw FFmpeg::eof_error();
@@ -326,8 +445,9 @@ void FFmpeg::decodePacket() {
 			throw FfmpegError(ret);
 		}
 		while (ret >= 0) {
-			std::shared_ptr<AVFrame> frame(av_frame_alloc(), [](AVFrame* ptr) { av_frame_free(&ptr); });
-			ret = avcodec_receive_frame(m_codecContext, frame.get());
+			start = Clock::now();
+			ret = avcodec_receive_frame(m_codecContext, frame.get());  // Unrefs the previous frame
+			m_stats.decoding(Clock::now() - start);
 			if(ret == AVERROR_EOF) {
 				// End of file: no more data.
 				throw FFmpeg::eof_error();
@@ -338,6 +458,7 @@ void FFmpeg::decodePacket() {
 				throw FfmpegError(ret);
 			}
 			// frame is available here
+			m_stats.frame(m_degrade > 0);
 			if (frame->pts != int64_t(AV_NOPTS_VALUE)) {
 				m_position = double(frame->pts) * av_q2d(m_formatContext->streams[m_streamId]->time_base);
 				if (m_formatContext->start_time != int64_t(AV_NOPTS_VALUE))
@@ -369,18 +490,22 @@ void FFmpeg::decodePacket() {
 		if (packetSize < 0) throw std::logic_error("negative packet size?!");
 		if (terminating() || m_seekTarget == m_seekTarget) return;
 		if (packet.stream_index != m_streamId) return;
+		if (m_mediaType == AVMEDIA_TYPE_VIDEO) adaptDecoding();
 #if (LIBAVCODEC_VERSION_INT) < (AV_VERSION_INT(55,0,0))
 		std::shared_ptr<AVFrame> frame(avcodec_alloc_frame(), &av_free);
 #else
 		std::shared_ptr<AVFrame> frame(av_frame_alloc(), [](AVFrame* ptr) { av_frame_free(&ptr); });
 #endif
 		int frameFinished = 0;
+		Time start = Clock::now();
 		int decodeSize = (m_mediaType == AVMEDIA_TYPE_VIDEO ?
 		  avcodec_decode_video2(m_codecContext, frame.get(), &frameFinished, &packet) :
 		  avcodec_decode_audio4(m_codecContext, frame.get(), &frameFinished, &packet));
+		m_stats.decoding(Clock::now() - start);
 		if (decodeSize < 0) return; // Packet didn't produce any output (could be waiting for B frames or something)
 		packetSize -= decodeSize; // Move forward within the packet
 		if (!frameFinished) continue;
+		m_stats.frame(m_degrade > 0);
 		// Update current position if timecode is available
 		if (frame->pkt_pts != int64_t(AV_NOPTS_VALUE)) {
 			m_position = double(frame->pkt_pts) * av_q2d(m_formatContext->streams[m_streamId]->time_base);
@@ -392,18 +517,34 @@ void FFmpeg::decodePacket() {
 #endif
 }
 
+void FFmpeg::adaptDecoding() {
+	// How far behind the displayed position the decoder is (NaN if nothing is being displayed)
+	double lag = videoQueue.demanded() - m_position;
+	unsigned level = degradeLevel(m_degrade, lag, degradeLevels);
+	if (level == m_degrade) return;
+	std::clog << "ffmpeg/debug: " << m_filename.filename().string();
+	if (level > m_degrade) std::clog << " is " << lag << " s behind playback, "; else std::clog << " caught up, ";
+	std::clog << degradeLevels[level].desc << std::endl;
+	m_degrade = level;
+	m_codecContext->skip_loop_filter = degradeLevels[level].loopFilter;
+	m_codecContext->skip_frame = degradeLevels[level].frames;
+}
+
 void FFmpeg::processVideo(AVFrame* frame) {
 	// Convert into RGB and scale the data
 	int w = (m_codecContext->width+15)&~15;
 	int h = m_codecContext->height;
 	Bitmap f;
+	videoQueue.reuse(f);  // Same size as before, so resize() does not allocate
 	f.timestamp = m_position;
 	f.fmt = pix::RGB;
 	f.resize(w, h);
 	{
 		uint8_t* data = f.data();
-		int linesize = w * 3;
+		int linesize = f.stride();
+		Time start = Clock::now();
 		sws_scale(m_swsContext, frame->data, frame->linesize, 0, h, &data, &linesize);
+		m_stats.converting(Clock::now() - start);
 	}
 	videoQueue.push(std::move(f));  // Takes ownership and may block until there is space
 }
@@ -1,10 +1,12 @@
 #pragma once
 
+#include "bufferpool.hh"
 #include "chrono.hh"
+#include "decodestats.hh"
+#include "pcmcache.hh"
 #include "texture.hh"
 #include "util.hh"
 #include "libda/sample.hpp"
-#include "aubio/aubio.h"
 #include <boost/circular_buffer.hpp>
 #include <atomic>
 #include <condition_variable>
@@ -14,6 +16,7 @@
 #include <iostream>
 #include <memory>
 #include <mutex>
+#include <string>
 #include <thread>
 #include <vector>
 
@@ -32,14 +35,22 @@ struct AudioFrame {
 class VideoFifo {
   public:
 	VideoFifo(): m_timestamp(), m_eof() {}
-	/// trys to pop a video frame from queue
+	/// trys to pop a video frame from queue (the old buffer of f is recycled)
 	bool tryPop(Bitmap& f);
 	/// Add frame to queue
 	void push(Bitmap&& f);
+	/// Give a frame buffer back for reuse once its content is no longer needed (leaves f empty)
+	void release(Bitmap& f);
+	/// Provide a recycled frame buffer (if any) for f to decode into
+	void reuse(Bitmap& f);
 	/// Clear and unlock the queue
 	void reset();
 	/// Returns the current position (seconds)
 	double position() const { return m_timestamp; }
+	/// Tell the decoder which position is being displayed, so that it can tell when it falls behind
+	void demand(double time) { m_demand = time; }
+	/// The position last displayed, NaN if none since reset
+	double demanded() const { return m_demand; }
 	/// Tests if EOF has already been reached
 	double eof() const { return m_eof; }
 
@@ -48,14 +59,27 @@ class VideoFifo {
 	mutable std::mutex m_mutex;
 	std::condition_variable m_cond;
 	double m_timestamp;
+	std::atomic<double> m_demand{ getNaN() };
 	bool m_eof;
 	static const unsigned m_max = 20;
+	static const unsigned m_poolMax = m_max + 2;  ///< Enough for a full queue and the frames in use
+	BufferPool<std::vector<unsigned char>> m_pool{ m_poolMax };  ///< Frame buffers for reuse, so that decoding does not allocate
 };
 
 class AudioBuffer {
 	typedef std::recursive_mutex mutex;
   public:
-	AudioBuffer(size_t size = 4320256): m_data(size) {}
+	static const size_t DEFAULT_SIZE = 4320256;
+	AudioBuffer(size_t size = DEFAULT_SIZE): m_data(size) {}
+	/// Play from a cached decode (if not null) instead of buffering the decoder output
+	AudioBuffer(std::unique_ptr<cache::PCMFile> pcm, unsigned sps);
+	/// True if playing from cache (no decoding needed)
+	bool cached() const { return m_pcm != nullptr; }
+	/// Store everything pushed from now on into the PCM cache (decoder thread only)
+	void setCacheWriter(std::unique_ptr<cache::PCMWriter> writer) { m_writer = std::move(writer); }
+	/// Finalize the cache entry at EOF, or abandon it (e.g. when seeking forward) (decoder thread only)
+	void commitCache() { if (m_writer) m_writer->commit(); m_writer.reset(); }
+	void abortCache() { m_writer.reset(); }
 	/// Reset from FFMPEG side (seeking to beginning or terminate stream)
 	void reset();
 	void quit();
@@ -63,23 +87,28 @@ class AudioBuffer {
 	void setSamplesPerSecond(unsigned sps) { m_sps = sps; }
 	/// get samples per second
 	unsigned getSamplesPerSecond() const { return m_sps; }
-	fvec_t* makePreviewBuffer();
 	void push(std::vector<std::int16_t> const& data, double timestamp);
+	/// Request data from pos on; returns true when it can be played without waiting (called from the audio callback)
 	bool prepare(std::int64_t pos);
 	bool operator()(float* begin, float* end, std::int64_t pos, float volume = 1.0f);
+	/// Keep the cached decode paged in ahead of the playback position until quit (runs in its own thread)
+	void prefetch();
 	bool eof(std::int64_t pos) const { return double(pos) / m_sps >= m_duration; }
 	void setEof() { m_duration = double(m_pos) / m_sps; }
 	double duration() const { return m_duration; }
 	void setDuration(double seconds) { m_duration = seconds; }
 	bool wantSeek() {
+		if (m_pcm) return false;
 		// Are we already past the requested position? (need to seek backward or back to beginning)
 		return m_posReq > 0 && m_posReq + m_sps * 2 /* seconds tolerance */ + m_data.size() < m_pos;
 	}
   private:
-	/// Handle waking up of input thread etc. whenever m_posReq is changed.
+	/// Handle a change of m_posReq by the audio callback (m_mutex held). Does not notify, because notifying
+	/// a condition_variable_any locks; the decoder polls for requests instead.
 	void wakeups() {
-		if (wantSeek()) reset();
-		else if (condition()) m_cond.notify_one();
+		if (!wantSeek()) return;
+		m_data.clear();  // Keeps the capacity
+		m_pos = 0;
 	}
 	bool wantMore() { return m_pos < m_posReq + m_data.capacity() / 2; }
 	/// Should the input stop waiting?
@@ -92,6 +121,12 @@ class AudioBuffer {
 	unsigned m_sps = 0;
 	double m_duration = getNaN();
 	std::atomic<bool> m_quit{ false };
+	std::unique_ptr<cache::PCMFile> m_pcm;  ///< Cached decode, replaces m_data if available
+	// The audio callback reads m_pcm directly, so prefetch() pages it in ahead of the position requested
+	std::atomic<std::int64_t> m_pcmReq{ 0 };  ///< Playback position (samples)
+	std::atomic<std::int64_t> m_pcmBegin{ 0 };  ///< Range paged in by prefetch()
+	std::atomic<std::int64_t> m_pcmEnd{ 0 };
+	std::unique_ptr<cache::PCMWriter> m_writer;
 };
 
 // ffmpeg forward declarations
@@ -127,6 +162,7 @@ class FFmpeg {
 	void seek_internal();
 	void open();
 	void decodePacket();
+	void adaptDecoding();  ///< Reduce video decoding quality while behind playback, restore it once caught up
 	void processVideo(AVFrame* frame);
 	void processAudio(AVFrame* frame);
 	fs::path m_filename;
@@ -143,8 +179,10 @@ class FFmpeg {
 	AVCodecContext* m_codecContext = nullptr;
 	SwrContext* m_resampleContext = nullptr;
 	SwsContext* m_swsContext = nullptr;
+	unsigned m_degrade = 0;  ///< Video decoding quality reduction level, 0 for full quality
+	DecodeStats m_stats;
 	// Make sure the thread starts only after initializing everything else
 	std::unique_ptr<std::thread> m_thread;
-	static std::mutex s_avcodec_mutex; // Used for avcodec_open/close (which use some static crap and are thus not thread-safe)
+	static std::mutex s_avcodec_mutex; // Used for avcodec_open2/close only (older versions use some static crap and are thus not thread-safe)
 };
 
@@ -0,0 +1,36 @@
+#include "hiscore.hh"
+
+#include "libxml++-impl.hh"
+
+#include <stdexcept>
+#include <string>
+
+void Hiscore::load(xmlpp::NodeSet const& nodes) {
+	for (auto const& n: nodes) {
+		xmlpp::Element& element = dynamic_cast<xmlpp::Element&>(*n);
+		xmlpp::Attribute* a_playerid = element.get_attribute("playerid");
+		if (!a_playerid) throw std::runtime_error("Attribute playerid not found");
+		xmlpp::Attribute* a_songid = element.get_attribute("songid");
+		if (!a_songid) throw std::runtime_error("Attribute songid not found");
+		xmlpp::Attribute* a_track = element.get_attribute("track");
+
+		int playerid = std::stoi(a_playerid->get_value());
+		int songid = std::stoi(a_songid->get_value());
+
+		auto tn = xmlpp::get_first_child_text(element);
+		if (!tn) throw std::runtime_error("Score not found");
+		int score = std::stoi(tn->get_content());
+
+		addHiscore(score, playerid, songid, a_track ? a_track->get_value() : "vocals");
+	}
+}
+
+void Hiscore::save(xmlpp::Element *hiscores) {
+	for (auto const& h: m_hiscore) {
+		xmlpp::Element* hiscore = xmlpp::add_child_element(hiscores, "hiscore");
+		hiscore->set_attribute("playerid", std::to_string(h.playerid));
+		hiscore->set_attribute("songid", std::to_string(h.songid));
+		hiscore->set_attribute("track", h.track);
+		hiscore->add_child_text(std::to_string(h.score));
+	}
+}
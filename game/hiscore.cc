@@ -1,74 +1,54 @@
 #include "hiscore.hh"
 
-#include "libxml++-impl.hh"
-
-#include <algorithm>
-#include <sstream>
 #include <stdexcept>
 
+/// Call f with hiscores in order until it returns false, only visiting the bucket of songid or playerid if given (-1 means any)
+template <typename F> void Hiscore::each(unsigned playerid, unsigned songid, F f) const {
+	auto visit = [&f](std::unordered_map<unsigned, bucket_t> const& index, unsigned id) {
+		auto it = index.find(id);
+		if (it == index.end()) return;
+		for (auto const& h: it->second) if (!f(*h)) return;
+	};
+	if (songid != unsigned(-1)) visit(m_bySong, songid);
+	else if (playerid != unsigned(-1)) visit(m_byPlayer, playerid);
+	else for (auto const& h: m_hiscore) if (!f(h)) return;
+}
+
 bool Hiscore::reachedHiscore(unsigned score, unsigned songid, std::string const& track) const {
 	if (score > 10000) throw std::logic_error("Invalid score value");
 	if (score < 2000) return false; // come on, did you even try to sing?
 
 	unsigned position = 0;
-	for (auto const& elem: m_hiscore) {
-		if (elem.songid != songid) continue;
-		if (elem.track != track) continue;
-		if (score > elem.score) return true; // seems like you are in top 3!
-		if (++position == 3) return false; // not in top 3 -> leave
-	}
-	return true; // nothing found for that song -> true
+	bool reached = true; // nothing found for that song -> true
+	each(-1, songid, [&](HiscoreItem const& elem) {
+		if (elem.track != track) return true;
+		if (score > elem.score) return false; // seems like you are in top 3!
+		if (++position == 3) { reached = false; return false; } // not in top 3 -> leave
+		return true;
+	});
+	return reached;
 }
 
 void Hiscore::addHiscore(unsigned score, unsigned playerid, unsigned songid, std::string const& track) {
 	if (track.empty()) throw std::runtime_error("No track given");
 	if (!reachedHiscore(score, songid, track)) return;
-	m_hiscore.insert(HiscoreItem(score, playerid, songid, track));
+	auto it = m_hiscore.insert(HiscoreItem(score, playerid, songid, track));
+	m_bySong[songid].insert(it);
+	m_byPlayer[playerid].insert(it);
 }
 
 Hiscore::HiscoreVector Hiscore::queryHiscore(unsigned max, unsigned playerid, unsigned songid, std::string const& track) const {
 	HiscoreVector hv;
-	for (auto const& h: m_hiscore) {
-		if (playerid != unsigned(-1) && playerid != h.playerid) continue;
-		if (songid != unsigned(-1) && songid != h.songid) continue;
-		if (!track.empty() && track != h.track) continue;
-		if (--max == 0) break;
+	each(playerid, songid, [&](HiscoreItem const& h) {
+		if (playerid != unsigned(-1) && playerid != h.playerid) return true;
+		if (!track.empty() && track != h.track) return true;
+		if (--max == 0) return false;
 		hv.push_back(h);
-	}
+		return true;
+	});
 	return hv;
 }
 
 bool Hiscore::hasHiscore(unsigned songid) const {
-	for (auto const& h: m_hiscore) if (songid == h.songid) return true;
-	return false;
-}
-
-void Hiscore::load(xmlpp::NodeSet const& nodes) {
-	for (auto const& n: nodes) {
-		xmlpp::Element& element = dynamic_cast<xmlpp::Element&>(*n);
-		xmlpp::Attribute* a_playerid = element.get_attribute("playerid");
-		if (!a_playerid) throw std::runtime_error("Attribute playerid not found");
-		xmlpp::Attribute* a_songid = element.get_attribute("songid");
-		if (!a_songid) throw std::runtime_error("Attribute songid not found");
-		xmlpp::Attribute* a_track = element.get_attribute("track");
-
-		int playerid = std::stoi(a_playerid->get_value());
-		int songid = std::stoi(a_songid->get_value());
-
-		auto tn = xmlpp::get_first_child_text(element);
-		if (!tn) throw std::runtime_error("Score not found");
-		int score = std::stoi(tn->get_content());
-
-		addHiscore(score, playerid, songid, a_track ? a_track->get_value() : "vocals");
-	}
-}
-
-void Hiscore::save(xmlpp::Element *hiscores) {
-	for (auto const& h: m_hiscore) {
-		xmlpp::Element* hiscore = xmlpp::add_child_element(hiscores, "hiscore");
-		hiscore->set_attribute("playerid", std::to_string(h.playerid));
-		hiscore->set_attribute("songid", std::to_string(h.songid));
-		hiscore->set_attribute("track", h.track);
-		hiscore->add_child_text(std::to_string(h.score));
-	}
+	return m_bySong.find(songid) != m_bySong.end();
 }
@@ -3,6 +3,7 @@
 #include "libxml++.hh"
 
 #include <set>
+#include <unordered_map>
 #include <string>
 #include <vector>
 
@@ -55,5 +56,13 @@ public:
 	std::size_t size() const { return m_hiscore.size(); }
 private:
 	typedef std::multiset<HiscoreItem> hiscore_t;
+	/// Orders bucket entries like m_hiscore (highest score first, equal scores in insertion order)
+	struct ByScore {
+		bool operator()(hiscore_t::const_iterator a, hiscore_t::const_iterator b) const { return *a < *b; }
+	};
+	typedef std::multiset<hiscore_t::const_iterator, ByScore> bucket_t;
+	template <typename F> void each(unsigned playerid, unsigned songid, F f) const;
 	hiscore_t m_hiscore;
+	std::unordered_map<unsigned, bucket_t> m_bySong;  ///< Hiscores of each song, so that per song queries need not scan everything
+	std::unordered_map<unsigned, bucket_t> m_byPlayer;  ///< Hiscores of each player
 };
@@ -0,0 +1,62 @@
+#include "httpcache.hh"
+#include "util.hh"
+
+#include <cstdlib>
+#include <sstream>
+#include <zlib.h>
+
+namespace httpcache {
+	std::vector<unsigned char> gzip(std::string const& data, int level) {
+		std::vector<unsigned char> out;
+		z_stream z = {};
+		if (deflateInit2(&z, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) return out;  // 15 + 16 = gzip format
+		out.resize(deflateBound(&z, data.size()));
+		z.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+		z.avail_in = data.size();
+		z.next_out = out.data();
+		z.avail_out = out.size();
+		bool ok = deflate(&z, Z_FINISH) == Z_STREAM_END;
+		out.resize(ok ? z.total_out : 0);
+		deflateEnd(&z);
+		return out;
+	}
+
+	std::string etag(std::string const& data, char const* suffix) {
+		std::ostringstream oss;
+		oss << '"' << std::hex << fnv1a64(data) << suffix << '"';
+		return oss.str();
+	}
+
+	namespace {
+		/// Call f with each item of a comma-separated header value, without surrounding whitespace
+		template <typename F> bool anyItem(std::string const& value, F f) {
+			std::size_t begin = 0;
+			while (begin <= value.size()) {
+				std::size_t end = value.find(',', begin);
+				if (end == std::string::npos) end = value.size();
+				std::size_t first = value.find_first_not_of(" \t", begin);
+				std::size_t last = value.find_last_not_of(" \t", end - 1);
+				if (first < end && last != std::string::npos && last >= first && f(value.substr(first, last - first + 1))) return true;
+				begin = end + 1;
+			}
+			return false;
+		}
+	}
+
+	bool acceptsGzip(std::string const& acceptEncoding) {
+		return anyItem(acceptEncoding, [](std::string const& item) {
+			std::string coding = item.substr(0, item.find(';'));
+			coding.erase(coding.find_last_not_of(" \t") + 1);
+			if (coding != "gzip" && coding != "x-gzip" && coding != "*") return false;
+			std::size_t q = item.find("q=");
+			return q == std::string::npos || std::strtod(item.c_str() + q + 2, nullptr) > 0.0;
+		});
+	}
+
+	bool etagMatches(std::string const& ifNoneMatch, std::string const& etag) {
+		// Weak comparison, as If-None-Match uses (a W/ prefix is ignored)
+		return anyItem(ifNoneMatch, [&etag](std::string const& item) {
+			return item == "*" || item == etag || (item.compare(0, 2, "W/") == 0 && item.substr(2) == etag);
+		});
+	}
+}
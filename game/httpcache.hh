@@ -0,0 +1,16 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+/// Content helpers for cached HTTP responses of the webserver (see RequestHandler::ReplyCached)
+namespace httpcache {
+	/// Compress data in gzip format at given zlib level, returns an empty vector on failure
+	std::vector<unsigned char> gzip(std::string const& data, int level);
+	/// Strong ETag of the content (quoted 64-bit FNV-1a), so that it stays valid across restarts
+	std::string etag(std::string const& data, char const* suffix = "");
+	/// Does an Accept-Encoding header value allow gzip (and not with q=0)
+	bool acceptsGzip(std::string const& acceptEncoding);
+	/// Does an If-None-Match header value (a list of ETags or *) match etag
+	bool etagMatches(std::string const& ifNoneMatch, std::string const& etag);
+}
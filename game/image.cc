@@ -1,5 +1,6 @@
 #include "fs.hh"
 #include "image.hh"
+#include "log.hh"
 
 #include <boost/filesystem/fstream.hpp>
 #include <boost/filesystem/path.hpp>
@@ -97,7 +98,7 @@ namespace {
 void writePNG(fs::path const& filename, Bitmap const& img, unsigned stride) {
 	fs::path name = filename;
 	// We use PNG in a non-standard way, with premultiplied alpha, signified by .premul.png extension.
-	std::clog << "image/debug: Saving PNG: " + name.string() << std::endl;
+	LOG("image", debug, "Saving PNG: " << name.string());
 	std::vector<png_bytep> rows(img.height);
 	// Determine color type and bytes per pixel
 	unsigned char bpp;
@@ -136,7 +137,7 @@ void writePNG(fs::path const& filename, Bitmap const& img, unsigned stride) {
 }
 
 void loadPNG(Bitmap& bitmap, fs::path const& filename) {
-	std::clog << "image/debug: Loading PNG: " + filename.string() << std::endl;
+	LOG("image", debug, "Loading PNG: " << filename.string());
 	// A hack to assume linear premultiplied data if file extension is .premul.png (used for cached SVGs)
 	if (filename.stem().extension() == "premul") bitmap.linearPremul = true;
 	ifstream file(filename, std::ios::binary);
@@ -156,7 +157,7 @@ void loadPNG(Bitmap& bitmap, fs::path const& filename) {
 }
 
 void loadJPEG(Bitmap& bitmap, fs::path const& filename) {
-	std::clog << "image/debug: Loading JPEG: " + filename.string() << std::endl;
+	LOG("image", debug, "Loading JPEG: " << filename.string());
 	bitmap.fmt = pix::RGB;
 	struct my_jpeg_error_mgr jerr;
 	BinaryBuffer data = readFile(filename);
@@ -15,7 +15,9 @@ namespace pix { enum Format {
 	CHAR_RGBA,  // libpng w/ alpha: non-premul sRGB (RGBA byte order)
 	RGB,  // libpng w/o alpha, libjpeg, ffmpeg: sRGB (RGB byte order, no padding)
 	BGR  // OpenCV/webcam: sRGB (BGR byte order, no padding)
-}; }
+};
+	inline unsigned bytesPerPixel(Format fmt) { return fmt == RGB || fmt == BGR ? 3 : 4; }
+}
 
 struct Bitmap {
 	std::vector<unsigned char> buf;  // Pixel data if owned by Bitmap
@@ -27,11 +29,13 @@ struct Bitmap {
 	bool linearPremul;  // Is the data linear RGB and premultiplied (as opposed to sRGB and non-premultiplied)
 	bool bottomFirst;  // Upside-down (only used for taking screenshots)
 	Bitmap(unsigned char* ptr = nullptr): ptr(ptr), width(), height(), ar(), timestamp(), fmt(pix::CHAR_RGBA), linearPremul(), bottomFirst() {}
+	/// Bytes per row (rows are 4-byte aligned, which is how OpenGL reads them by default); set fmt before resize()
+	unsigned stride() const { return (width * pix::bytesPerPixel(fmt) + 3) & ~3u; }
 	void resize(unsigned w, unsigned h) {
-		if (!ptr) buf.resize(w * h * 4); else buf.clear();
 		width = w;
 		height = h;
 		ar = float(w) / float(h);
+		if (!ptr) buf.resize(stride() * h); else buf.clear();
 	}
 	void swap(Bitmap& b) {
 		if (ptr || b.ptr) throw std::logic_error("Cannot Bitmap::swap foreign pointers.");
@@ -0,0 +1,161 @@
+#include "journal.hh"
+
+#include <boost/filesystem.hpp>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+#if ((BOOST_VERSION / 100 % 1000) >= 55)
+#include <boost/predef/os.h>
+#else
+#include "../boost_predef/os.h"
+#endif
+
+#if (BOOST_OS_WINDOWS)
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace {
+	std::string escape(std::string const& str) {
+		std::string ret;
+		for (char c: str) {
+			if (c == '\\') ret += "\\\\";
+			else if (c == '\t') ret += "\\t";
+			else if (c == '\n') ret += "\\n";
+			else ret += c;
+		}
+		return ret;
+	}
+
+	/// Parse a complete record line, returns false if it is malformed
+	bool parse(std::string const& line, Journal::Seq& seq, Journal::Fields& fields) {
+		fields.assign(1, std::string());
+		for (std::size_t i = 0; i < line.size(); ++i) {
+			char c = line[i];
+			if (c == '\t') { fields.emplace_back(); continue; }
+			if (c == '\\' && ++i < line.size()) c = line[i] == 't' ? '\t' : line[i] == 'n' ? '\n' : line[i];
+			fields.back() += c;
+		}
+		try {
+			std::size_t pos;
+			seq = std::stoull(fields.front(), &pos);
+			if (pos != fields.front().size()) return false;
+		} catch (std::exception&) { return false; }
+		fields.erase(fields.begin());
+		return true;
+	}
+
+	/// Call f(seq, line, fields) for each complete record of file
+	template <typename F> void readRecords(fs::path const& file, F f) {
+		std::ifstream in(file.string(), std::ios::binary);
+		std::string line;
+		Journal::Seq seq;
+		Journal::Fields fields;
+		while (std::getline(in, line)) {
+			if (in.eof()) break;  // No newline, the write was interrupted
+			if (parse(line, seq, fields)) f(seq, line, fields);
+			else std::clog << "journal/warning: Ignoring malformed record in " << file.string() << std::endl;
+		}
+	}
+
+	void sync(std::FILE* fp) {
+		std::fflush(fp);
+	#if (BOOST_OS_WINDOWS)
+		_commit(_fileno(fp));
+	#else
+		fsync(fileno(fp));
+	#endif
+	}
+}
+
+Journal::Journal(fs::path const& file, Seq after, std::function<void(Fields const&)> const& replay):
+  m_file(file), m_seq(after), m_drop(after), m_dropped(after)
+{
+	std::size_t count = 0;
+	readRecords(m_file, [&](Seq seq, std::string const&, Fields const& fields) {
+		if (seq <= m_seq) return;  // Already stored elsewhere
+		try { replay(fields); } catch (std::exception& e) {
+			std::clog << "journal/warning: Record " << seq << " of " << m_file.string() << " ignored: " << e.what() << std::endl;
+		}
+		m_seq = seq;
+		++count;
+	});
+	if (count) std::clog << "journal/info: Replayed " << count << " records from " << m_file.string() << std::endl;
+	rewrite(after);
+	m_fp = std::fopen(m_file.string().c_str(), "ab");
+	if (!m_fp) std::clog << "journal/error: Cannot open " << m_file.string() << " for writing" << std::endl;
+	m_thread = std::thread(&Journal::writer, this);
+}
+
+Journal::~Journal() {
+	{
+		std::lock_guard<std::mutex> l(m_mutex);
+		m_quit = true;
+	}
+	m_cond.notify_one();
+	m_thread.join();
+	if (m_fp) std::fclose(m_fp);
+}
+
+Journal::Seq Journal::append(Fields const& fields) {
+	std::lock_guard<std::mutex> l(m_mutex);
+	Seq seq = ++m_seq;
+	m_pending += std::to_string(seq);
+	for (auto const& f: fields) m_pending += '\t' + escape(f);
+	m_pending += '\n';
+	m_cond.notify_one();
+	return seq;
+}
+
+void Journal::drop(Seq seq) {
+	std::lock_guard<std::mutex> l(m_mutex);
+	if (seq <= m_drop) return;
+	m_drop = seq;
+	m_cond.notify_one();
+}
+
+void Journal::writer() {
+	std::unique_lock<std::mutex> l(m_mutex);
+	while (true) {
+		m_cond.wait(l, [this]{ return m_quit || !m_pending.empty() || m_drop > m_dropped; });
+		std::string data;
+		data.swap(m_pending);
+		Seq drop = m_drop;
+		bool quit = m_quit;
+		l.unlock();
+		// Everything appended meanwhile gets written (and synced) together
+		if (!data.empty() && m_fp) {
+			if (std::fwrite(data.data(), 1, data.size(), m_fp) != data.size()) std::clog << "journal/error: Writing " << m_file.string() << " failed" << std::endl;
+			sync(m_fp);
+		}
+		if (drop > m_dropped) {
+			if (m_fp) std::fclose(m_fp);
+			rewrite(drop);
+			m_fp = std::fopen(m_file.string().c_str(), "ab");
+		}
+		l.lock();
+		m_dropped = drop;
+		if (quit && m_pending.empty()) break;
+	}
+}
+
+void Journal::rewrite(Seq after) {
+	try {
+		if (!fs::exists(m_file)) return;
+		fs::path tmp = m_file.string() + ".tmp";
+		std::FILE* out = std::fopen(tmp.string().c_str(), "wb");
+		if (!out) throw std::runtime_error("Cannot create " + tmp.string());
+		bool ok = true;
+		readRecords(m_file, [&](Seq seq, std::string const& line, Fields const&) {
+			if (seq > after) ok = ok && std::fwrite(line.data(), 1, line.size(), out) == line.size() && std::fputc('\n', out) != EOF;
+		});
+		sync(out);  // Before replacing the old file
+		if (std::fclose(out) != 0 || !ok) throw std::runtime_error("Cannot write " + tmp.string());
+		fs::rename(tmp, m_file);
+	} catch (std::exception& e) {
+		std::clog << "journal/error: Cannot compact " << m_file.string() << ": " << e.what() << std::endl;
+	}
+}
+
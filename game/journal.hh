@@ -0,0 +1,51 @@
+#pragma once
+
+#include "fs.hh"
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+* Append-only write-ahead log of text records, numbered by a sequence number that keeps increasing across runs.
+* A record is one line of tab separated fields. Records are written and fsynced by a background thread, so
+* appending never waits for the disk and records appended close together share one fsync. A record that was
+* only partially written (crash) is ignored when reading.
+**/
+class Journal {
+  public:
+	typedef std::uint64_t Seq;
+	typedef std::vector<std::string> Fields;
+	/// Read the records of file after seq (in order) and open it for appending after them
+	Journal(fs::path const& file, Seq after, std::function<void(Fields const&)> const& replay);
+	/// Write out everything appended
+	~Journal();
+	Journal(Journal const&) = delete;
+	Journal& operator=(Journal const&) = delete;
+	/// Queue a record for writing, returns its sequence number
+	Seq append(Fields const& fields);
+	/// Sequence number of the last record appended or replayed
+	Seq seq() const { std::lock_guard<std::mutex> l(m_mutex); return m_seq; }
+	/// Number of records in the file (the ones not yet dropped)
+	std::size_t size() const { std::lock_guard<std::mutex> l(m_mutex); return m_seq - m_drop; }
+	/// Drop records up to seq (once they are safely stored elsewhere)
+	void drop(Seq seq);
+  private:
+	void writer();
+	void rewrite(Seq after);  ///< Rewrite the file without records up to after (and without a partial record)
+	fs::path m_file;
+	std::FILE* m_fp = nullptr;
+	mutable std::mutex m_mutex;
+	std::condition_variable m_cond;  ///< Signalled when there is work for the writer
+	std::string m_pending;  ///< Appended records not yet written
+	Seq m_seq = 0;
+	Seq m_drop = 0;  ///< Records up to this should be removed from the file
+	Seq m_dropped = 0;  ///< Records up to this have been removed (written by the writer thread only)
+	bool m_quit = false;
+	std::thread m_thread;
+};
+
@@ -7,6 +7,7 @@
 #include "sample.hpp"
 #include <complex>
 #include <cstddef>
+#include <stdexcept>
 #include <vector>
 
 
@@ -70,6 +71,67 @@ namespace da {
 		return data;
 	}
 
+	/**
+	 * Real-input FFT of a size chosen at runtime, with all tables precomputed.
+	 * Computes the N-point FFT of real data as an N/2-point complex FFT and a split step,
+	 * writing the N/2 + 1 non-negative frequency bins to a caller-owned buffer. Does not
+	 * allocate after construction, but each plan has its own work buffer, so a plan may only
+	 * be used by one thread at a time.
+	 **/
+	class fft_plan {
+	  public:
+		typedef std::complex<float> complex_t;
+		/// Construct a plan for transforms of size 2^P
+		explicit fft_plan(unsigned P): m_n(std::size_t(1) << P), m_bitrev(m_n / 2), m_twiddle(m_n / 4), m_split(m_n / 2 + 1), m_work(m_n / 2) {
+			if (P < 2) throw std::logic_error("da::fft_plan: size must be at least 4");
+			std::size_t const M = m_n / 2;
+			for (std::size_t i = 0, j = 0; i < M; ++i) {
+				m_bitrev[i] = j;
+				std::size_t m = M / 2;
+				while (m >= 1 && m <= j) { j -= m; m >>= 1; }
+				j += m;
+			}
+			for (std::size_t k = 0; k < m_twiddle.size(); ++k) m_twiddle[k] = std::polar(1.0, -TAU * k / M);
+			for (std::size_t k = 0; k < m_split.size(); ++k) m_split[k] = std::polar(1.0, -TAU * k / m_n);
+		}
+		/// Transform size (number of input samples)
+		std::size_t size() const { return m_n; }
+		/// Number of output bins
+		std::size_t bins() const { return m_n / 2 + 1; }
+		/// Perform FFT on size() samples from in (multiplied by window), writing bins() values to out.
+		void operator()(float const* in, float const* window, complex_t* out) {
+			std::size_t const M = m_n / 2;
+			complex_t* z = m_work.data();
+			// Pack even samples to real part and odd samples to imaginary part, in bit-reversed order
+			for (std::size_t i = 0; i < M; ++i) z[m_bitrev[i]] = complex_t(in[2 * i] * window[2 * i], in[2 * i + 1] * window[2 * i + 1]);
+			// Iterative radix-2 complex FFT of size M
+			for (std::size_t len = 2; len <= M; len <<= 1) {
+				std::size_t const half = len / 2, step = M / len;
+				for (std::size_t i = 0; i < M; i += len) {
+					for (std::size_t j = 0; j < half; ++j) {
+						complex_t const temp = z[i + j + half] * m_twiddle[j * step];
+						z[i + j + half] = z[i + j] - temp;
+						z[i + j] += temp;
+					}
+				}
+			}
+			// Split into the spectrum of the real input
+			for (std::size_t k = 0; k <= M; ++k) {
+				complex_t const a = z[k == M ? 0 : k];
+				complex_t const b = std::conj(z[k == 0 ? 0 : M - k]);
+				complex_t const even = 0.5f * (a + b);
+				complex_t const odd = complex_t(0.0f, -0.5f) * (a - b);
+				out[k] = even + m_split[k] * odd;
+			}
+		}
+	  private:
+		std::size_t m_n;
+		std::vector<std::size_t> m_bitrev;  ///< Bit-reversal permutation for the complex FFT
+		std::vector<complex_t> m_twiddle;  ///< Twiddle factors for the complex FFT
+		std::vector<complex_t> m_split;  ///< Twiddle factors for the split step
+		std::vector<complex_t> m_work;
+	};
+
 	template<unsigned P, typename T> void ifft(std::complex<T>* data) {
 		constexpr std::size_t N = 1 << P;
 		for (std::size_t i = 0; i < N; ++i) data[i] = std::conj(data[i]);  // Invert phase so that we can use FFT to do IFFT
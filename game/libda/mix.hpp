@@ -0,0 +1,72 @@
+#pragma once
+
+/**
+ * @file mix.hpp Mixing kernels for blocks of samples.
+ *
+ * These are plain loops over contiguous arrays without data-dependent branches
+ * so that the compiler can vectorize them for the target instruction set.
+ */
+
+#include "sample.hpp"
+#include <cstddef>
+#include <cstdint>
+
+namespace da {
+
+	/// Convert s16 samples to sample_t, scale by gain and add to out.
+	static inline void accumulate_s16(sample_t* out, std::int16_t const* in, std::size_t n, sample_t gain) {
+		sample_t const scale = gain / max_s16;
+		for (std::size_t i = 0; i < n; ++i) out[i] += scale * in[i];
+	}
+
+	/// Scale samples by gain and add to out.
+	static inline void accumulate(sample_t* out, sample_t const* in, std::size_t n, sample_t gain) {
+		for (std::size_t i = 0; i < n; ++i) out[i] += gain * in[i];
+	}
+
+	/**
+	 * Add interleaved stereo frames to out, scaled by gain and a linear fade.
+	 * Before each frame level is incremented by rate; when it rises above 1 it is clamped and the fade
+	 * stops (rate set to 0). Mixing stops when level drops to zero or below. An infinite rate fades
+	 * instantly (fadeTime 0).
+	 * @return number of frames mixed (less than frames only if faded out completely)
+	 */
+	static inline std::size_t accumulate_fade_stereo(sample_t* out, sample_t const* in, std::size_t frames, sample_t gain, double& level, double& rate) {
+		if (frames == 0) return 0;
+		if (std::isnan(rate) || !(level + rate > 0.0)) { level += rate; return 0; }  // Faded out before the first frame
+		if (rate > 0.0 && (std::isinf(rate) || level + rate > 1.0)) { level = 1.0; rate = 0.0; }  // Fade-in completes at once
+		if (rate == 0.0) {
+			accumulate(out, in, 2 * frames, gain * level);
+			return frames;
+		}
+		// Number of frames before the fade reaches its end (level <= 0 or level > 1), at least one (checked above)
+		auto within = [&](std::size_t i) { double l = level + rate * i; return rate < 0.0 ? l > 0.0 : l <= 1.0; };
+		double limit = rate < 0.0 ? std::ceil(level / -rate) - 1.0 : std::floor((1.0 - level) / rate);
+		std::size_t n = limit < 1.0 ? 1 : limit < frames ? std::size_t(limit) : frames;
+		// Correct rounding errors of limit
+		while (n < frames && within(n + 1)) ++n;
+		while (n > 1 && !within(n)) --n;
+		for (std::size_t i = 0; i < n; ++i) {
+			sample_t g = gain * (level + rate * (i + 1));
+			out[2 * i] += g * in[2 * i];
+			out[2 * i + 1] += g * in[2 * i + 1];
+		}
+		if (n == frames) { level += rate * n; return frames; }
+		if (rate < 0.0) { level += rate * (n + 1); return n; }  // Faded out
+		// Fade-in completed, mix the rest at full level
+		level = 1.0;
+		rate = 0.0;
+		accumulate(out + 2 * n, in + 2 * n, 2 * (frames - n), gain);
+		return frames;
+	}
+
+	/// Replace both channels of interleaved stereo frames with their difference (removes center-panned audio).
+	static inline void suppress_center_stereo(sample_t* buf, std::size_t frames) {
+		for (std::size_t i = 0; i < frames; ++i) {
+			sample_t diff = buf[2 * i] - buf[2 * i + 1];
+			buf[2 * i] = diff;
+			buf[2 * i + 1] = diff;
+		}
+	}
+
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <cmath>
+#include <iterator>
 
 /**
  * @file sample.hpp Sample format definition and format conversions.
@@ -6,6 +6,7 @@
 namespace xmlpp {
 	class Node;
 	class Element;
+	class Document;
 	typedef std::vector<Node*> NodeSet;
 }
 
@@ -0,0 +1,143 @@
+#pragma once
+
+#include "fs.hh"
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/**
+* Loading of files on a pool of worker threads, most important first, with the results applied by one thread
+* (e.g. uploaded to OpenGL) within a budget per call. Jobs are identified by the address of their target, so
+* that a new job for a target replaces the previous one, and cancelled jobs are dropped however far they got.
+**/
+template <typename Result> class LoadQueue {
+  public:
+	typedef std::function<void (Result& result, fs::path const& name)> LoadFunc;
+	typedef std::function<void (Result& result)> ApplyFunc;
+	/// Start threads workers that call load (concurrently)
+	LoadQueue(LoadFunc load, unsigned threads): m_load(load) {
+		for (unsigned i = 0; i < threads; ++i) m_threads.emplace_back(&LoadQueue::run, this);
+	}
+	~LoadQueue() {
+		{
+			std::lock_guard<std::mutex> l(m_mutex);
+			m_quit = true;
+		}
+		m_condition.notify_all();
+		for (auto& t: m_threads) t.join();
+	}
+	/// Add a new job for target t, replacing its previous job if any
+	void push(void const* t, fs::path const& name, ApplyFunc const& apply) {
+		std::lock_guard<std::mutex> l(m_mutex);
+		remove_internal(t);
+		Job& job = m_jobs[t];
+		job.name = name;
+		job.apply = apply;
+		job.seq = ++m_seq;
+		m_queue.emplace(key(job), t);
+		m_condition.notify_one();
+	}
+	/// Change the priority of a job, higher first (no effect once loading has started)
+	void prioritize(void const* t, int priority) {
+		std::lock_guard<std::mutex> l(m_mutex);
+		auto it = m_jobs.find(t);
+		if (it == m_jobs.end() || it->second.priority == priority) return;
+		Job& job = it->second;
+		if (job.state == Job::QUEUED) m_queue.erase(key(job));
+		job.priority = priority;
+		if (job.state == Job::QUEUED) m_queue.emplace(key(job), t);
+	}
+	/// Test if a job is still waiting to be loaded or applied
+	bool pending(void const* t) {
+		std::lock_guard<std::mutex> l(m_mutex);
+		return m_jobs.find(t) != m_jobs.end();
+	}
+	/// Cancel a job (no effect if the job has already been applied)
+	void remove(void const* t) {
+		std::lock_guard<std::mutex> l(m_mutex);
+		remove_internal(t);
+	}
+	/**
+	* Apply completed jobs, oldest first, until their total size(result) reaches budget, which the last one may
+	* exceed (so that results larger than the budget get through). Returns the size applied.
+	**/
+	template <typename Size> std::size_t apply(std::size_t budget, Size size) {
+		std::size_t used = 0;
+		while (used < budget) {
+			Job job;
+			{
+				std::lock_guard<std::mutex> l(m_mutex);
+				while (!m_done.empty()) {
+					auto done = m_done.front();
+					m_done.pop_front();
+					auto it = m_jobs.find(done.first);
+					if (it == m_jobs.end() || it->second.seq != done.second) continue;  // Cancelled
+					job = std::move(it->second);
+					m_jobs.erase(it);
+					break;
+				}
+			}
+			if (!job.apply) break;  // Nothing more to apply
+			used += size(job.result);
+			job.apply(job.result);  // Without locking, so that the workers can proceed
+		}
+		return used;
+	}
+  private:
+	struct Job {
+		fs::path name;
+		ApplyFunc apply;
+		Result result;
+		int priority = 0;
+		std::uint64_t seq = 0;  ///< Submission order, also tells apart jobs of different targets at the same address
+		enum State { QUEUED, LOADING, DONE } state = QUEUED;
+	};
+	/// Key of a queued job, ordered so that the highest priority (and then the oldest) job comes first
+	static std::pair<int, std::uint64_t> key(Job const& job) { return { -job.priority, job.seq }; }
+	/// Cancel the job of t, if any (called with m_mutex locked)
+	void remove_internal(void const* t) {
+		auto it = m_jobs.find(t);
+		if (it == m_jobs.end()) return;
+		if (it->second.state == Job::QUEUED) m_queue.erase(key(it->second));
+		m_jobs.erase(it);  // A worker loading it notices and discards the result
+	}
+	/// The worker main loop: take the most important job from the queue and load it
+	void run() {
+		std::unique_lock<std::mutex> l(m_mutex);
+		while (true) {
+			m_condition.wait(l, [this]{ return m_quit || !m_queue.empty(); });
+			if (m_quit) return;
+			void const* target = m_queue.begin()->second;
+			m_queue.erase(m_queue.begin());
+			Job& job = m_jobs.at(target);
+			job.state = Job::LOADING;
+			fs::path name = job.name;
+			std::uint64_t seq = job.seq;
+			l.unlock();
+			Result result;
+			m_load(result, name);
+			l.lock();
+			auto it = m_jobs.find(target);
+			if (it == m_jobs.end() || it->second.seq != seq) continue;  // The job has been cancelled meanwhile
+			it->second.state = Job::DONE;
+			it->second.result = std::move(result);
+			m_done.emplace_back(target, seq);
+		}
+	}
+	LoadFunc m_load;
+	bool m_quit = false;
+	std::mutex m_mutex;
+	std::condition_variable m_condition;
+	std::unordered_map<void const*, Job> m_jobs;
+	std::map<std::pair<int, std::uint64_t>, void const*> m_queue;  ///< Jobs waiting for a worker
+	std::deque<std::pair<void const*, std::uint64_t>> m_done;  ///< Loaded jobs waiting to be applied (may include cancelled ones)
+	std::uint64_t m_seq = 0;
+	std::vector<std::thread> m_threads;  ///< Last, so that the workers start after everything else is initialized
+};
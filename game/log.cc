@@ -1,13 +1,19 @@
 #include "log.hh"
 
 #include "fs.hh"
+#include "logqueue.hh"
 #include <boost/filesystem.hpp>
 #include <boost/iostreams/device/file_descriptor.hpp>
 #include <boost/iostreams/stream.hpp>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
 #include <iostream>
 #include <memory>
 #include <mutex>
 #include <stdexcept>
+#include <thread>
 
 /** \file
  * \brief The std::clog logger.
@@ -35,6 +41,14 @@
  * substring search) to be monitored all the way down to debug level, in which case only errors from any other
  * subsystems will be printed.
  *
+ * Messages that are frequent or expensive to format should use the LOG macro of log.hh instead, which checks
+ * Logger::enabled before formatting anything.
+ *
+ * Accepted messages are queued and written by a background thread in batches, so callers do not wait for I/O
+ * (only for the writer to make room if the queue is flooded). Threads marked by Logger::realtimeThread never
+ * wait: their messages are dropped and counted if they cannot be queued. Real-time code should still avoid
+ * logging, as formatting a message allocates.
+ *
  **/
 
 /** \internal
@@ -107,6 +121,62 @@ void writeLog(std::string const& msg) {
 	file << msg << std::flush;
 }
 
+namespace {
+	LogQueue<4096> queue;
+	std::thread writer;
+	std::atomic<bool> writerRunning{ false };
+	std::atomic<bool> writerQuit{ false };  ///< Set by teardown, after which messages are written directly
+	std::atomic<unsigned> producers{ 0 };  ///< Threads in enqueue (teardown waits for them before the final drain)
+	thread_local bool realtime = false;  ///< Set by Logger::realtimeThread
+	std::atomic<unsigned> realtimeDropped{ 0 };  ///< Messages of real-time threads that could not be queued
+	std::mutex writerMutex;  ///< Only for sleeping on writerCond
+	std::condition_variable writerCond;
+	std::atomic<unsigned> fullWaits{ 0 };  ///< Times that a caller had to wait for a full queue
+	std::atomic<long long> fullWaitMax{ 0 };  ///< Longest such wait in microseconds
+
+	/// Write out everything queued as one batch, returns false if there was nothing
+	bool writeQueued() {
+		std::string batch;
+		while (queue.pop(batch) && batch.size() < 1 << 16) {}
+		if (batch.empty()) return false;
+		writeLog(batch);
+		return true;
+	}
+
+	void writerLoop() {
+		while (!writerQuit) {
+			if (writeQueued()) continue;
+			std::unique_lock<std::mutex> l(writerMutex);
+			// Producers notify without locking, so a wakeup may be missed; the timeout bounds the delay
+			writerCond.wait_for(l, std::chrono::milliseconds(20));
+		}
+		while (writeQueued()) {}
+	}
+
+	/// Hand a complete message to the writer (or write it directly when there is no writer)
+	void enqueue(std::string& msg) {
+		++producers;  // Sequentially consistent with the check of writerQuit, so that teardown cannot miss this message
+		bool running = writerRunning && !writerQuit;
+		bool queued = running && queue.push(msg);
+		if (!queued && running && !realtime) {
+			// Flooded: wait for the writer rather than lose messages
+			auto begin = std::chrono::steady_clock::now();
+			do {
+				writerCond.notify_one();
+				std::this_thread::yield();
+			} while (!writerQuit && !(queued = queue.push(msg)));
+			long long us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - begin).count();
+			++fullWaits;
+			long long prev = fullWaitMax.load();
+			while (us > prev && !fullWaitMax.compare_exchange_weak(prev, us)) {}
+		}
+		--producers;
+		if (queued) writerCond.notify_one();
+		else if (realtime) ++realtimeDropped;  // Neither wait for the writer nor lock for writing
+		else writeLog(msg);  // No writer, or it is finishing
+	}
+}
+
 int numeric(std::string const& level) {
 	if (level == "debug") return 0;
 	if (level == "info") return 1;
@@ -135,11 +205,17 @@ std::streamsize VerboseMessageSink::write(const char* s, std::streamsize n) {
 		return n;
 	}
 	if (lev >= minLevel || (!target.empty() && subsystem.find(target) != std::string::npos)) {
-		writeLog(line);
+		enqueue(line);
 	}
 	return n;
 }
 
+void Logger::realtimeThread() { realtime = true; }
+
+bool Logger::enabled(char const* subsystem, Level level) {
+	return level >= minLevel || (!target.empty() && std::strstr(subsystem, target.c_str()));
+}
+
 Logger::Logger(std::string const& level) {
 	if (default_ClogBuf) throw std::logic_error("Multiple loggers constructed. There can only be one.");
 	if (level.find_first_of(":/_* ") != std::string::npos) throw std::runtime_error("Invalid logging level specified. Specify either a subsystem name (e.g. logger) or a level (debug, info, notice, warning, error).");
@@ -169,6 +245,8 @@ Logger::Logger(std::string const& level) {
 			file.open(name);
 			msg += " Log file: " + name.string();
 		}
+		writer = std::thread(writerLoop);
+		writerRunning = true;
 		sb.open(vsm);
 		default_ClogBuf = std::clog.rdbuf();
 		std::clog.rdbuf(&sb);
@@ -183,6 +261,20 @@ Logger::~Logger() { teardown(); }
 void Logger::teardown() {
 	grabber.reset();
 	if (default_ClogBuf) std::clog << "logger/info: Exiting normally." << std::endl;
+	if (writer.joinable()) {
+		writerQuit = true;  // From now on enqueue writes directly
+		writerCond.notify_one();
+		writer.join();
+		while (producers) std::this_thread::yield();  // Callers that saw the writer running may still be queuing
+		while (writeQueued()) {}  // Anything that slipped in while the writer was finishing
+		writerRunning = false;
+		if (fullWaits) {
+			std::clog << "logger/warning: Callers waited " << fullWaits << " times for a full log queue, at most " << fullWaitMax << " us" << std::endl;
+		}
+		if (realtimeDropped) {
+			std::clog << "logger/warning: " << realtimeDropped << " messages from real-time threads dropped (log queue full)" << std::endl;
+		}
+	}
 	std::lock_guard<std::mutex> l(log_lock);
 	if (!default_ClogBuf) return;
 	std::clog.rdbuf(default_ClogBuf);
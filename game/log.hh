@@ -1,11 +1,26 @@
 #pragma once
 
+#include <iostream>
 #include <string>
 
 class Logger {
 public:
+	/// Message levels, in ascending order of priority (see log.cc)
+	enum Level { debug, info, notice, warning, error };
 	Logger(std::string const& level);
 	~Logger();
 	static void teardown();
+	/// Mark the calling thread as real-time: its messages are dropped rather than waited for if the queue is full
+	static void realtimeThread();
+	/// Test if messages of subsystem at level would be logged (cheap, no formatting needed)
+	static bool enabled(char const* subsystem, Level level);
 };
 
+/**
+* Log a message only if its subsystem and level are enabled, so that filtered messages are never formatted.
+* Subsystem must be a string literal and level a Logger::Level name, e.g.
+* LOG("controllers", debug, "processing " << ev);
+**/
+#define LOG(subsystem, level, message) \
+	do { if (Logger::enabled(subsystem, Logger::level)) std::clog << subsystem "/" #level ": " << message << std::endl; } while (false)
+
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <string>
+
+/**
+* Bounded ring of log messages from any number of threads to one writer thread. Producers claim a slot with
+* a CAS on the write position and publish it through the slot's sequence number, so no locks are taken.
+**/
+template <std::size_t SIZE> class LogQueue {
+	static_assert(SIZE >= 2 && (SIZE & (SIZE - 1)) == 0, "LogQueue SIZE must be a power of two");
+  public:
+	LogQueue() { for (std::size_t i = 0; i < SIZE; ++i) m_slots[i].seq.store(i, std::memory_order_relaxed); }
+	/// Any thread: add a message, returns false (leaving msg untouched) if the queue is full
+	bool push(std::string& msg) {
+		std::size_t pos = m_write.load(std::memory_order_relaxed);
+		while (true) {
+			Slot& slot = m_slots[pos % SIZE];
+			std::size_t seq = slot.seq.load(std::memory_order_acquire);
+			if (seq == pos) {
+				if (!m_write.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) continue;
+				slot.msg.swap(msg);
+				slot.seq.store(pos + 1, std::memory_order_release);
+				return true;
+			}
+			if (seq < pos) return false;  // Not yet consumed (full)
+			pos = m_write.load(std::memory_order_relaxed);  // Another producer claimed it
+		}
+	}
+	/// Writer thread only: append the oldest message to out, returns false if empty
+	bool pop(std::string& out) {
+		Slot& slot = m_slots[m_read % SIZE];
+		if (slot.seq.load(std::memory_order_acquire) != m_read + 1) return false;
+		out += slot.msg;
+		slot.msg.clear();
+		slot.seq.store(m_read + SIZE, std::memory_order_release);
+		++m_read;
+		return true;
+	}
+  private:
+	struct Slot {
+		std::atomic<std::size_t> seq;
+		std::string msg;
+	};
+	std::array<Slot, SIZE> m_slots;
+	std::atomic<std::size_t> m_write{ 0 };
+	std::size_t m_read = 0;
+};
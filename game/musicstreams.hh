@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <utility>
+#include <vector>
+
+/**
+* The music streams of the audio callback: the one being preloaded and those playing, the current one first
+* and earlier ones fading out. Stream is Music (or a stand-in in tests), providing prepare() and fadeRate.
+* Room for the playing streams is reserved up front, so nothing here allocates or locks and all of it may run
+* in the callback. Streams replaced are returned to the caller, to be disposed of by another thread.
+**/
+template <typename Stream> struct MusicStreams {
+	std::unique_ptr<Stream> preloading;
+	std::vector<std::unique_ptr<Stream>> playing;
+
+	explicit MusicStreams(std::size_t maxPlaying) { playing.reserve(maxPlaying); }
+	/// Start preloading stream, returns the earlier one if it was still preloading
+	std::unique_ptr<Stream> preload(std::unique_ptr<Stream> stream) {
+		preloading.swap(stream);
+		return stream;
+	}
+	/// Start playing the preloaded stream if it is ready and there is room, fading out the current one.
+	/// Returns the stream started, or nullptr if none.
+	Stream* promote() {
+		if (!preloading || playing.size() == playing.capacity() || !preloading->prepare()) return nullptr;
+		if (!playing.empty()) playing[0]->fadeRate = -preloading->fadeRate;  // Fade out the old music
+		playing.insert(playing.begin(), std::move(preloading));
+		return playing[0].get();
+	}
+	/// Is music playing (rather than nothing or only preloading)
+	bool current() const { return !preloading && !playing.empty(); }
+	/// Preloading or playing something
+	bool active() const { return preloading || !playing.empty(); }
+};
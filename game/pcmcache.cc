@@ -0,0 +1,206 @@
+#include "pcmcache.hh"
+
+#include "configuration.hh"
+#include "util.hh"
+#include <boost/filesystem.hpp>
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <tuple>
+#include <vector>
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#endif
+
+namespace cache {
+	namespace {
+		const char MAGIC[8] = { 'P', 'E', 'R', 'F', 'P', 'C', 'M', '\0' };
+		const std::uint32_t VERSION = 1;
+		const std::uint32_t CHANNELS = 2;
+
+		/// Entry file header, followed by the samples (native byte order, the cache is not portable)
+		struct Header {
+			char magic[8];
+			std::uint32_t version;
+			std::uint32_t channels;
+			std::uint32_t rate;
+			std::uint32_t reserved;
+			std::int64_t mtime;
+			std::uint64_t fileSize;
+			std::uint64_t samples;
+			char padding[16];
+		};
+		static_assert(sizeof(Header) == 64, "PCM cache header must be 64 bytes");
+
+		/// Identifies the decode of a specific version of a file
+		struct Key {
+			fs::path source;
+			std::int64_t mtime;
+			std::uint64_t fileSize;
+			unsigned rate;
+			Key(fs::path const& file, unsigned rate): source(fs::absolute(file)), mtime(fs::last_write_time(file)), fileSize(fs::file_size(file)), rate(rate) {}
+			/// Entry filename, stable across runs (64-bit FNV-1a of path and rate). Changed files reuse the same entry.
+			fs::path filename() const {
+				std::ostringstream oss;
+				oss << source.string() << '\0' << rate;
+				std::ostringstream name;
+				name << std::hex << std::setw(16) << std::setfill('0') << fnv1a64(oss.str()) << ".pcm";
+				return name.str();
+			}
+			bool matches(Header const& h) const {
+				return std::memcmp(h.magic, MAGIC, sizeof(MAGIC)) == 0 && h.version == VERSION && h.channels == CHANNELS
+				  && h.rate == rate && h.mtime == mtime && h.fileSize == fileSize;
+			}
+		};
+
+		fs::path cacheDir() { return getCacheDir() / "pcm"; }
+		bool enabled() { return config["audio/pcm_cache"].i() > 0; }
+	}
+
+	std::unique_ptr<PCMFile> PCMFile::open(fs::path const& file, unsigned rate) {
+		if (!rate || !enabled()) return nullptr;
+		try {
+			Key key(file, rate);
+			fs::path entry = cacheDir() / key.filename();
+			if (!fs::is_regular_file(entry) || fs::file_size(entry) < sizeof(Header)) return nullptr;
+			std::unique_ptr<PCMFile> pcm(new PCMFile());
+			pcm->m_map.open(entry.string());
+			Header h;
+			std::memcpy(&h, pcm->m_map.data(), sizeof(h));
+			if (!key.matches(h)) return nullptr;  // Outdated, will be replaced when decoded again
+			if (pcm->m_map.size() != sizeof(Header) + h.samples * sizeof(std::int16_t)) return nullptr;  // Truncated
+			pcm->m_data = reinterpret_cast<std::int16_t const*>(pcm->m_map.data() + sizeof(Header));
+			pcm->m_size = h.samples;
+			fs::last_write_time(entry, std::time(nullptr));  // Mark as recently used
+			std::clog << "audio/debug: Using cached PCM for " << file.filename().string() << std::endl;
+			return pcm;
+		} catch (std::exception& e) {
+			std::clog << "audio/warning: PCM cache of " << file << " not usable: " << e.what() << std::endl;
+		}
+		return nullptr;
+	}
+
+	void PCMFile::prefetch(std::size_t begin, std::size_t end) const {
+		std::size_t const PAGE = 4096;  // Touching more often than once per page is harmless
+		end = std::min(end, m_size);
+		if (begin >= end) return;
+		char const* first = reinterpret_cast<char const*>(m_data + begin);
+		char const* last = reinterpret_cast<char const*>(m_data + end);
+#if defined(__unix__) || defined(__APPLE__)
+		// Let the kernel read ahead the whole range at once (madvise needs a page-aligned start)
+		char const* aligned = first - reinterpret_cast<std::uintptr_t>(first) % PAGE;
+		madvise(const_cast<char*>(aligned), last - aligned, MADV_WILLNEED);
+#endif
+		// Fault each page in
+		volatile char sink = 0;
+		for (char const* p = first; p < last; p += PAGE) sink = sink + *p;
+		sink = sink + last[-1];
+	}
+
+	std::unique_ptr<PCMWriter> PCMWriter::create(fs::path const& file, unsigned rate) {
+		if (!rate || !enabled()) return nullptr;
+		try {
+			Key key(file, rate);
+			std::unique_ptr<PCMWriter> w(new PCMWriter());
+			fs::create_directories(cacheDir());
+			w->m_target = cacheDir() / key.filename();
+			w->m_tmp = cacheDir() / fs::unique_path(key.filename().stem().string() + "-%%%%%%%%.tmp");
+			w->m_mtime = key.mtime;
+			w->m_fileSize = key.fileSize;
+			w->m_rate = rate;
+			w->m_file.open(w->m_tmp.string(), std::ios::binary | std::ios::trunc);
+			if (!w->m_file) throw std::runtime_error("Cannot create " + w->m_tmp.string());
+			w->restart();
+			return w;
+		} catch (std::exception& e) {
+			std::clog << "audio/warning: Cannot cache PCM of " << file << ": " << e.what() << std::endl;
+		}
+		return nullptr;
+	}
+
+	PCMWriter::~PCMWriter() {
+		if (m_tmp.empty()) return;  // Committed
+		m_file.close();
+		boost::system::error_code ec;
+		fs::remove(m_tmp, ec);
+	}
+
+	void PCMWriter::restart() {
+		Header h = {};  // Placeholder until commit
+		m_file.seekp(0);
+		m_file.write(reinterpret_cast<char const*>(&h), sizeof(h));
+		m_samples = 0;
+	}
+
+	void PCMWriter::silence(std::size_t samples) {
+		static const std::int16_t zeros[4096] = {};
+		while (samples > 0) {
+			std::size_t n = std::min(samples, sizeof(zeros) / sizeof(*zeros));
+			write(zeros, n);
+			samples -= n;
+		}
+	}
+
+	void PCMWriter::write(std::int16_t const* data, std::size_t samples) {
+		m_file.write(reinterpret_cast<char const*>(data), samples * sizeof(std::int16_t));
+		m_samples += samples;
+	}
+
+	void PCMWriter::commit() {
+		Header h = {};
+		std::memcpy(h.magic, MAGIC, sizeof(MAGIC));
+		h.version = VERSION;
+		h.channels = CHANNELS;
+		h.rate = m_rate;
+		h.mtime = m_mtime;
+		h.fileSize = m_fileSize;
+		h.samples = m_samples;
+		m_file.seekp(0);
+		m_file.write(reinterpret_cast<char const*>(&h), sizeof(h));
+		m_file.close();
+		try {
+			if (m_file.fail()) throw std::runtime_error("Write failed");
+			// Discard data from before a restart
+			fs::resize_file(m_tmp, sizeof(Header) + m_samples * sizeof(std::int16_t));
+			fs::rename(m_tmp, m_target);
+		} catch (std::exception& e) {
+			std::clog << "audio/warning: Cannot store PCM cache entry " << m_target << ": " << e.what() << std::endl;
+			return;  // The destructor removes the temporary file
+		}
+		m_tmp.clear();
+		std::clog << "audio/debug: Cached " << (m_samples * sizeof(std::int16_t) >> 10) << " kB of PCM in " << m_target.filename().string() << std::endl;
+		evictPCM();
+	}
+
+	void evictPCM() {
+		std::uintmax_t limit = std::uintmax_t(std::max(0, config["audio/pcm_cache"].i())) << 20;
+		std::time_t now = std::time(nullptr);
+		std::vector<std::tuple<std::time_t, std::uintmax_t, fs::path>> entries;
+		std::uintmax_t total = 0;
+		boost::system::error_code ec;
+		for (fs::directory_iterator it(cacheDir(), ec), end; !ec && it != end; it.increment(ec)) {
+			fs::path p = it->path();
+			std::time_t mtime = fs::last_write_time(p, ec);
+			std::uintmax_t size = fs::file_size(p, ec);
+			if (ec) { ec.clear(); continue; }
+			// Leftovers from interrupted decodes (files still being written are recent)
+			if (p.extension() == ".tmp" && now - mtime > 3600) { fs::remove(p, ec); ec.clear(); continue; }
+			if (p.extension() != ".pcm") continue;
+			entries.emplace_back(mtime, size, p);
+			total += size;
+		}
+		if (total <= limit) return;
+		std::sort(entries.begin(), entries.end());  // Least recently used first
+		for (auto const& e: entries) {
+			if (total <= limit) break;
+			// Fails on systems that cannot remove files in use (mapped), those are left for later
+			if (!fs::remove(std::get<2>(e), ec) || ec) { ec.clear(); continue; }
+			std::clog << "audio/debug: Evicted PCM cache entry " << std::get<2>(e).filename().string() << std::endl;
+			total -= std::get<1>(e);
+		}
+	}
+}
+
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "fs.hh"
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+
+namespace cache {
+
+	/**
+	* Fully decoded audio of a song file (interleaved stereo, 16 bit) from the on-disk PCM cache.
+	* The file is memory-mapped, so replaying and seeking need no decoding and the OS pages the data.
+	**/
+	class PCMFile {
+	  public:
+		/// Map the cached decode of file at given sample rate, returns nullptr if not cached (or the cache is disabled).
+		static std::unique_ptr<PCMFile> open(fs::path const& file, unsigned rate);
+		std::int16_t const* data() const { return m_data; }
+		/// Number of samples (not frames)
+		std::size_t size() const { return m_size; }
+		/// Page in samples [begin, end) (blocks on disk I/O), so that reading them later does not fault
+		void prefetch(std::size_t begin, std::size_t end) const;
+	  private:
+		PCMFile() = default;
+		boost::iostreams::mapped_file_source m_map;
+		std::int16_t const* m_data = nullptr;
+		std::size_t m_size = 0;
+	};
+
+	/**
+	* Collects decoded audio of a file into the PCM cache. Data must be written contiguously from the
+	* beginning of the song; the cache entry is only created by commit(), i.e. if the file was decoded to the end.
+	**/
+	class PCMWriter {
+	  public:
+		/// Start caching the decode of file at given sample rate, returns nullptr if the cache is disabled or unusable.
+		static std::unique_ptr<PCMWriter> create(fs::path const& file, unsigned rate);
+		~PCMWriter();
+		/// Start over from the beginning of the song (after seeking back)
+		void restart();
+		/// Append silence (number of samples)
+		void silence(std::size_t samples);
+		/// Append samples
+		void write(std::int16_t const* data, std::size_t samples);
+		/// Finish the entry and make it available, evicting older entries if the cache grows too large
+		void commit();
+	  private:
+		PCMWriter() = default;
+		fs::path m_target;
+		fs::path m_tmp;  ///< The entry is written here and renamed to m_target on commit
+		std::ofstream m_file;
+		std::int64_t m_mtime = 0;  ///< Of the source file
+		std::uint64_t m_fileSize = 0;  ///< Of the source file
+		unsigned m_rate = 0;
+		std::uint64_t m_samples = 0;
+	};
+
+	/// Remove least recently used PCM cache entries until the cache fits in the configured size
+	void evictPCM();
+}
+
@@ -1,7 +1,6 @@
 #include "pitch.hh"
 
 #include "util.hh"
-#include "libda/fft.hpp"
 #include <cmath>
 #include <iostream>
 #include <iomanip>
@@ -31,26 +30,46 @@ bool Tone::operator==(double f) const {
 	return std::abs(freq / f - 1.0) < 0.05;
 }
 
-Analyzer::Analyzer(double rate, std::string id, std::size_t step):
+namespace {
+	unsigned fftPower(std::size_t fftSize) {
+		if (!Analyzer::isValidFFTSize(fftSize)) throw std::logic_error("Invalid Analyzer FFT size " + std::to_string(fftSize));
+		unsigned p = 0;
+		while ((std::size_t(1) << p) < fftSize) ++p;
+		return p;
+	}
+}
+
+Analyzer::Analyzer(double rate, std::string id, std::size_t fftSize, std::size_t step):
   m_step(step),
   m_resampleFactor(1.0),
   m_resamplePos(),
   m_rate(rate),
   m_id(id),
-  m_window(FFT_N),
-  m_fftLastPhase(FFT_N / 2),
+  m_fftN(fftSize),
+  m_fftPlan(fftPower(fftSize)),
+  m_window(m_fftN),
+  m_fft(m_fftPlan.bins()),
+  m_pcm(m_fftN),
+  m_fftLastPhase(m_fftN / 2 + 1),
   m_peak(0.0),
-  m_oldfreq(0.0)
+  m_oldfreq(0.0),
+  m_binMagnitude(m_fftN / 2 + 1),
+  m_binPhase(m_fftN / 2 + 1),
+  m_peaks(m_fftN / 2 + 2)
 {
-	if (m_step > FFT_N) throw std::logic_error("Analyzer step is larger that FFT_N (ideally it should be less than a fourth of FFT_N).");
+	if (m_step > m_fftN) throw std::logic_error("Analyzer step is larger that FFT size (ideally it should be less than a fourth of FFT size).");
 	// Hamming window
-	for (size_t i=0; i < FFT_N; i++) {
-		m_window[i] = 0.53836 - 0.46164 * std::cos(TAU * i / (FFT_N - 1));
+	for (size_t i=0; i < m_fftN; i++) {
+		m_window[i] = 0.53836 - 0.46164 * std::cos(TAU * i / (m_fftN - 1));
 	}
+	m_tones.reserve(MAXTONES);
+	m_newTones.reserve(MAXTONES);
+	m_mergedTones.reserve(MAXTONES);
 }
 
 void Analyzer::output(float* begin, float* end, double rate) {
 	constexpr unsigned a = 2;
+	if (m_passthrough.resync()) m_resampleFactor = 1.0;  // Skip stale audio left from when nobody listened
 	const unsigned size = m_passthrough.size();
 	const unsigned out = (end - begin) / 2 /* stereo */;
 	if (out == 0) return;
@@ -81,71 +100,96 @@ void Analyzer::output(float* begin, float* end, double rate) {
 }
 
 
+/// A spectral peak candidate, one per FFT bin
+struct Analyzer::Peak {
+	double freq;
+	double db;
+	Peak(double _freq = 0.0, double _db = -getInf()): freq(_freq), db(_db) {}
+	void clear() {
+		freq = 0.0;
+		db = -getInf();
+	}
+};
+
+Analyzer::~Analyzer() = default;
+
+/// Find the strongest of the peaks at and next to pos
+Analyzer::Peak& Analyzer::match(std::size_t pos) {
+	std::size_t best = pos;
+	if (m_peaks[pos - 1].db > m_peaks[best].db) best = pos - 1;
+	if (m_peaks[pos + 1].db > m_peaks[best].db) best = pos + 1;
+	return m_peaks[best];
+}
+
 namespace {
-	struct Peak {
-		double freq;
-		double db;
-		bool harm[Tone::MAXHARM];
-		Peak(double _freq = 0.0, double _db = -getInf()):
-		  freq(_freq), db(_db)
-		{
-			for (auto& h: harm) h = false;
+	/// Append a tone; if the (preallocated) capacity is already used, the weakest tone is removed to make room
+	/// (the order of the others is kept) or, if t is the weakest, t is dropped.
+	inline void addTone(Analyzer::tones_t& tones, Tone const& t) {
+		if (tones.size() >= Analyzer::MAXTONES) {
+			auto weakest = std::min_element(tones.begin(), tones.end(), Tone::dbCompare);
+			if (weakest->db >= t.db) return;
+			tones.erase(weakest);
 		}
-		void clear() {
-			freq = 0.0;
-			db = -getInf();
-		}
-	};
-
-	Peak& match(std::vector<Peak>& peaks, std::size_t pos) {
-		std::size_t best = pos;
-		if (peaks[pos - 1].db > peaks[best].db) best = pos - 1;
-		if (peaks[pos + 1].db > peaks[best].db) best = pos + 1;
-		return peaks[best];
+		tones.push_back(t);
 	}
+
+	/// Map phase into +/- pi interval. Same as std::remainder(phase, TAU) but without the libm call, so that loops using it can be vectorized.
+	inline double wrapPhase(double phase) { return phase - TAU * std::nearbyint(phase / TAU); }
 }
 
 bool Analyzer::calcFFT() {
-	float pcm[FFT_N];
-	// Read FFT_N samples, move forward by m_step samples
-	if (!m_buf.read(pcm, pcm + FFT_N)) return false;
+	float* pcm = m_pcm.data();
+	// Read FFT size samples, move forward by m_step samples
+	if (!m_buf.read(pcm, pcm + m_fftN)) return false;
 	m_buf.pop(m_step);
 	// Peak level calculation of the most recent m_step samples (the rest is overlap)
-	for (float const* ptr = pcm + FFT_N - m_step; ptr != pcm + FFT_N; ++ptr) {
+	for (float const* ptr = pcm + m_fftN - m_step; ptr != pcm + m_fftN; ++ptr) {
 		float s = *ptr;
 		float p = s * s;
 		if (p > m_peak) m_peak = p; else m_peak *= 0.999;
 	}
 	// Calculate FFT
-	m_fft = da::fft<FFT_P>(pcm, m_window);
+	m_fftPlan(pcm, m_window.data(), m_fft.data());
 	return true;
 }
 
-void Analyzer::calcTones() {
+void Analyzer::calcPeaks(std::size_t kMax) {
 	// Precalculated constants
-	const double freqPerBin = m_rate / FFT_N;
-	const double phaseStep = TAU * m_step / FFT_N;
-	const double normCoeff = 1.0 / FFT_N;
-	const double minMagnitude = pow(10, -100.0 / 20.0) / normCoeff; // -100 dB
-	// Limit frequency range of processing
-	const size_t kMin = std::max(size_t(1), size_t(FFT_MINFREQ / freqPerBin));
-	const size_t kMax = std::min(FFT_N / 2, size_t(FFT_MAXFREQ / freqPerBin));
-	std::vector<Peak> peaks(kMax + 1); // One extra to simplify loops
-	for (size_t k = 1; k <= kMax; ++k) {
-		double magnitude = std::abs(m_fft[k]);
-		double phase = std::arg(m_fft[k]);
-		// process phase difference
-		double delta = phase - m_fftLastPhase[k];
-		m_fftLastPhase[k] = phase;
-		delta -= k * phaseStep;  // subtract expected phase difference
-		delta = std::remainder(delta, TAU);  // map delta phase into +/- pi interval
-		delta /= phaseStep;  // calculate diff from bin center frequency
+	const double freqPerBin = m_rate / m_fftN;
+	const double phaseStep = TAU * m_step / m_fftN;
+	const double normCoeff = 1.0 / m_fftN;
+	const float minMagnitude = pow(10, -100.0 / 20.0) / normCoeff; // -100 dB
+	std::complex<float> const* fft = m_fft.data();
+	float* magnitude = m_binMagnitude.data();
+	float* phase = m_binPhase.data();
+	float* lastPhase = m_fftLastPhase.data();
+	// Magnitude and phase of each bin (plain arithmetic over flat arrays, the compiler vectorizes the magnitude part)
+	for (std::size_t k = 1; k <= kMax; ++k) {
+		float re = fft[k].real(), im = fft[k].imag();
+		magnitude[k] = std::sqrt(re * re + im * im);
+	}
+	for (std::size_t k = 1; k <= kMax; ++k) phase[k] = std::atan2(fft[k].imag(), fft[k].real());
+	for (std::size_t k = 0; k <= kMax; ++k) m_peaks[k].clear();
+	// Phase vocoder: true frequency from phase difference to the previous hop; level only computed for bins above the threshold
+	for (std::size_t k = 1; k <= kMax; ++k) {
+		double delta = phase[k] - lastPhase[k];
+		lastPhase[k] = phase[k];
+		delta = wrapPhase(delta - k * phaseStep) / phaseStep;  // diff from bin center frequency
 		double freq = (k + delta) * freqPerBin;  // calculate the true frequency
-		if (freq > 1.0 && magnitude > minMagnitude) {
-			peaks[k].freq = freq;
-			peaks[k].db = 20.0 * log10(normCoeff * magnitude);
+		if (freq > 1.0 && magnitude[k] > minMagnitude) {
+			m_peaks[k].freq = freq;
+			m_peaks[k].db = 20.0 * log10(normCoeff * magnitude[k]);
 		}
 	}
+}
+
+void Analyzer::calcTones() {
+	const double freqPerBin = m_rate / m_fftN;
+	// Limit frequency range of processing
+	const size_t kMin = std::max(size_t(1), size_t(FFT_MINFREQ / freqPerBin));
+	const size_t kMax = std::min(m_fftN / 2, size_t(FFT_MAXFREQ / freqPerBin));
+	calcPeaks(kMax);
+	std::vector<Peak>& peaks = m_peaks;
 	// Prefilter peaks
 	double prevdb = peaks[0].db;
 	for (size_t k = 1; k < kMax; ++k) {
@@ -155,7 +199,8 @@ void Analyzer::calcTones() {
 		prevdb = db;
 	}
 	// Find the tones (collections of harmonics) from the array of peaks
-	tones_t tones;
+	tones_t& tones = m_newTones;
+	tones.clear();
 	for (size_t k = kMax - 1; k >= kMin; --k) {
 		if (peaks[k].db < -70.0) continue;
 		// Find the best divider for getting the fundamental from peaks[k]
@@ -165,7 +210,7 @@ void Analyzer::calcTones() {
 			double freq = peaks[k].freq / div; // Fundamental
 			int score = 0;
 			for (std::size_t n = 1; n < div && n < 8; ++n) {
-				Peak& p = match(peaks, k * n / div);
+				Peak& p = match(k * n / div);
 				--score;
 				if (p.db < -90.0 || std::abs(p.freq / n / freq - 1.0) > .03) continue;
 				if (n == 1) score += 4; // Extra for fundamental
@@ -183,7 +228,7 @@ void Analyzer::calcTones() {
 		t.db = peaks[k].db;
 		for (std::size_t n = 1; n <= bestDiv; ++n) {
 			// Find the peak for n'th harmonic
-			Peak& p = match(peaks, k * n / bestDiv);
+			Peak& p = match(k * n / bestDiv);
 			if (std::abs(p.freq / n / freq - 1.0) > .03) continue; // Does it match the fundamental freq?
 			if (p.db > t.db - 10.0) {
 				t.db = std::max(t.db, p.db);
@@ -197,20 +242,24 @@ void Analyzer::calcTones() {
 		// If the tone seems strong enough, add it (-3 dB compensation for each harmonic)
 		if (t.db > -50.0 - 3.0 * count) {
 			t.stabledb = t.db;
-			tones.push_back(t);
+			addTone(tones, t);
 		}
 	}
-	mergeWithOld(tones);
-	m_tones.swap(tones);
+	mergeWithOld(tones, m_mergedTones);
+	m_tones.swap(m_mergedTones);
 }
 
-void Analyzer::mergeWithOld(tones_t& tones) const {
-	tones.sort();
+void Analyzer::mergeWithOld(tones_t& tones, tones_t& merged) const {
+	// Stable insertion sort (the tones are nearly sorted already, and this does not allocate like std::stable_sort)
+	for (auto it = tones.begin(); it != tones.end(); ++it) {
+		for (auto jt = it; jt != tones.begin() && *jt < *(jt - 1); --jt) std::iter_swap(jt, jt - 1);
+	}
+	merged.clear();
 	auto it = tones.begin();
 	// Iterate over old tones
 	for (auto const& old: m_tones) {
 		// Try to find a matching new tone
-		while (it != tones.end() && *it < old) ++it;
+		while (it != tones.end() && *it < old) addTone(merged, *it++);
 		// If match found
 		if (it != tones.end() && *it == old) {
 			// Merge the old tone into the new tone
@@ -219,14 +268,18 @@ void Analyzer::mergeWithOld(tones_t& tones) const {
 			it->freq = 0.5 * old.freq + 0.5 * it->freq;
 		} else if (old.db > -80.0) {
 			// Insert a decayed version of the old tone into new tones
-			Tone& t = *tones.insert(it, old);
+			Tone t = old;
 			t.db -= 5.0;
 			t.stabledb -= 0.1;
+			addTone(merged, t);
 		}
 	}
+	while (it != tones.end()) addTone(merged, *it++);
 }
 
 void Analyzer::process() {
+	// Skip stale audio left from when nobody analyzed (e.g. in menus)
+	m_buf.resync();
 	// Try calculating FFT and calculate tones until no more data in input buffer
 	while (calcFFT()) calcTones();
 }
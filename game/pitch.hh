@@ -3,9 +3,9 @@
 #include <atomic>
 #include <complex>
 #include <vector>
-#include <list>
 #include <algorithm>
 #include <cmath>
+#include "libda/fft.hpp"
 
 /// struct to represent tones
 struct Tone {
@@ -30,41 +30,78 @@ static inline bool operator>=(Tone const& lhs, Tone const& rhs) { return lhs.fre
 static inline bool operator<(Tone const& lhs, Tone const& rhs) { return lhs.freq < rhs.freq && lhs != rhs; }
 static inline bool operator>(Tone const& lhs, Tone const& rhs) { return lhs.freq > rhs.freq && lhs != rhs; }
 
-static const unsigned FFT_P = 10;
+static const unsigned FFT_P = 10;  ///< Default FFT size (as a power of two)
 static const std::size_t FFT_N = 1 << FFT_P;
+static const std::size_t FFT_MINN = 512;  ///< Smallest FFT size that an Analyzer may use
+static const std::size_t FFT_MAXN = 4096;  ///< Largest FFT size that an Analyzer may use
 
-/// Lock-free ring buffer. Discards oldest data on overflow (not strictly thread-safe).
+/**
+* Lock-free single-producer/single-consumer ring buffer of samples.
+* One thread may call insert while another calls read/pop/size/resync. Data that does not fit is dropped,
+* so the producer never touches the read position. What is left in a buffer that overflowed is stale (e.g.
+* nobody consumed it while in menus), so after an overflow the producer drops everything until the consumer
+* calls resync() to discard the stale data. Thus the consumer must call resync() regularly.
+**/
 template <size_t SIZE> class RingBuffer {
+	static_assert(SIZE > 0 && (SIZE & (SIZE - 1)) == 0, "RingBuffer size must be a power of two");
 public:
 	constexpr static size_t capacity = SIZE;
-	RingBuffer(): m_read(), m_write() {}  ///< Initialize empty buffer
+	RingBuffer() {}  ///< Initialize empty buffer
+	/// Append samples (producer). Samples that do not fit are dropped.
 	template <typename InIt> void insert(InIt begin, InIt end) {
-		unsigned r = m_read;  // The read position
-		unsigned w = m_write;  // The write position
-		bool overflow = false;
-		while (begin != end) {
-			m_buf[w] = *begin++;  // Copy sample
-			w = modulo(w + 1);  // Update cursor
-			if (w == r) overflow = true;
+		unsigned w = m_write.load(std::memory_order_relaxed);  // Only the producer modifies this
+		unsigned r = m_read.load(std::memory_order_acquire);
+		unsigned n = end - begin;
+		unsigned space = SIZE - (w - r);
+		unsigned long long overflow = m_overflow.load(std::memory_order_relaxed);  // Only the producer modifies this
+		if (overflow != m_resynced.load(std::memory_order_acquire)) space = 0;  // Waiting for resync
+		if (n > space) {
+			m_overflow.store(overflow + n - space, std::memory_order_release);
+			n = space;
 		}
-		m_write = w;
-		if (overflow) m_read = modulo(w + 1);  // Reset read pointer on overflow
+		// Copy in at most two contiguous segments
+		unsigned pos = w & MASK;
+		unsigned first = std::min<unsigned>(n, SIZE - pos);
+		std::copy_n(begin, first, m_buf + pos);
+		std::copy_n(begin + first, n - first, m_buf);
+		m_write.store(w + n, std::memory_order_release);
 	}
 	/// Read data from current position if there is enough data to fill the range (otherwise return false). Does not move read pointer.
-	template <typename OutIt> bool read(OutIt begin, OutIt end) {
-		unsigned r = m_read;
-		if (modulo(m_write - r) <= end - begin) return false;  // Not enough audio available
-		while (begin != end) *begin++ = m_buf[r++ % SIZE];  // Copy audio to output iterator
+	template <typename OutIt> bool read(OutIt begin, OutIt end) const {
+		unsigned r = m_read.load(std::memory_order_relaxed);  // Only the consumer modifies this
+		unsigned w = m_write.load(std::memory_order_acquire);
+		unsigned n = end - begin;
+		if (w - r < n) return false;  // Not enough audio available
+		unsigned pos = r & MASK;
+		unsigned first = std::min<unsigned>(n, SIZE - pos);
+		std::copy_n(m_buf + pos, first, begin);
+		std::copy_n(m_buf, n - first, begin + first);
+		return true;
+	}
+	/// Move reading pointer forward (consumer).
+	void pop(unsigned n) {
+		unsigned r = m_read.load(std::memory_order_relaxed);
+		m_read.store(r + std::min(n, size()), std::memory_order_release);
+	}
+	/// Number of samples available for reading.
+	unsigned size() const { return m_write.load(std::memory_order_acquire) - m_read.load(std::memory_order_acquire); }
+	/// Discard the contents if the producer has dropped data since the last call (consumer), so that reading
+	/// continues from live data rather than from whatever was left when the buffer filled up. Returns true if discarded.
+	bool resync() {
+		unsigned long long overflow = m_overflow.load(std::memory_order_acquire);
+		if (overflow == m_resynced.load(std::memory_order_relaxed)) return false;
+		pop(size());
+		m_resynced.store(overflow, std::memory_order_release);  // Let the producer continue
 		return true;
 	}
-	void pop(unsigned n) { m_read = modulo(m_read + n); } ///< Move reading pointer forward.
-	unsigned size() const { return modulo(m_write - m_read); }
 private:
-	static unsigned modulo(unsigned idx) { return (SIZE + idx) % SIZE; }  ///< Modulo operation with proper rounding (handles slightly "negative" idx as well)
+	static constexpr unsigned MASK = SIZE - 1;
 	float m_buf[SIZE];
-	// The indices of the next read/write operations. read == write implies that buffer is empty.
+	// Free-running positions of the next read/write operations (wrap around naturally, masked on access). read == write implies that buffer is empty.
 	std::atomic<unsigned> m_read{ 0 };
 	std::atomic<unsigned> m_write{ 0 };
+	std::atomic<unsigned long long> m_overflow{ 0 };  ///< Samples dropped (written by the producer only)
+	std::atomic<unsigned long long> m_resynced{ 0 };  ///< m_overflow at the last resync (written by the consumer only)
 };
 
 /// analyzer class
@@ -76,10 +113,12 @@ public:
   	const Analyzer& operator=(const Analyzer&) = delete;
 	/// fast fourier transform vector
 	typedef std::vector<std::complex<float> > fft_t;
-	/// list of tones
-	typedef std::list<Tone> tones_t;
-	/// constructor
-	Analyzer(double rate, std::string id, std::size_t step = 200);
+	/// tones sorted by frequency; storage is reserved for MAXTONES so that the engine thread never allocates
+	typedef std::vector<Tone> tones_t;
+	static const std::size_t MAXTONES = 128; ///< The maximum number of tones tracked (the weakest ones are dropped)
+	/// constructor; larger fftSize gives better low note resolution at the cost of latency
+	Analyzer(double rate, std::string id, std::size_t fftSize = FFT_N, std::size_t step = 200);
+	~Analyzer();
 	/** Add input data to buffer. This is thread-safe (against other functions). **/
 	template <typename InIt> void input(InIt begin, InIt end) {
 		m_buf.insert(begin, end);
@@ -87,7 +126,9 @@ public:
 	}
 	/** Call this to process all data input so far. **/
 	void process();
-	/** Get the raw FFT. **/
+	/** Check if the value can be used as fftSize (a power of two between FFT_MINN and FFT_MAXN). **/
+	static bool isValidFFTSize(std::size_t fftSize) { return fftSize >= FFT_MINN && fftSize <= FFT_MAXN && (fftSize & (fftSize - 1)) == 0; }
+	/** Get the raw FFT (non-negative frequency bins only, fftSize / 2 + 1 values). **/
 	fft_t const& getFFT() const { return m_fft; }
 	/** Get the peak level in dB (negative value, 0.0 = clipping). **/
 	double getPeak() const { return 10.0 * log10(m_peak); }
@@ -118,19 +159,31 @@ public:
 
 private:
 	const std::size_t m_step;
-	RingBuffer<2 * FFT_N> m_buf;  // Twice the FFT size should give enough room for sliding window and for engine delays
+	RingBuffer<2 * FFT_MAXN> m_buf;  // Twice the FFT size should give enough room for sliding window and for engine delays
 	RingBuffer<4096> m_passthrough;
 	double m_resampleFactor;
 	double m_resamplePos;
 	double m_rate;
 	std::string m_id;
+	std::size_t m_fftN;
+	da::fft_plan m_fftPlan;
 	std::vector<float> m_window;
 	fft_t m_fft;
+	std::vector<float> m_pcm;  ///< Input of the FFT
 	std::vector<float> m_fftLastPhase;
 	double m_peak;
 	tones_t m_tones;
+	tones_t m_newTones;  ///< Tones found on the current hop (scratch)
+	tones_t m_mergedTones;  ///< Result of merging new tones with the old ones (scratch, swapped with m_tones)
 	mutable double m_oldfreq;
+	struct Peak;
+	// Per-bin work buffers in structure-of-arrays form, allocated once so that analysis does not allocate per hop
+	std::vector<float> m_binMagnitude;
+	std::vector<float> m_binPhase;
+	std::vector<Peak> m_peaks;
 	bool calcFFT();
+	void calcPeaks(std::size_t kMax);
+	Peak& match(std::size_t pos);
 	void calcTones();
-	void mergeWithOld(tones_t& tones) const;
+	void mergeWithOld(tones_t& tones, tones_t& merged) const;
 };
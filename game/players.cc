@@ -13,6 +13,7 @@ UErrorCode Players::m_icuError = U_ZERO_ERROR;
 
 Players::Players():
 	m_players(),
+	m_ids(),
 	m_filtered(),
 	m_filter(),
 	math_cover(),
@@ -60,11 +61,8 @@ void Players::update() {
 }
 
 int Players::lookup(std::string const& name) const {
-	for (auto const& p: m_players) {
-		if (p.name == name) return p.id;
-	}
-
-	return -1;
+	auto it = m_ids.find(name);
+	return it == m_ids.end() ? -1 : it->second;
 }
 
 std::string Players::lookup(int id) const {
@@ -75,7 +73,7 @@ std::string Players::lookup(int id) const {
 	else return it->name;
 }
 
-void Players::addPlayer (std::string const& name, std::string const& picture, int id) {
+int Players::addPlayer (std::string const& name, std::string const& picture, int id) {
 	PlayerItem pi;
 	pi.id = id;
 	pi.name = name;
@@ -102,6 +100,9 @@ void Players::addPlayer (std::string const& name, std::string const& picture, in
 		pi.id = assign_id_internal();
 		m_players.insert(pi); // now do the insert with the fresh id
 	}
+	auto idx = m_ids.emplace(pi.name, pi.id);
+	if (!idx.second && pi.id < idx.first->second) idx.first->second = pi.id;
+	return pi.id;
 }
 
 void Players::setFilter(std::string const& val) {
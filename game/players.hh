@@ -1,6 +1,7 @@
 #pragma once
 
 #include <set>
+#include <unordered_map>
 #include <list>
 #include <vector>
 #include <string>
@@ -41,6 +42,7 @@ class Players {
 
   private:
 	players_t m_players;
+	std::unordered_map<std::string, int> m_ids;  ///< Lowest id by player name
 	fplayers_t m_filtered;
 
 	std::string m_filter;
@@ -68,7 +70,8 @@ class Players {
 	std::string lookup(int id) const;
 
 	/// add a player with a displayed name and an optional picture; if no id is given one will be assigned
-	void addPlayer (std::string const& name, std::string const& picture = "", int id = -1);
+	/// @return the id of the player
+	int addPlayer (std::string const& name, std::string const& picture = "", int id = -1);
 
 	/// const array access
 	PlayerItem operator[](std::size_t pos) const {
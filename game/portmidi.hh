@@ -22,13 +22,14 @@ namespace pm {
 
 	class Input: public Stream {
 	public:
-		Input(int devId) {
+		/// Open device devId for input, timestamping events with timeProc (PortTime milliseconds if null)
+		Input(int devId, PmTimeProcPtr timeProc = nullptr, void* timeInfo = nullptr) {
 			// Errors must be handled here because otherwise PortMidi will just exit() the program...
 			if (devId < 0 || devId >= Pm_CountDevices()) throw std::runtime_error("Invalid PortMidi device ID");
 			PmDeviceInfo const* info = Pm_GetDeviceInfo(devId);
 			if (!info->input) throw std::runtime_error(std::string(info->name) + ": The PortMidi device is an output device (input device needed)");
 			if (info->opened) throw std::runtime_error(std::string(info->name) + ": The PortMidi device is already open");
-			PmError err = Pm_OpenInput(&m_handle, devId, 0, 1024, 0, 0);
+			PmError err = Pm_OpenInput(&m_handle, devId, nullptr, 1024, timeProc, timeInfo);
 			if (err) throw std::runtime_error(std::string(info->name) + ": Pm_OpenInput failed");
 		}
 	};
@@ -1,7 +1,25 @@
 #include "requesthandler.hh"
+#include "httpcache.hh"
+#include "songfilter.hh"
 #include "unicode.hh"
+#include "util.hh"
 
 #ifdef USE_WEBSERVER
+#include <algorithm>
+#include <cpprest/containerstream.h>
+#include <zlib.h>
+
+namespace {
+    /// Sort order (see Songs::sortDesc) by name used in the web API
+    int sortOrder(std::string const& name) {
+        if (name == "title") return 1;
+        if (name == "artist") return 2;
+        if (name == "edition") return 3;
+        if (name == "language") return 6;
+        return -1;
+    }
+}
+
 RequestHandler::RequestHandler(Songs& songs):m_songs(songs)
 {
 }
@@ -79,26 +97,11 @@ void RequestHandler::Get(web::http::http_request request)
     if (path == "/") {
         HandleFile(request, findFile("index.html").string());
     } else if (path == "/api/getDataBase.json") { //get database
-        m_songs.setFilter("");
-        if(request.relative_uri().query() == "sort=artist&order=ascending") {
-            m_songs.sortSpecificChange(2);    
-        } else if(request.relative_uri().query() == "sort=artist&order=descending") {
-            m_songs.sortSpecificChange(2, true);
-        } else if(request.relative_uri().query() == "sort=title&order=ascending") {
-            m_songs.sortSpecificChange(1);    
-        } else if(request.relative_uri().query() == "sort=title&order=descending") {
-            m_songs.sortSpecificChange(1, true);
-        } else if(request.relative_uri().query() == "sort=language&order=ascending") {
-            m_songs.sortSpecificChange(6);    
-        } else if(request.relative_uri().query() == "sort=language&order=descending") {
-            m_songs.sortSpecificChange(6, true);
-        } else if(request.relative_uri().query() == "sort=edition&order=ascending") {
-            m_songs.sortSpecificChange(3);    
-        } else if(request.relative_uri().query() == "sort=edition&order=descending") {
-            m_songs.sortSpecificChange(3, true);
-        }
-        web::json::value jsonRoot = SongsToJsonObject();
-        request.reply(web::http::status_codes::OK, jsonRoot);
+        auto query = web::uri::split_query(request.relative_uri().query());
+        int order = query.count(U("sort")) ? sortOrder(utility::conversions::to_utf8string(query[U("sort")])) : -1;
+        bool descending = query.count(U("order")) && query[U("order")] == U("descending");
+        if (order == -1) order = m_songs.sortNum();  // Same order as on screen
+        ReplyCached(request, *DataBaseResponse(order, descending));
         return;
     }  else if(path == "/api/language") {
         auto localeMap = GenerateLocaleDict();
@@ -117,6 +120,7 @@ void RequestHandler::Get(web::http::http_request request)
         return;
     } else if(path == "/api/getCurrentPlaylist.json") {
         Game* gm = Game::getSingletonPtr();
+        auto library = m_songs.library();
         web::json::value jsonRoot = web::json::value::array();
         auto i = 0;
         for (auto const& song : gm->getCurrentPlayList().getList()) {
@@ -126,12 +130,14 @@ void RequestHandler::Get(web::http::http_request request)
             songObject["Edition"] = web::json::value::string(song->edition);
             songObject["Language"] = web::json::value::string(song->language);
             songObject["Creator"] = web::json::value::string(song->creator);
-            songObject["Duration"] = web::json::value(song->getDurationSeconds());
+            songObject["Id"] = web::json::value::number(song->id);
+            auto duration = library->durations.find(song->id);  // Measured when the song was loaded
+            songObject["Duration"] = web::json::value(duration != library->durations.end() ? duration->second : 0.0);
             jsonRoot[i] = songObject;
             i++;
         }
 
-        request.reply(web::http::status_codes::OK, jsonRoot);
+        ReplyCached(request, *MakeResponse(jsonRoot));
         return;
     } else if(path == "/api/getplaylistTimeout") {
         request.reply(web::http::status_codes::OK, U(config["game/playlist_screen_timeout"].i()));
@@ -161,10 +167,10 @@ void RequestHandler::Post(web::http::http_request request)
     }
 
     if (path == "/api/add") {
-        m_songs.setFilter("");
         std::shared_ptr<Song> songPointer = GetSongFromJSON(jsonPostBody);
         if(!songPointer) {
-            request.reply(web::http::status_codes::NotFound, "Song \"" + jsonPostBody["Artist"].as_string() + " - " + jsonPostBody["Title"].as_string() + "\" was not found.");
+            std::string name = jsonPostBody.has_field("Id") ? std::to_string(jsonPostBody["Id"].as_integer()) : jsonPostBody["Artist"].as_string() + " - " + jsonPostBody["Title"].as_string();
+            request.reply(web::http::status_codes::NotFound, "Song \"" + name + "\" was not found.");
             return;
         } else {
             std::clog << "requesthandler/debug: Adding " << songPointer->artist << " - " << songPointer->title << " to the playlist " << std::endl;
@@ -181,6 +187,16 @@ void RequestHandler::Post(web::http::http_request request)
             return;
         }
         try {
+            if(jsonPostBody.has_field("Id")) { // Song id instead of the position in the playlist
+                auto const& list = gm->getCurrentPlayList().getList();
+                unsigned id = jsonPostBody["Id"].as_integer();
+                auto it = std::find_if(list.begin(), list.end(), [id](std::shared_ptr<Song> const& song) { return song->id == id; });
+                if(it == list.end()) {
+                    request.reply(web::http::status_codes::NotFound, "Song " + std::to_string(id) + " is not in the playlist.");
+                    return;
+                }
+                jsonPostBody["songId"] = web::json::value::number(int(it - list.begin()));
+            }
             auto songIdToDelete = jsonPostBody["songId"].as_integer();
             if(songIdToDelete >= 0) {
                 gm->getCurrentPlayList().removeSong(songIdToDelete);
@@ -235,20 +251,22 @@ void RequestHandler::Post(web::http::http_request request)
             return;
         }     
     } else if(path == "/api/search") {
-        auto query = jsonPostBody["query"].as_string();
-        m_songs.setFilter(query);
-        web::json::value jsonRoot = web::json::value::array();
-        for(int i = 0; i < m_songs.size(); i++) {
-            web::json::value songObject = web::json::value::object();
-            songObject["Title"] = web::json::value::string(m_songs[i]->title);
-            songObject["Artist"] = web::json::value::string(m_songs[i]->artist);
-            songObject["Edition"] = web::json::value::string(m_songs[i]->edition);
-            songObject["Language"] = web::json::value::string(m_songs[i]->language);
-            songObject["Creator"] = web::json::value::string(m_songs[i]->creator);
-            jsonRoot[i] = songObject;
+        try {
+            Songs::SongVector songs = SearchSongs(*m_songs.library(), jsonPostBody);
+            // Pagination, the total number of matches is in a header
+            songfilter::Page page(songs.size(),
+              jsonPostBody.has_field("offset") ? jsonPostBody["offset"].as_integer() : 0,
+              jsonPostBody.has_field("limit") ? std::max(0, jsonPostBody["limit"].as_integer()) : -1);
+            web::http::http_response response(web::http::status_codes::OK);
+            response.headers().add(U("X-Total-Count"), songs.size());
+            response.set_body(SongsToJsonObject(Songs::SongVector(songs.begin() + page.offset, songs.begin() + page.offset + page.count)));
+            request.reply(response);
+            return;
+        } catch(web::json::json_exception const & e) {
+            std::string str = std::string("JSON Exception: ") + e.what();
+            request.reply(web::http::status_codes::BadRequest, str);
+            return;
         }
-        request.reply(web::http::status_codes::OK, jsonRoot);
-        return;
     } else {
         request.reply(web::http::status_codes::NotFound, "The path \""+ path +"\" was not found.");
         return;
@@ -283,33 +301,89 @@ web::json::value RequestHandler::ExtractJsonFromRequest(web::http::http_request
 }
 
 
-web::json::value RequestHandler::SongsToJsonObject() {
-    web::json::value jsonRoot = web::json::value::array();
-    for (int i=0; i< m_songs.size(); i++) {
+web::json::value RequestHandler::SongsToJsonObject(Songs::SongVector const& songs) {
+    web::json::value jsonRoot = web::json::value::array(songs.size());
+    for (std::size_t i = 0; i < songs.size(); i++) {
         web::json::value songObject = web::json::value::object();
-        songObject["Title"] = web::json::value::string(m_songs[i]->title);
-        songObject["Artist"] = web::json::value::string(m_songs[i]->artist);
-        songObject["Edition"] = web::json::value::string(m_songs[i]->edition);
-        songObject["Language"] = web::json::value::string(m_songs[i]->language);
-        songObject["Creator"] = web::json::value::string(m_songs[i]->creator);
-        songObject["name"] = web::json::value::string(m_songs[i]->artist + " " + m_songs[i]->title);
+        songObject["Title"] = web::json::value::string(songs[i]->title);
+        songObject["Artist"] = web::json::value::string(songs[i]->artist);
+        songObject["Edition"] = web::json::value::string(songs[i]->edition);
+        songObject["Language"] = web::json::value::string(songs[i]->language);
+        songObject["Creator"] = web::json::value::string(songs[i]->creator);
+        songObject["Id"] = web::json::value::number(songs[i]->id);
+        songObject["name"] = web::json::value::string(songs[i]->artist + " " + songs[i]->title);
         jsonRoot[i] = songObject;
     }
 
     return jsonRoot;
 }
 
+std::shared_ptr<RequestHandler::CachedResponse const> RequestHandler::MakeResponse(web::json::value const& json, bool reused) {
+    auto response = std::make_shared<CachedResponse>();
+    std::string body = utility::conversions::to_utf8string(json.serialize());
+    response->etag = httpcache::etag(body);
+    response->gzipEtag = httpcache::etag(body, "-gz");
+    response->gzipped = httpcache::gzip(body, reused ? Z_BEST_COMPRESSION : Z_DEFAULT_COMPRESSION);
+    response->body.assign(body.begin(), body.end());
+    return response;
+}
+
+void RequestHandler::ReplyCached(web::http::http_request request, CachedResponse const& cached) {
+    using web::http::header_names;
+    auto const& headers = request.headers();
+    // The gzipped body is a different representation, so it has an ETag of its own
+    auto encoding = headers.find(header_names::accept_encoding);
+    bool gzipped = !cached.gzipped.empty() && encoding != headers.end() && httpcache::acceptsGzip(utility::conversions::to_utf8string(encoding->second));
+    std::string const& etag = gzipped ? cached.gzipEtag : cached.etag;
+    web::http::http_response response(web::http::status_codes::OK);
+    response.headers().add(header_names::etag, utility::conversions::to_string_t(etag));
+    response.headers().add(header_names::vary, U("Accept-Encoding"));
+    response.headers().add(header_names::cache_control, U("no-cache"));  // Clients may keep it but must revalidate
+    auto match = headers.find(header_names::if_none_match);
+    if (match != headers.end() && httpcache::etagMatches(utility::conversions::to_utf8string(match->second), etag)) {
+        response.set_status_code(web::http::status_codes::NotModified);
+        request.reply(response).then([this](pplx::task<void> t) { Error(t); });
+        return;
+    }
+    std::vector<unsigned char> const& body = gzipped ? cached.gzipped : cached.body;
+    if (gzipped) response.headers().add(header_names::content_encoding, U("gzip"));
+    response.set_body(concurrency::streams::bytestream::open_istream(body), body.size(), U("application/json"));
+    request.reply(response).then([this](pplx::task<void> t) { Error(t); });
+}
+
+std::shared_ptr<RequestHandler::CachedResponse const> RequestHandler::DataBaseResponse(int order, bool descending) {
+    std::lock_guard<std::mutex> l(m_cacheMutex);  // Concurrent requests wait for the same serialization
+    auto library = m_songs.library();
+    if (!m_library || library->generation != m_library->generation) {
+        m_cache.clear();
+        m_library = library;
+    }
+    bool caseSensitive = config["game/case-sorting"].b();
+    auto& response = m_cache[std::make_tuple(order, descending, caseSensitive)];
+    if (!response) {
+        Songs::SongVector songs = m_library->songs;
+        Songs::sortSongs(songs, order, descending, caseSensitive);
+        response = MakeResponse(SongsToJsonObject(songs), true);
+    }
+    return response;
+}
+
 std::shared_ptr<Song> RequestHandler::GetSongFromJSON(web::json::value jsonDoc) {
-    m_songs.setFilter("");
-
-    for(int i = 0; i< m_songs.size(); i++) {
-        if(m_songs[i]->title == jsonDoc["Title"].as_string() &&
-           m_songs[i]->artist == jsonDoc["Artist"].as_string() &&
-           m_songs[i]->edition == jsonDoc["Edition"].as_string() &&
-           m_songs[i]->language == jsonDoc["Language"].as_string() &&
-           m_songs[i]->creator == jsonDoc["Creator"].as_string() ) {
+    auto library = m_songs.library();
+    if(jsonDoc.has_field("Id")) {
+        auto it = library->byId.find(jsonDoc["Id"].as_integer());
+        if(it != library->byId.end()) return it->second;
+        std::clog << "webserver/info: Couldn't find requested song." << std::endl;
+        return std::shared_ptr<Song>();
+    }
+    for (auto const& song: library->songs) {
+        if(song->title == jsonDoc["Title"].as_string() &&
+           song->artist == jsonDoc["Artist"].as_string() &&
+           song->edition == jsonDoc["Edition"].as_string() &&
+           song->language == jsonDoc["Language"].as_string() &&
+           song->creator == jsonDoc["Creator"].as_string() ) {
             std::clog << "webserver/info: Found requested song." << std::endl;
-            return m_songs[i];
+            return song;
         }
     }
 
@@ -317,6 +391,26 @@ std::shared_ptr<Song> RequestHandler::GetSongFromJSON(web::json::value jsonDoc)
     return std::shared_ptr<Song>();
 }
 
+Songs::SongVector RequestHandler::SearchSongs(Songs::Library const& library, web::json::value& params) {
+    // Matched like the song browser search does, ignoring case and accents
+    auto param = [&params](char const* name) { return params.has_field(name) ? UnicodeUtil::searchFold(params[name].as_string()) : std::string(); };
+    songfilter::Filter filter;
+    filter.query = param("query");
+    filter.fields = {{ param("title"), param("artist"), param("genre"), param("edition") }};  // By songfilter::Line
+    filter.language = param("language");
+    std::map<std::string, std::string> languages;  // Folded languages (there are only a few different ones)
+    Songs::SongVector songs;
+    for (auto const& song: library.songs) {
+        auto it = languages.find(song->language);
+        if (it == languages.end()) it = languages.emplace(song->language, UnicodeUtil::searchFold(song->language)).first;
+        if (filter.matches(song->searchText(), it->second)) songs.push_back(song);
+    }
+    int order = params.has_field("sort") ? sortOrder(params["sort"].as_string()) : -1;
+    bool descending = params.has_field("order") && params["order"].as_string() == "descending";
+    Songs::sortSongs(songs, order == -1 ? m_songs.sortNum() : order, descending, config["game/case-sorting"].b());
+    return songs;
+}
+
 std::map<std::string, std::string> RequestHandler::GenerateLocaleDict() {
     std::vector<std::string> translationKeys = GetTranslationKeys();
     std::map<std::string, std::string> localeMap;
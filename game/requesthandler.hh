@@ -5,6 +5,15 @@
 #include <cpprest/filestream.h>
 
 #include "screen_playlist.hh"
+#include "songs.hh"
+
+#include <cstdint>
+#include <array>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <tuple>
+#include <vector>
 
 class RequestHandler
 {
@@ -27,15 +36,35 @@ class RequestHandler
 
         web::json::value ExtractJsonFromRequest(web::http::http_request request);
 
+        /// A serialized JSON response, also gzipped for clients that accept it
+        struct CachedResponse {
+            std::string etag;
+            std::string gzipEtag;  ///< Of the gzipped body
+            std::vector<unsigned char> body;
+            std::vector<unsigned char> gzipped;  ///< Empty if compression failed
+        };
+        /// Serialize and compress json; reused responses are compressed harder since they are served many times
+        static std::shared_ptr<CachedResponse const> MakeResponse(web::json::value const& json, bool reused = false);
+        /// Reply with 304 Not Modified if the client has it already (gzipped if the client accepts it)
+        void ReplyCached(web::http::http_request request, CachedResponse const& response);
+        /// The whole song library in given sort order, serialized once per change of the library
+        std::shared_ptr<CachedResponse const> DataBaseResponse(int order, bool descending);
+
         void HandleFile(web::http::http_request request, std::string filePath = "");
-        web::json::value SongsToJsonObject();
+        web::json::value SongsToJsonObject(Songs::SongVector const& songs);
         std::map<std::string, std::string> GenerateLocaleDict();
         std::vector<std::string> GetTranslationKeys();
         std::shared_ptr<Song> GetSongFromJSON(web::json::value);
+        /// Songs matching the filters of a search request (query and field filters), sorted as requested
+        Songs::SongVector SearchSongs(Songs::Library const& library, web::json::value& params);
 
         web::http::experimental::listener::http_listener m_listener;
 
         Songs& m_songs;
+
+        std::mutex m_cacheMutex;
+        std::shared_ptr<Songs::Library const> m_library;  ///< The library that m_cache was made from
+        std::map<std::tuple<int, bool, bool>, std::shared_ptr<CachedResponse const>> m_cache;  ///< By order, descending and case sensitivity
 };
 #else
 class Songs;
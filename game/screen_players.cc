@@ -47,8 +47,6 @@ void ScreenPlayers::exit() {
 	m_songbg.reset();
 	m_playing.clear();
 	m_playReq.clear();
-
-	m_database.save();
 }
 
 void ScreenPlayers::manageEvent(input::NavEvent const& event) {
@@ -60,7 +58,7 @@ void ScreenPlayers::manageEvent(input::NavEvent const& event) {
 		else { m_search.text.clear(); m_players.setFilter(m_search.text); }
 	} else if (nav == input::NAV_START) {
 		if (m_players.empty()) {
-			m_players.addPlayer(m_search.text);
+			m_database.addPlayer(m_search.text);
 			m_players.setFilter(m_search.text);
 			m_players.update();
 			// the current player is the new created one
@@ -175,6 +175,7 @@ void ScreenSongs::manageEvent(SDL_Event event) {
 void ScreenSongs::update() {
 	Game* sm = Game::getSingletonPtr();
 	sm->showLogo(!m_jukebox);
+	m_beatDetector.update();
 	if (m_idleTimer.get() < 0.3) return;  // Only update when the user gives us a break
 	m_songs.update(); // Poll for new songs
 	bool songChange = false;  // Do we need to switch songs?
@@ -197,17 +198,17 @@ void ScreenSongs::update() {
 	if (m_playing != music) songChange = true;
 	// Switch songs if needed, only when the user is not browsing for a moment
 	if (!songChange) return;
-	ScreenSongs::previewBeatsBuffer.reset(new_fvec(1));
-	{
-	std::lock_guard<std::recursive_mutex> l(Audio::aubio_mutex);	
-	Audio::aubioTempo.reset(new_aubio_tempo("default", Audio::aubio_win_size, Audio::aubio_hop_size, Audio::getSR()));
-	}
 	if (song && song->hasControllers()) { song->loadNotes(); } // Needed for BPM info.
 	m_playing = music;
 	// Clear the old content and load new content if available
 	m_songbg.reset(); m_video.reset();
 	double pstart = (!m_jukebox && song ? song->preview_start : 0.0);
 	m_audio.playMusic(music, true, 1.0, pstart);
+	// Detect beats for the cover browser to pulse with
+	if (song && !m_jukebox && !song->hasControllers() && pstart > 0.0) {
+		auto it = music.find("background");
+		if (it != music.end()) m_beatDetector.request(song, it->second, pstart);
+	}
 	if (song) {
 		fs::path const& background = song->background.empty() ? song->cover : song->background;
 		if (!background.empty()) try { m_songbg = std::make_unique<Texture>(background); } catch (std::exception const&) {}
@@ -340,6 +341,7 @@ void ScreenSongs::draw() {
 	}
 	// Menus on top of everything
 	if (m_menu.isOpen()) drawMenu();
+	pruneCovers();
 }
 
 void ScreenSongs::drawCovers() {
@@ -403,6 +405,12 @@ void ScreenSongs::drawCovers() {
 		ColorTrans c2(Color::alpha(0.4));
 		s.draw();
 	}
+	// Prefetch the covers next to the visible ones, nearest first
+	for (int i = 1; i <= PREFETCH_COVERS; ++i) {
+		for (int idx: { baseidx - 2 - i, baseidx + 5 + i }) {
+			if (idx >= 0 && idx < int(ss)) getCover(*m_songs[idx], -i);
+		}
+	}
 	// Draw the playlist
 	Game* gm = Game::getSingletonPtr();
 	auto const& playlist = gm->getCurrentPlayList().getList();
@@ -421,23 +429,34 @@ void ScreenSongs::drawCovers() {
 	}
 }
 
-Texture* ScreenSongs::loadTextureFromMap(fs::path path) {
-	if(m_covers.find(path) == m_covers.end()) {
-		std::pair<fs::path, std::unique_ptr<Texture>> kv = std::make_pair(path, std::make_unique<Texture>(path));
-		m_covers.insert(std::move(kv));
-	}
-	try {
-		return m_covers.at(path).get();
-	} catch (std::exception const&) {}
-	return nullptr;
+Texture* ScreenSongs::loadTextureFromMap(fs::path path, int priority) {
+	auto it = m_covers.find(path);
+	if (it == m_covers.end()) {
+		it = m_covers.emplace(path, Cover{ std::make_unique<Texture>(path), m_frame }).first;
+		it->second.texture->prioritize(priority);
+	} else if (it->second.texture->loading()) {
+		it->second.texture->prioritize(priority);
+	}
+	it->second.used = m_frame;
+	return it->second.texture.get();
+}
+
+void ScreenSongs::pruneCovers() {
+	// Cancel loading the covers that have not been needed for a while (e.g. scrolled far past), they are requested
+	// again if they come back. Covers that drop out for a few frames (at the edge of the prefetch window) are kept.
+	if (++m_frame % COVER_KEEP_FRAMES) return;
+	for (auto it = m_covers.begin(); it != m_covers.end();) {
+		if (m_frame - it->second.used > COVER_KEEP_FRAMES && it->second.texture->loading()) it = m_covers.erase(it);
+		else ++it;
+	}
 }
 
-Texture& ScreenSongs::getCover(Song const& song) {
+Texture& ScreenSongs::getCover(Song const& song, int priority) {
 	Texture* cover = nullptr;
 	// Fetch cover image from cache or try loading it
-	if (!song.cover.empty()) cover = loadTextureFromMap(song.cover);
+	if (!song.cover.empty()) cover = loadTextureFromMap(song.cover, priority);
 	// Fallback to background image as cover if needed
-	if (!cover && !song.background.empty()) cover = loadTextureFromMap(song.background);
+	if (!cover && !song.background.empty()) cover = loadTextureFromMap(song.background, priority);
 	// Use empty cover
 	if (!cover) {
 		if(song.hasDance()) {
@@ -545,8 +564,6 @@ void ScreenSongs::drawMenu() {
 	m_menu.dimensions.stretch(w, h);
 }
 
-std::unique_ptr<fvec_t, void(*)(fvec_t*)> ScreenSongs::previewSamplesBuffer = std::unique_ptr<fvec_t, void(*)(fvec_t*)>(new_fvec(1), [](fvec_t* p){del_fvec(p);});
-std::unique_ptr<fvec_t, void(*)(fvec_t*)> ScreenSongs::previewBeatsBuffer = std::unique_ptr<fvec_t, void(*)(fvec_t*)>(new_fvec(1), [](fvec_t* p){del_fvec(p);});
 
 void ScreenSongs::createPlaylistMenu() {
 	m_menu.clear();
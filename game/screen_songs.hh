@@ -1,6 +1,7 @@
 #pragma once
 
 #include "animvalue.hh"
+#include "beatdetector.hh"
 #include "controllers.hh"
 #include "screen.hh"
 #include "theme.hh"
@@ -9,7 +10,6 @@
 #include "video.hh"
 #include "playlist.hh"
 #include "menu.hh"
-#include <aubio/fvec.h>
 
 class Audio;
 class Database;
@@ -36,10 +36,8 @@ public:
 	void prepare();
 	void draw();
 	void drawCovers(); ///< draw the cover browser
-	Texture& getCover(Song const& song); ///< get appropriate cover image for the song (incl. no cover)
+	Texture& getCover(Song const& song, int priority = 0); ///< get appropriate cover image for the song (incl. no cover), priority as in Texture::prioritize
 	void drawJukebox(); ///< draw the songbrowser in jukebox mode (fullscreen, full previews, ...)
-	static std::unique_ptr<fvec_t, void(*)(fvec_t*)> previewSamplesBuffer;
-	static std::unique_ptr<fvec_t, void(*)(fvec_t*)> previewBeatsBuffer;
 private:
 	void manageSharedKey(input::NavEvent const& event); ///< same behaviour for jukebox and normal mode
 	void drawInstruments(Dimensions dim) const;
@@ -49,7 +47,10 @@ private:
 	bool addSong(); ///< Add current song to playlist. Returns true if the playlist was empty.
 	void sing(); ///< Enter singing screen with current playlist.
 	void createPlaylistMenu();
-	Texture* loadTextureFromMap(fs::path path);
+	Texture* loadTextureFromMap(fs::path path, int priority = 0);
+	void pruneCovers(); ///< Cancel loading covers that have not been used for a while, called once per frame
+	static const int PREFETCH_COVERS = 8; ///< Covers loaded ahead on each side of the cover browser
+	static const unsigned COVER_KEEP_FRAMES = 60; ///< Frames that a loading cover is kept after its last use
 
 	Audio& m_audio;
 	Songs& m_songs;
@@ -67,7 +68,13 @@ private:
 	std::unique_ptr<Texture> m_danceCover;
 	std::unique_ptr<Texture> m_instrumentList;
 	std::unique_ptr<ThemeInstrumentMenu> m_menuTheme;
-	std::map<fs::path, std::unique_ptr<Texture>> m_covers;
+	struct Cover {
+		std::unique_ptr<Texture> texture;
+		unsigned used; ///< Frame of last use (see m_frame)
+	};
+	std::map<fs::path, Cover> m_covers;
+	unsigned m_frame = 0; ///< Frames drawn, for pruning covers
+	BeatDetector<Song> m_beatDetector{ detectBeats }; ///< For songs without beat information
 	int m_menuPos, m_infoPos;
 	bool m_jukebox;
 	bool show_hiscores;
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+* Substring search over items (e.g. Songs, by title, artist, genre, edition and path), ignoring case and accents.
+* Items are indexed by byte trigrams of their searchText(), which is folded with UnicodeUtil::searchFold, so a
+* query only checks items that contain its rarest trigram. A query that extends the previous one (e.g. typing
+* another letter) only checks the previous results.
+**/
+template <typename Item> class SearchIndex {
+  public:
+	void add(std::shared_ptr<Item> const& item) {
+		if (m_ids.find(item.get()) != m_ids.end()) return;
+		Id id = m_entries.size();
+		m_entries.push_back(item);
+		m_ids.emplace(item.get(), id);
+		index(id);
+		m_hasLast = false;  // The new item might match the previous query
+	}
+	void remove(Item const* item) {
+		auto it = m_ids.find(item);
+		if (it == m_ids.end()) return;
+		m_entries[it->second].reset();  // Postings of removed entries are left in place until compact()
+		m_ids.erase(it);
+		if (++m_removed > m_entries.size() / 2) compact();
+	}
+	void clear() {
+		m_entries.clear();
+		m_ids.clear();
+		m_trigrams.clear();
+		m_removed = 0;
+		m_hasLast = false;
+	}
+	/// Items whose text contains query (UTF-8, already folded with UnicodeUtil::searchFold), in the order they were added
+	std::vector<std::shared_ptr<Item>> find(std::string const& query) {
+		std::vector<Id> result;
+		auto check = [&](Id id) {
+			auto const& item = m_entries[id];
+			if (item && item->searchText().find(query) != std::string::npos) result.push_back(id);
+		};
+		if (m_hasLast && query.find(m_lastQuery) != std::string::npos) {
+			// Refining the previous query, its results contain all matches
+			for (Id id: m_lastResult) check(id);
+		} else if (query.size() >= 3) {
+			// Only items containing the rarest trigram of the query can match
+			std::vector<Id> const* candidates = nullptr;
+			for (std::size_t pos = 0; pos + 3 <= query.size(); ++pos) {
+				auto it = m_trigrams.find(trigram(query, pos));
+				if (it == m_trigrams.end()) { candidates = nullptr; break; }
+				if (!candidates || it->second.size() < candidates->size()) candidates = &it->second;
+			}
+			if (candidates) for (Id id: *candidates) check(id);
+		} else {
+			for (Id id = 0; id < m_entries.size(); ++id) check(id);
+		}
+		std::vector<std::shared_ptr<Item>> items;
+		items.reserve(result.size());
+		for (Id id: result) items.push_back(m_entries[id]);
+		m_hasLast = true;
+		m_lastQuery = query;
+		m_lastResult = std::move(result);
+		return items;
+	}
+  private:
+	typedef std::uint32_t Id;
+	static std::uint32_t trigram(std::string const& s, std::size_t pos) {
+		return std::uint32_t(std::uint8_t(s[pos])) << 16 | std::uint32_t(std::uint8_t(s[pos + 1])) << 8 | std::uint8_t(s[pos + 2]);
+	}
+	void index(Id id) {
+		std::string const& text = m_entries[id]->searchText();
+		for (std::size_t pos = 0; pos + 3 <= text.size(); ++pos) {
+			std::vector<Id>& ids = m_trigrams[trigram(text, pos)];
+			if (ids.empty() || ids.back() != id) ids.push_back(id);
+		}
+	}
+	void compact() {
+		std::vector<std::shared_ptr<Item>> entries;
+		entries.reserve(m_entries.size() - m_removed);
+		for (auto& e: m_entries) if (e) entries.push_back(std::move(e));
+		clear();
+		m_entries.swap(entries);
+		for (Id id = 0; id < m_entries.size(); ++id) {
+			m_ids.emplace(m_entries[id].get(), id);
+			index(id);
+		}
+	}
+	std::vector<std::shared_ptr<Item>> m_entries;  ///< nullptr if removed
+	std::unordered_map<Item const*, Id> m_ids;
+	std::unordered_map<std::uint32_t, std::vector<Id>> m_trigrams;  ///< Ids of entries containing each trigram, ascending
+	std::size_t m_removed = 0;
+	// The previous query and its results (for refining)
+	bool m_hasLast = false;
+	std::string m_lastQuery;
+	std::vector<Id> m_lastResult;
+};
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <type_traits>
+
+/**
+* Sequence lock for publishing a small value from exactly one writer thread to any number of readers.
+* The writer never waits for readers: store() only bumps a sequence counter around copying the value. A reader
+* copies the value and retries if a store happened meanwhile, so readers can never delay the writer (e.g. the
+* audio callback) however often they poll. The value is copied through atomic words, so torn copies are detected
+* rather than being data races.
+**/
+template <typename T> class SeqLock {
+	static_assert(std::is_trivially_copyable<T>::value, "SeqLock value must be trivially copyable");
+	typedef std::uint64_t Word;
+	static const std::size_t WORDS = (sizeof(T) + sizeof(Word) - 1) / sizeof(Word);
+  public:
+	explicit SeqLock(T const& value = T()) { store(value); }
+	/// Writer: publish a new value
+	void store(T const& value) {
+		Word words[WORDS] = {};
+		std::memcpy(words, &value, sizeof(T));
+		unsigned seq = m_seq.load(std::memory_order_relaxed);
+		m_seq.store(seq + 1, std::memory_order_relaxed);  // Odd: store in progress
+		std::atomic_thread_fence(std::memory_order_release);
+		for (std::size_t i = 0; i < WORDS; ++i) m_data[i].store(words[i], std::memory_order_relaxed);
+		m_seq.store(seq + 2, std::memory_order_release);
+	}
+	/// Reader: the latest complete value
+	T load() const {
+		Word words[WORDS];
+		while (true) {
+			unsigned seq = m_seq.load(std::memory_order_acquire);
+			if (seq & 1) { std::this_thread::yield(); continue; }  // Store in progress (the writer may have been preempted)
+			for (std::size_t i = 0; i < WORDS; ++i) words[i] = m_data[i].load(std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (m_seq.load(std::memory_order_relaxed) == seq) break;
+		}
+		T value;
+		std::memcpy(&value, words, sizeof(T));
+		return value;
+	}
+  private:
+	std::atomic<unsigned> m_seq{ 0 };
+	std::array<std::atomic<Word>, WORDS> m_data{};
+};
+
@@ -1,65 +1,87 @@
 #include "song.hh"
 #include "config.hh"
 #include "screen_sing.hh"
+#include "songcache.hh"
+#include "songfilter.hh"
 #include "songparser.hh"
 #include "unicode.hh"
 #include "util.hh"
 
 #include <algorithm>
 #include <limits>
+#include <mutex>
 
 extern "C" {
 #include AVFORMAT_INCLUDE
 #include AVCODEC_INCLUDE
 }
-#ifdef USE_WEBSERVER
-Song::Song(web::json::value const& song): dummyVocal(TrackName::LEAD_VOCAL), randomIdx(rand()) {
-	path = song.has_field("TxtFileFolder") ? fs::path(song.at("TxtFileFolder").as_string().substr(0, song.at("TxtFileFolder").as_string().find_last_of("/\\"))) : "";
-	filename = song.has_field("TxtFile") ? fs::path(song.at("TxtFile").as_string()) : "";
-	artist = song.has_field("Artist") ? song.at("Artist").as_string() : "";
-	title = song.has_field("Title") ? song.at("Title").as_string() : "";
-	language = song.has_field("Language") ? song.at("Language").as_string() : "";
-	edition = song.has_field("Edition") ? song.at("Edition").as_string() : "";
-	creator = song.has_field("Creator") ? song.at("Creator").as_string() : "";
-	genre = song.has_field("Genre") ? song.at("Genre").as_string() : "";
-	cover = song.has_field("Cover") ? song.at("Cover").as_string() : "";
-	background = song.has_field("Background") ? song.at("Background").as_string() : "";
-	video = song.has_field("VideoFile") ? fs::path(song.at("VideoFile").as_string()) : "";
-	videoGap = song.has_field("VideoGap") ? song.at("VideoGap").as_number().to_double() : 0.0;
-	start = song.has_field("Start") ? song.at("Start").as_number().to_double() : 0.0;
-	preview_start = song.has_field("PreviewStart") ? song.at("PreviewStart").as_number().to_double() : 0.0;
-	m_duration = song.has_field("Duration") ? song.at("Duration").as_number().to_double() : 0.0;
-	music["background"] = song.has_field("SongFile") ? fs::path(song.at("SongFile").as_string()) : "";
-	music["vocals"] = song.has_field("Vocals") ? fs::path(song.at("Vocals").as_string()) : "";
+Song::Song(cache::SongCacheFile const& cache, cache::SongRecord const& r): dummyVocal(TrackName::LEAD_VOCAL), randomIdx(rand()) {
+	path = cache.str(r.path);
+	filename = cache.str(r.filename);
+	artist = cache.str(r.artist);
+	title = cache.str(r.title);
+	language = cache.str(r.language);
+	edition = cache.str(r.edition);
+	creator = cache.str(r.creator);
+	genre = cache.str(r.genre);
+	cover = cache.str(r.cover);
+	background = cache.str(r.background);
+	video = cache.str(r.video);
+	videoGap = r.videoGap;
+	start = r.start;
+	preview_start = r.previewStart;
+	m_duration = r.duration;
+	fileTime = r.fileTime;
+	fileSize = r.fileSize;
+	music[TrackName::BGMUSIC] = cache.str(r.music);
+	music["vocals"] = cache.str(r.vocals);
 	loadStatus = Song::LoadStatus::HEADER;
-	
-	if (song.has_field("VocalTracks")) {
-		for (unsigned i = 0; i < song.at("VocalTracks").as_number().to_uint32(); i++) {
-			std::string track = "DummyTrack" + std::to_string(i);
-			insertVocalTrack(track, VocalTrack(track));
-		}
-	}
-	
-	if (song.has_field("KeyboardTracks")) {
-			instrumentTracks.insert(make_pair(TrackName::KEYBOARD, InstrumentTrack(TrackName::KEYBOARD)));
-	}
-	
-	if (song.has_field("DrumTracks")) {
-			instrumentTracks.insert(make_pair(TrackName::DRUMS, InstrumentTrack(TrackName::DRUMS)));
-	}		
-	if (song.has_field("DanceTracks")) {
-		DanceDifficultyMap danceDifficultyMap;
-			danceTracks.insert(std::make_pair("dance-single", danceDifficultyMap));
-	}		
-	if (song.has_field("GuitarTracks")) {
-			instrumentTracks.insert(std::make_pair(TrackName::GUITAR, InstrumentTrack(TrackName::GUITAR)));
-	}
-	if (song.has_field("BPM")) {
-			m_bpms.push_back(BPM(0, 0, song.at("BPM").as_number().to_double()));
+	// Placeholder tracks, so that the song type is known without parsing the notes
+	for (unsigned i = 0; i < r.vocalTracks; i++) {
+		std::string track = "DummyTrack" + std::to_string(i);
+		insertVocalTrack(track, VocalTrack(track));
 	}
+	if (r.keyboard) instrumentTracks.insert(make_pair(TrackName::KEYBOARD, InstrumentTrack(TrackName::KEYBOARD)));
+	if (r.drums) instrumentTracks.insert(make_pair(TrackName::DRUMS, InstrumentTrack(TrackName::DRUMS)));
+	if (r.danceTracks) danceTracks.insert(std::make_pair("dance-single", DanceDifficultyMap()));
+	if (r.guitarTracks) instrumentTracks.insert(std::make_pair(TrackName::GUITAR, InstrumentTrack(TrackName::GUITAR)));
+	if (r.bpm > 0.0) m_bpms.push_back(BPM(0, 0, r.bpm));
 	collateUpdate();
 }
-#endif
+
+cache::SongRecord Song::cacheRecord(cache::SongCacheWriter& cache) const {
+	auto musicFile = [this](std::string const& track) {
+		auto it = music.find(track);
+		return it == music.end() ? std::string() : it->second.string();
+	};
+	cache::SongRecord r = {};
+	r.path = cache.str(path.string());
+	r.filename = cache.str(filename.string());
+	r.title = cache.str(title);
+	r.artist = cache.str(artist);
+	r.edition = cache.str(edition);
+	r.language = cache.str(language);
+	r.creator = cache.str(creator);
+	r.genre = cache.str(genre);
+	r.cover = cache.str(cover.string());
+	r.background = cache.str(background.string());
+	r.music = cache.str(musicFile(TrackName::BGMUSIC));
+	r.vocals = cache.str(musicFile("vocals"));
+	r.video = cache.str(video.string());
+	r.videoGap = videoGap;
+	r.start = start;
+	r.previewStart = preview_start;
+	r.duration = m_duration;
+	r.bpm = m_bpms.empty() ? 0.0 : 15.0 / m_bpms.front().step;
+	r.fileTime = fileTime;
+	r.fileSize = fileSize;
+	r.vocalTracks = vocalTracks.size();
+	r.danceTracks = danceTracks.size();
+	r.guitarTracks = instrumentTracks.size() - hasDrums() - hasKeyboard();
+	r.keyboard = hasKeyboard();
+	r.drums = hasDrums();
+	return r;
+}
 
 Song::Song(fs::path const& path, fs::path const& filename):
   dummyVocal(TrackName::LEAD_VOCAL), path(path), filename(filename), randomIdx(rand())
@@ -85,10 +107,32 @@ void Song::dropNotes() {
 	loadStatus = LoadStatus::HEADER;
 }
 
+namespace {
+	std::mutex sortKeyMutex;  ///< Guards Song::m_sortKeys and the collate strings, as songs are shared by the UI and the webserver
+}
+
+std::string Song::sortKey(SortField field, bool caseSensitive) const {
+	std::lock_guard<std::mutex> l(sortKeyMutex);
+	std::string& key = m_sortKeys[caseSensitive][unsigned(field)];
+	if (key.empty()) {
+		switch (field) {
+			case SortField::TITLE: key = UnicodeUtil::sortKey(collateByTitle, caseSensitive); break;
+			case SortField::ARTIST: key = UnicodeUtil::sortKey(collateByArtist, caseSensitive); break;
+			case SortField::EDITION: key = UnicodeUtil::sortKey(edition, caseSensitive); break;
+			case SortField::GENRE: key = UnicodeUtil::sortKey(genre, caseSensitive); break;
+			case SortField::LANGUAGE: key = UnicodeUtil::sortKey(language, caseSensitive); break;
+		}
+	}
+	return key;  // A copy, as collateUpdate may clear the cached key
+}
+
 void Song::collateUpdate() {
+	m_searchText = UnicodeUtil::searchFold(strFull());
 	songMetadata collateInfo {{"artist", artist}, {"title", title}};
 	UnicodeUtil::collate(collateInfo);	
 	
+	std::lock_guard<std::mutex> l(sortKeyMutex);
+	for (auto& keys: m_sortKeys) for (auto& key: keys) key.clear();
 	collateByTitle = collateInfo["title"] + "__" + collateInfo["artist"] + "__" + filename.string();
 	collateByTitleOnly = collateInfo["title"];
 	
@@ -196,7 +240,7 @@ double Song::getDurationSeconds() {
 std::string Song::str() const { return title + "  by  " + artist; }
 
 std::string Song::strFull() const {
-	return title + "\n" + artist + "\n" + genre + "\n" + edition + "\n" + path.string();
+	return songfilter::join({{ title, artist, genre, edition, path.string() }});
 }
 
 std::vector<std::string> Song::getVocalTrackNames() const {
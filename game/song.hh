@@ -5,14 +5,17 @@
 #include "notes.hh"
 #include "util.hh"
 
-#ifdef USE_WEBSERVER
-#include <cpprest/json.h>
-#endif
-
+#include <array>
+#include <cstdint>
 #include <stdexcept>
 #include <string>
 
 class SongParser;
+namespace cache {
+	class SongCacheFile;
+	class SongCacheWriter;
+	struct SongRecord;
+}
 
 namespace TrackName {
 	const std::string BGMUSIC = "background";
@@ -75,6 +78,8 @@ public:
 	double start = 0.0; ///< start of song
 	double preview_start = getNaN(); ///< starting time for the preview
 	double m_duration = 0.0;
+	std::int64_t fileTime = 0;  ///< Modification time of the song file when it was parsed (for detecting changes)
+	std::uintmax_t fileSize = 0;  ///< Size of the song file when it was parsed
 	using Stops = std::vector<std::pair<double,double> >;
 	Stops stops; ///< related to dance
 	using Beats = std::vector<double>;
@@ -88,11 +93,11 @@ public:
 	};
 	std::vector<SongSection> songsections; ///< vector of song sections
 	int randomIdx = 0; ///< sorting index used for random order
+	unsigned id = 0;  ///< Identifies the song file for the rest of the run (assigned by Songs, 0 = none)
 
 	// Functions only below this line
-#ifdef USE_WEBSERVER
-	Song(web::json::value const& song);  ///< Load song from cache.
-#endif
+	Song(cache::SongCacheFile const& cache, cache::SongRecord const& record);  ///< Load song headers from cache
+	cache::SongRecord cacheRecord(cache::SongCacheWriter& cache) const;  ///< Song headers for the cache (strings go to cache)
 	Song(fs::path const& path, fs::path const& filename);  ///< Load song from specified path and filename
 	void reload(bool errorIgnore = true);  ///< Reset and reload the entire song from file
 	void loadNotes(bool errorIgnore = true);  ///< Load note data (called when entering singing screen, headers preloaded).
@@ -117,8 +122,17 @@ public:
 	bool hasControllers() const { return !danceTracks.empty() || !instrumentTracks.empty(); }
 	bool getNextSection(double pos, SongSection &section);
 	bool getPrevSection(double pos, SongSection &section);
+	/// Fields that are sorted with collation
+	enum class SortField { TITLE, ARTIST, EDITION, GENRE, LANGUAGE };
+	/// Collation sort key of a field, case sensitive (tertiary strength) or not (computed on first use and kept)
+	std::string sortKey(SortField field, bool caseSensitive) const;
+	/// strFull() case folded and without accents for searching, see UnicodeUtil::searchFold
+	std::string const& searchText() const { return m_searchText; }
 private:
-	void collateUpdate();   ///< Rebuild collate variables (used for sorting) from other strings
+	void collateUpdate();   ///< Rebuild collate variables (used for sorting) and search text from other strings
+	static const unsigned SORT_FIELDS = 5;
+	mutable std::array<std::array<std::string, SORT_FIELDS>, 2> m_sortKeys;  ///< By case sensitivity and field, empty until computed (guarded by a mutex in song.cc)
+	std::string m_searchText;  ///< Computed by collateUpdate, so it is complete before the song is shared
 };
 
 /// Thrown by SongParser when there is an error
@@ -0,0 +1,71 @@
+#include "songcache.hh"
+
+#include <boost/filesystem.hpp>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+namespace cache {
+	namespace {
+		const char MAGIC[8] = { 'P', 'E', 'R', 'F', 'S', 'N', 'G', '\0' };
+		const std::uint32_t VERSION = 1;
+
+		struct Header {
+			char magic[8];
+			std::uint32_t version;
+			std::uint32_t recordSize;  ///< sizeof(SongRecord), guards against layout changes
+			std::uint64_t count;  ///< Number of records
+			std::uint64_t stringsSize;  ///< Size of the string table that follows the records
+		};
+		static_assert(sizeof(Header) == 32, "Song cache header must be 32 bytes");
+		static_assert(sizeof(SongRecord) % 8 == 0, "Song cache records must keep 8 byte alignment");
+	}
+
+	SongCacheFile::SongCacheFile(fs::path const& file) {
+		if (!fs::is_regular_file(file) || fs::file_size(file) < sizeof(Header)) throw std::runtime_error("No cache file " + file.string());
+		m_map.open(file.string());
+		Header h;
+		std::memcpy(&h, m_map.data(), sizeof(h));
+		if (std::memcmp(h.magic, MAGIC, sizeof(MAGIC)) != 0 || h.version != VERSION || h.recordSize != sizeof(SongRecord)) {
+			throw std::runtime_error("Incompatible cache file " + file.string());
+		}
+		if (m_map.size() != sizeof(Header) + h.count * sizeof(SongRecord) + h.stringsSize) throw std::runtime_error("Damaged cache file " + file.string());
+		m_records = reinterpret_cast<SongRecord const*>(m_map.data() + sizeof(Header));
+		m_count = h.count;
+		m_strings = m_map.data() + sizeof(Header) + h.count * sizeof(SongRecord);
+		m_stringsSize = h.stringsSize;
+	}
+
+	std::string SongCacheFile::str(StringRef ref) const {
+		if (std::uint64_t(ref.offset) + ref.size > m_stringsSize) throw std::runtime_error("Damaged string table in song cache");
+		return std::string(m_strings + ref.offset, ref.size);
+	}
+
+	StringRef SongCacheWriter::str(std::string const& s) {
+		auto it = m_index.find(s);
+		if (it != m_index.end()) return it->second;
+		StringRef ref = { std::uint32_t(m_strings.size()), std::uint32_t(s.size()) };
+		m_strings += s;
+		m_index.emplace(s, ref);
+		return ref;
+	}
+
+	void SongCacheWriter::save(fs::path const& file) const {
+		Header h = {};
+		std::memcpy(h.magic, MAGIC, sizeof(MAGIC));
+		h.version = VERSION;
+		h.recordSize = sizeof(SongRecord);
+		h.count = m_records.size();
+		h.stringsSize = m_strings.size();
+		fs::path tmp = file;
+		tmp += ".tmp";
+		{
+			std::ofstream f(tmp.string(), std::ios::binary | std::ios::trunc);
+			f.write(reinterpret_cast<char const*>(&h), sizeof(h));
+			f.write(reinterpret_cast<char const*>(m_records.data()), m_records.size() * sizeof(SongRecord));
+			f.write(m_strings.data(), m_strings.size());
+			if (!f) throw std::runtime_error("Could not write " + tmp.string());
+		}
+		fs::rename(tmp, file);
+	}
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "fs.hh"
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace cache {
+
+	/// Location of a string in the string table of the song cache
+	struct StringRef {
+		std::uint32_t offset;
+		std::uint32_t size;
+	};
+
+	/// Fixed-size record of song headers in the song cache (native byte order)
+	struct SongRecord {
+		StringRef path, filename, title, artist, edition, language, creator, genre, cover, background, music, vocals, video;
+		double videoGap, start, previewStart, duration;
+		double bpm;  ///< 0 if unknown
+		std::int64_t fileTime;
+		std::uint64_t fileSize;
+		std::uint32_t vocalTracks, danceTracks, guitarTracks;
+		std::uint8_t keyboard, drums;
+		std::uint8_t reserved[2];
+	};
+
+	/**
+	* Binary song metadata cache: a header, an array of SongRecords and a string table.
+	* The file is memory-mapped and records are used in place, so loading costs little more than creating the Songs.
+	**/
+	class SongCacheFile {
+	  public:
+		/// Map and validate the cache file, throws std::runtime_error if it is missing, outdated or damaged
+		explicit SongCacheFile(fs::path const& file);
+		std::size_t size() const { return m_count; }
+		SongRecord const& operator[](std::size_t i) const { return m_records[i]; }
+		/// The string referred to by a record
+		std::string str(StringRef ref) const;
+	  private:
+		boost::iostreams::mapped_file_source m_map;
+		SongRecord const* m_records = nullptr;
+		std::size_t m_count = 0;
+		char const* m_strings = nullptr;
+		std::uint64_t m_stringsSize = 0;
+	};
+
+	/// Builds a song cache file: records, with their strings collected into one (deduplicated) string table
+	class SongCacheWriter {
+	  public:
+		/// Add a string to the string table
+		StringRef str(std::string const& s);
+		void add(SongRecord const& record) { m_records.push_back(record); }
+		/// Write the cache file (replacing the old file only once the new one is complete)
+		void save(fs::path const& file) const;
+	  private:
+		std::vector<SongRecord> m_records;
+		std::string m_strings;
+		std::unordered_map<std::string, StringRef> m_index;
+	};
+}
+
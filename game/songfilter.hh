@@ -0,0 +1,50 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <string>
+
+/// Search text of a song: title, artist, genre, edition and path, one per line (see Song::strFull)
+namespace songfilter {
+	/// Lines of the search text, in order
+	enum Line { TITLE, ARTIST, GENRE, EDITION, PATH, LINES };
+
+	/// Join fields (indexed by Line) into a search text
+	inline std::string join(std::array<std::string, LINES> const& fields) {
+		std::string text;
+		for (unsigned i = 0; i < LINES; ++i) text += (i ? "\n" : "") + fields[i];
+		return text;
+	}
+
+	/**
+	* Filters of a web API search. All strings must be folded like the search text (see UnicodeUtil::searchFold);
+	* empty filters match anything.
+	**/
+	struct Filter {
+		std::string query;  ///< Anywhere in the search text
+		std::array<std::string, PATH> fields;  ///< Within their own line of the search text (indexed by Line)
+		std::string language;  ///< Within the (folded) language
+
+		bool matches(std::string const& text, std::string const& foldedLanguage) const {
+			if (!query.empty() && text.find(query) == std::string::npos) return false;
+			for (std::size_t i = 0, begin = 0; i < fields.size(); ++i) {
+				std::size_t end = text.find('\n', begin);
+				if (!fields[i].empty()) {
+					std::size_t pos = text.find(fields[i], begin);
+					if (pos == std::string::npos || pos + fields[i].size() > end) return false;
+				}
+				begin = (end == std::string::npos ? text.size() + 1 : end + 1);  // Past the end if there are no more lines
+			}
+			return language.empty() || foldedLanguage.find(language) != std::string::npos;
+		}
+	};
+
+	/// A page of search results: offset and count clamped to total results (negative limit means all)
+	struct Page {
+		std::size_t offset, count;
+		Page(std::size_t total, int offset, int limit = -1):
+		  offset(std::min<std::size_t>(std::max(0, offset), total)),
+		  count(limit < 0 ? total - this->offset : std::min<std::size_t>(limit, total - this->offset))
+		{}
+	};
+}
@@ -46,6 +46,8 @@ int SongItems::addSongItem(std::string const& artist, std::string const& title,
 		si.id = assign_id_internal();
 		m_songs.insert(si); // now do the insert with the fresh id
 	}
+	auto idx = m_index.emplace(key(si.artist, si.title), si.id);
+	if (!idx.second && si.id < idx.first->second) idx.first->second = si.id;
 	return si.id;
 }
 
@@ -72,17 +74,12 @@ void SongItems::addSong(std::shared_ptr<Song> song) {
 }
 
 int SongItems::lookup(std::shared_ptr<Song> song) const {
-	for (auto const& s: m_songs) {
-		if (song->collateByArtistOnly == s.artist && song->collateByTitleOnly == s.title) return s.id;
-	}
-	return -1;
+	return lookup(*song);
 }
 
 int SongItems::lookup(Song& song) const {
-	for (auto const& s: m_songs) {
-		if (song.collateByArtistOnly == s.artist && song.collateByTitleOnly == s.title) return s.id;
-	}
-	return -1;
+	auto it = m_index.find(key(song.collateByArtistOnly, song.collateByTitleOnly));
+	return it == m_index.end() ? -1 : it->second;
 }
 
 std::string SongItems::lookup(int id) const {
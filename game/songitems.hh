@@ -6,6 +6,7 @@
 
 #include <memory>
 #include <set>
+#include <unordered_map>
 #include <vector>
 #include <string>
 #include <stdexcept>
@@ -48,12 +49,10 @@ struct SongItem
   This class was introduced to hide the implementation
   detail which data structure is used for the list away.
 
-  Currently a std::set is used, which makes both addSongItem()
-  and addSong() slow. The only advantage is that the id is
-  unique and it is cheap to get a new unique id.
-
-  When one of the methods is to slow, it can be optimized
-  easily. */
+  The items are kept in a std::set ordered by id, so the id is
+  unique and it is cheap to get a new unique id. A hash index
+  on the collated artist and title makes looking up the id of
+  a song cheap (it is done for every song shown). */
 class SongItems {
 public:
 	void load(xmlpp::NodeSet const& n);
@@ -92,7 +91,9 @@ public:
 
 private:
 	int assign_id_internal() const;
+	static std::string key(std::string const& artist, std::string const& title) { return artist + '\0' + title; }
 
 	typedef std::set<SongItem> songs_t;
 	songs_t m_songs;
+	std::unordered_map<std::string, int> m_index;  ///< Lowest id by key() of collated artist and title
 };
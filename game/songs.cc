@@ -3,26 +3,26 @@
 #include "configuration.hh"
 #include "fs.hh"
 #include "song.hh"
+#include "songcache.hh"
 #include "database.hh"
 #include "i18n.hh"
 #include "profiler.hh"
 #include "libxml++-impl.hh"
 #include "unicode.hh"
 #include "platform.hh"
+#include "threadpool.hh"
 
 #include <algorithm>
 #include <cstdlib>
 #include <iostream>
 #include "regex.hh"
 #include <stdexcept>
+#include <unordered_map>
+#include <unordered_set>
 
 #include <boost/filesystem.hpp>
 #include <boost/format.hpp>
-#include <unicode/stsearch.h>
 
-#ifdef USE_WEBSERVER
-#include <cpprest/json.h>
-#endif
 
 Songs::Songs(Database & database, std::string const& songlist): m_songlist(songlist), m_database(database), m_order(config["songs/sort-order"].i()) {
 	m_updateTimer.setTarget(getInf()); // Using this as a simple timer counting seconds
@@ -46,11 +46,35 @@ void Songs::reload() {
 	m_thread = std::make_unique<std::thread>([this]{ reload_internal(); });
 }
 
+namespace {
+	/// Songs with equal keys are different files of the same song (e.g. song.txt and song.ini)
+	std::string stemKey(Song const& s) { return s.filename.stem().string() + '\n' + s.title + '\n' + s.artist; }
+}
+
+/// State shared by the workers of a library scan
+struct Songs::Scan {
+	ThreadPool pool{ ThreadPool::defaultSize(8) };
+	std::unordered_map<std::string, std::shared_ptr<Song>> cached;  ///< Songs from the cache by filename (read-only during the scan)
+	std::unordered_map<std::string, fs::path> stems;  ///< Filenames by stemKey (protected by Songs::m_mutex)
+	std::unordered_set<std::string> seen;  ///< Song files found (protected by Songs::m_mutex)
+	std::vector<fs::path> incomplete;  ///< Folders that could not be fully listed (protected by Songs::m_mutex)
+	/// Whether file may exist even though it was not seen
+	bool unlisted(fs::path const& file) const {
+		return std::any_of(incomplete.begin(), incomplete.end(), [&file](fs::path const& dir) {
+			return std::mismatch(dir.begin(), dir.end(), file.begin(), file.end()).first == dir.end();
+		});
+	}
+	std::atomic<unsigned> parsed{ 0 };
+	std::atomic<unsigned> unchanged{ 0 };
+};
+
 void Songs::reload_internal() {
 	{
 		std::lock_guard<std::mutex> l(m_mutex);
 		m_songs.clear();
+		m_search.clear();
 		m_dirty = true;
+		++m_generation;
 	}
 	LoadCache();
 	std::clog << "songs/notice: Done loading the cache. You now have " << m_songs.size() << " songs in your list." << std::endl;
@@ -60,18 +84,42 @@ void Songs::reload_internal() {
 	Paths paths = getPathsConfig("paths/songs");
 	paths.insert(paths.begin(), systemSongs.begin(), systemSongs.end());
 
+	Scan scan;
+	for (auto const& song: m_songs) {
+		scan.cached.emplace(song->filename.string(), song);
+		scan.stems.emplace(stemKey(*song), song->filename);
+	}
 	for (auto it = paths.begin(); m_loading && it != paths.end(); ++it) { //loop through stored directories from config
 		try {
 			if (!fs::is_directory(*it)) { std::clog << "songs/info: >>> Not scanning: " << *it << " (no such directory)\n"; continue; }
 			std::clog << "songs/info: >>> Scanning " << *it << std::endl;
-			size_t count = m_songs.size();
-			reload_internal(*it);
-			size_t diff = m_songs.size() - count;
+			unsigned count = scan.parsed;
+			reload_internal(scan, *it);
+			scan.pool.wait();  // Subfolders are scanned by the workers
+			unsigned diff = scan.parsed - count;
 			if (diff > 0 && m_loading) std::clog << "songs/info: " << diff << " songs loaded\n";
 		} catch (std::exception& e) {
 			std::clog << "songs/error: >>> Error scanning " << *it << ": " << e.what() << '\n';
+			std::lock_guard<std::mutex> l(m_mutex);
+			scan.incomplete.push_back(*it);
 		}
 	}
+	std::clog << "songs/info: " << scan.parsed << " songs parsed, " << scan.unchanged << " unchanged since cached" << std::endl;
+	if (m_loading) {
+		// Forget cached songs whose files no longer exist
+		std::lock_guard<std::mutex> l(m_mutex);
+		auto removed = std::remove_if(m_songs.begin(), m_songs.end(), [&scan](std::shared_ptr<Song> const& s) {
+			return scan.seen.find(s->filename.string()) == scan.seen.end() && !scan.unlisted(s->filename);
+		});
+		if (removed != m_songs.end()) {
+			std::clog << "songs/info: " << (m_songs.end() - removed) << " cached songs no longer found" << std::endl;
+			for (auto it = removed; it != m_songs.end(); ++it) m_search.remove(it->get());
+			m_songs.erase(removed, m_songs.end());
+			m_dirty = true;
+			++m_generation;
+		}
+		publish_internal();
+	}
 	prof("total");
 	if (m_loading) dumpSongs_internal(); // Dump the songlist to file (if requested)
 	std::clog << std::flush;
@@ -82,206 +130,111 @@ void Songs::reload_internal() {
 	doneLoading = true;
 }
 
-#ifdef USE_WEBSERVER
-void Songs::LoadCache() {
-	fs::path songsMetaFile = getCacheDir() / "Songs-Metadata.json";
-	std::ifstream file(songsMetaFile.string());
-	web::json::value jsonRoot;
-    if (file)
-    {
-    	try {
-	        std::stringstream buffer;
-	        buffer << file.rdbuf();
-	        file.close();
-	        jsonRoot = web::json::value::parse(buffer);
-    	} catch(std::exception const& e) {
-			std::clog << "songs/error: " << e.what() << std::endl;
-			return;
-    	}
-    } else {
-    	std::clog << "songs/info: Could not open songs meta cache file " << songsMetaFile.string() << std::endl;
-    	return;
-    }
+namespace {
+	fs::path songCacheFile() { return getCacheDir() / "songs.cache"; }
+}
 
+void Songs::LoadCache() {
 	Paths systemSongs = getPathsConfig("paths/system-songs");
-	Paths localPaths = getPathsConfig("paths/songs");
-	localPaths.insert(localPaths.begin(), systemSongs.begin(), systemSongs.end());
-
-	std::vector<std::string> userSongs;
-	for(const fs::path& userSong : localPaths) {
-		userSongs.push_back(userSong.string());
+	Paths roots = getPathsConfig("paths/songs");
+	roots.insert(roots.begin(), systemSongs.begin(), systemSongs.end());
+	SongVector songs;
+	try {
+		cache::SongCacheFile cache(songCacheFile());
+		songs.reserve(cache.size());
+		for (std::size_t i = 0; i < cache.size(); ++i) {
+			cache::SongRecord const& record = cache[i];
+			// Only songs under the currently configured paths (deleted files are dropped by the scan)
+			std::string file = cache.str(record.filename);
+			bool configured = std::any_of(roots.begin(), roots.end(), [&file](fs::path const& root) {
+				return file.compare(0, root.string().size(), root.string()) == 0;
+			});
+			if (configured) songs.push_back(std::make_shared<Song>(cache, record));
+		}
+	} catch (std::exception const& e) {
+		std::clog << "songs/info: Song cache not used: " << e.what() << std::endl;
+		return;
 	}
-
-    for(auto const& song : jsonRoot.as_array()) {
-    	struct stat buffer;
-    	auto songPath = song.at("TxtFile").as_string();
-    	auto isSongPathInConfiguredPaths = std::find_if(
-                                                        userSongs.begin(), 
-                                                        userSongs.end(), 
-														[songPath](const std::string& userSongItem) { 
-															return songPath.find(userSongItem) != std::string::npos;
-														 }) != userSongs.end();
-    	if(_STAT(songPath.c_str(), &buffer) == 0 && isSongPathInConfiguredPaths) {
-    		std::shared_ptr<Song> realSong(new Song(song));
-    		m_songs.push_back(realSong);
-    	}  	
-    }
+	std::lock_guard<std::mutex> l(m_mutex);
+	for (auto const& song: songs) assignId_internal(*song);
+	m_songs.insert(m_songs.end(), songs.begin(), songs.end());
+	for (auto const& song: songs) m_search.add(song);
+	m_dirty = true;
+	++m_generation;
+	publish_internal();
 }
 
 void Songs::CacheSonglist() {
-    web::json::value jsonRoot = web::json::value::array();
-    auto i = 0;
-	for (auto const& song : m_songs)
-    {  
-        web::json::value songObject = web::json::value::object();
-        if(!song->path.string().empty()) {
-        	songObject["TxtFileFolder"] = web::json::value::string(song->path.string());
-        }
-        if(!song->filename.string().empty()) {
-        	songObject["TxtFile"] = web::json::value::string(song->filename.string());
-        }
-        if(!song->title.empty()) {
-        	songObject["Title"] = web::json::value::string(song->title);
-    	}
-		if(!song->artist.empty()) {
-        	songObject["Artist"] = web::json::value::string(song->artist);
-    	}
-        if(!song->edition.empty()) {
-        	songObject["Edition"] = web::json::value::string(song->edition);
-    	}
-    	if(!song->language.empty()) {
-        	songObject["Language"] = web::json::value::string(song->language);
-        }
-        if(!song->creator.empty()) {
-        	songObject["Creator"] = web::json::value::string(song->creator);
-    	}
-    	if(!song->genre.empty()) {
-        	songObject["Genre"] = web::json::value::string(song->genre);
-    	}
-    	if(!song->cover.string().empty()) {
-        	songObject["Cover"] = web::json::value::string(song->cover.string());
-    	}
-    	if(!song->background.string().empty()) {
-	        songObject["Background"] = web::json::value::string(song->background.string());
-	    }
-    	if(!song->music["background"].string().empty()) {
-	        songObject["SongFile"] = web::json::value::string(song->music["background"].string());
-	    }
-    	if(!song->video.string().empty()) {
-	        songObject["VideoFile"] = web::json::value::string(song->video.string());
-	    }
-    	if(!std::isnan(song->start)) {
-	        songObject["Start"] = web::json::value(song->start);
-	    }
-    	if(!std::isnan(song->videoGap)) {
-	        songObject["VideoGap"] = web::json::value(song->videoGap);
-	    }
-    	if(!std::isnan(song->preview_start)) {
-	        songObject["PreviewStart"] = web::json::value::number(song->preview_start);
-	    }
-    	if(!song->music["vocals"].string().empty()) {
-	        songObject["Vocals"] = web::json::value::string(song->music["vocals"].string());
-	    }
-    	double duration = song->getDurationSeconds();
-    	if(!std::isnan(duration)) {
-	    	songObject["Duration"] = web::json::value::number(duration);
-	    }
-	    if (!song->m_bpms.empty()) {
-			songObject["BPM"] = web::json::value::number(15 / song->m_bpms.front().step);
-		}
-			
-		// Cache songtype also.
-		if(song->hasVocals()) {
-			uint32_t vocals = song->vocalTracks.size();
-        	songObject["VocalTracks"] = web::json::value::number(vocals);
-    	}
-		if(song->hasKeyboard()) {
-        	songObject["KeyboardTracks"] = web::json::value::number(1);
-    	}
-		if(song->hasDrums()) {
-        	songObject["DrumTracks"] = web::json::value::number(1);
-    	}
-		if(song->hasDance()) {
-			uint32_t dance = song->danceTracks.size();
-        	songObject["DanceTracks"] = web::json::value::number(dance);
-    	}
-		if(song->hasGuitars()) {
-			uint32_t guitars = song->instrumentTracks.size() - song->hasDrums() - song->hasKeyboard();
-        	songObject["GuitarTracks"] = web::json::value::number(guitars);
-    	}
-	    if(songObject != web::json::value::object()) {
-        	jsonRoot[i] = songObject;
-        	i++;
-    	}
-	}
-
-	fs::path cacheDir = getCacheDir() / "Songs-Metadata.json";
-
 	try {
-		std::stringstream stream;
-		jsonRoot.serialize(stream);
-		std::ofstream outFile(cacheDir.string());
-    	outFile << stream.rdbuf();
-    	outFile.close();
+		cache::SongCacheWriter cache;
+		for (auto const& song: m_songs) cache.add(song->cacheRecord(cache));
+		cache.save(songCacheFile());
 	} catch (std::exception const& e) {
-		std::clog << "songs/error: Could not save " + cacheDir.string() + ": " + e.what() << std::endl;
-		return;
+		std::clog << "songs/error: Could not save " + songCacheFile().string() + ": " + e.what() << std::endl;
 	}
 }
-#else 
-void Songs::LoadCache() { }
-void Songs::CacheSonglist() { }
-#endif
 
-void Songs::reload_internal(fs::path const& parent) {
+void Songs::reload_internal(Scan& scan, fs::path const& parent) {
 	if (std::distance(parent.begin(), parent.end()) > 20) { std::clog << "songs/info: >>> Not scanning: " << parent.string() << " (maximum depth reached, possibly due to cyclic symlinks)\n"; return; }
 	try {
-		regex expression(R"((\.txt|^song\.ini|^notes\.xml|\.sm)$)", regex_constants::icase);
+		static const regex expression(R"((\.txt|^song\.ini|^notes\.xml|\.sm)$)", regex_constants::icase);
 		for (fs::directory_iterator dirIt(parent), dirEnd; m_loading && dirIt != dirEnd; ++dirIt) { //loop through files
 			fs::path p = dirIt->path();
-			if (fs::is_directory(p)) { reload_internal(p); continue; } //if the file is a folder redo this function with this folder as path
+			if (fs::is_directory(p)) { scan.pool.run([this, &scan, p]{ reload_internal(scan, p); }); continue; } //scan subfolders in parallel
 			if (!regex_search(p.filename().string(), expression)) continue; //if the folder does not contain any of the requested files, ignore it
 			try { //found song file, make a new song with it.
-				auto it = std::find_if(m_songs.begin(), m_songs.end(), [p](std::shared_ptr<Song> n) {
-					return n->filename == p;
-				});
-				auto alreadyInCache = it != m_songs.end();
-
-				if(alreadyInCache) { 
-					continue;
-				}
-
-				std::clog << "songs/notice: Found song which was not in the cache: " << p.string() << std::endl;
-
-				std::shared_ptr<Song>s(new Song(p.parent_path(), p));
-				std::lock_guard<std::mutex> l(m_mutex);
-				int AdditionalFileIndex = -1;
-				for(unsigned int i = 0; i< m_songs.size(); i++) {
-					if(s->filename.extension() != m_songs[i]->filename.extension() && s->filename.stem() == m_songs[i]->filename.stem() &&
-							s->title == m_songs[i]->title && s->artist == m_songs[i]->artist) {
-						std::clog << "songs/info: >>> Found additional song file: " << s->filename << " for: " << m_songs[i]->filename << std::endl;
-						AdditionalFileIndex = i;
-					}
-				}				
-
-				if(AdditionalFileIndex > 0) { //TODO: add it to existing song
-					std::clog << "songs/info: >>> not yet implemented " << std::endl;
-					s->getDurationSeconds();
-					m_songs.push_back(s); // will make it appear double!!
-				} else {
-					s->getDurationSeconds();
-					m_songs.push_back(s); //put it in the database
-				}
-				m_dirty = true;
+				loadSong(scan, p);
 			} catch (SongParserException& e) {
 				std::clog << e;
+			} catch (std::exception const& e) {
+				std::clog << "songs/error: Error loading " << p << ": " << e.what() << '\n';
 			}
 		}
 	} catch (std::exception const& e) {
 		std::clog << "songs/error: Error accessing " << parent << ": " << e.what() << '\n';
+		std::lock_guard<std::mutex> l(m_mutex);
+		scan.incomplete.push_back(parent);  // Keep the cached songs that could not be reached
 	}
 }
 
+void Songs::loadSong(Scan& scan, fs::path const& p) {
+	{
+		std::lock_guard<std::mutex> l(m_mutex);
+		if (!scan.seen.insert(p.string()).second) return;  // Already found via another configured path
+	}
+	std::int64_t fileTime = fs::last_write_time(p);
+	std::uintmax_t fileSize = fs::file_size(p);
+	auto cached = scan.cached.find(p.string());
+	if (cached != scan.cached.end()) {
+		Song const& c = *cached->second;
+		if (c.fileTime == fileTime && c.fileSize == fileSize) { ++scan.unchanged; return; }
+		std::clog << "songs/notice: Found song which was modified after caching: " << p.string() << std::endl;
+	} else {
+		std::clog << "songs/notice: Found song which was not in the cache: " << p.string() << std::endl;
+	}
+	auto s = std::make_shared<Song>(p.parent_path(), p);
+	s->fileTime = fileTime;
+	s->fileSize = fileSize;
+	s->getDurationSeconds();
+	++scan.parsed;
+	std::lock_guard<std::mutex> l(m_mutex);
+	assignId_internal(*s);
+	auto stem = scan.stems.emplace(stemKey(*s), s->filename);
+	if (!stem.second && stem.first->second.extension() != s->filename.extension()) {
+		std::clog << "songs/info: >>> Found additional song file: " << s->filename << " for: " << stem.first->second << std::endl;
+		std::clog << "songs/info: >>> not yet implemented " << std::endl;  //TODO: add it to existing song
+	}
+	auto outdated = cached != scan.cached.end() ? std::find(m_songs.begin(), m_songs.end(), cached->second) : m_songs.end();
+	if (outdated != m_songs.end()) {
+		*outdated = s;  // Replace the outdated one
+		m_search.remove(cached->second.get());
+	}
+	else m_songs.push_back(s); //put it in the database (additional files appear double)
+	m_search.add(s);
+	m_dirty = true;
+	++m_generation;
+}
+
 // Make std::find work with shared_ptrs and regular pointers
 static bool operator==(std::shared_ptr<Song> const& a, Song const* b) { return a.get() == b; }
 
@@ -325,34 +278,31 @@ void Songs::filter_internal() {
 	m_updateTimer.setValue(0.0);
 	std::lock_guard<std::mutex> l(m_mutex);
 	m_dirty = false;
+	publish_internal();  // Newly loaded songs
 	RestoreSel restore(*this);
 	try {
 		SongVector filtered;
 		// if filter text is blank and no type filter is set, just display all songs.
 		if (m_filter == std::string() && m_type == 0) filtered = m_songs;
 		else {
-			std::string charset = UnicodeUtil::getCharset(m_filter);
-			icu::UnicodeString filter = ((charset == "UTF-8") ? icu::UnicodeString::fromUTF8(m_filter) : icu::UnicodeString(m_filter.c_str(), charset.c_str()));
-			UErrorCode icuError = U_ZERO_ERROR;
-			
-			std::copy_if (m_songs.begin(), m_songs.end(), std::back_inserter(filtered), [&](std::shared_ptr<Song> it){
-			// Filter by type first.	
-				if (m_type == 1 && !(*it).hasDance()) return false;
-				if (m_type == 2 && !(*it).hasVocals()) return false;
-				if (m_type == 3 && !(*it).hasDuet()) return false;
-				if (m_type == 4 && !(*it).hasGuitars()) return false;
-				if (m_type == 5 && !(*it).hasDrums() && !(*it).hasKeyboard()) return false;
-				if (m_type == 6 && (!(*it).hasVocals() || !(*it).hasGuitars() || (!(*it).hasDrums() && !(*it).hasKeyboard()))) return false;
-				
-		  // If search is not empty, filter by search term.	
-				if (!m_filter.empty()) {
-					icu::StringSearch search = icu::StringSearch(filter, icu::UnicodeString::fromUTF8((*it).strFull()), &UnicodeUtil::m_dummyCollator, nullptr, icuError);
-					return (search.first(icuError) != USEARCH_DONE);
-					}
-					
-		// If we still haven't returned, it must be a type match with an empty search string.			
-				return true;
-			});
+			// If search is not empty, filter by search term (the index only checks songs that may match)
+			if (m_filter.empty()) filtered = m_songs;
+			else {
+				std::string charset = UnicodeUtil::getCharset(m_filter);
+				std::string filter = m_filter;
+				if (charset != "UTF-8") icu::UnicodeString(m_filter.c_str(), charset.c_str()).toUTF8String(filter = std::string());
+				filtered = m_search.find(UnicodeUtil::searchFold(filter));
+			}
+			// Then by type
+			filtered.erase(std::remove_if(filtered.begin(), filtered.end(), [&](std::shared_ptr<Song> const& it){
+				if (m_type == 1 && !(*it).hasDance()) return true;
+				if (m_type == 2 && !(*it).hasVocals()) return true;
+				if (m_type == 3 && !(*it).hasDuet()) return true;
+				if (m_type == 4 && !(*it).hasGuitars()) return true;
+				if (m_type == 5 && !(*it).hasDrums() && !(*it).hasKeyboard()) return true;
+				if (m_type == 6 && (!(*it).hasVocals() || !(*it).hasGuitars() || (!(*it).hasDrums() && !(*it).hasKeyboard()))) return true;
+				return false;
+			}), filtered.end());
 		}
 		m_filtered.swap(filtered);
 	} catch (...) {
@@ -379,29 +329,15 @@ namespace {
 		}
 	};
 	
-	template<> class CmpByField<std::string> {
-		std::string Song::* m_field;
-	  public:
-		/** @param field a pointer to the field to use (pointer to member) **/
-		CmpByField(std::string Song::* field): m_field(field) {}
-		/// Compare left < right
-		bool operator()(Song const& left , Song const& right) {
-			icu::UnicodeString leftVal = icu::UnicodeString::fromUTF8(left.*m_field);
-			icu::UnicodeString rightVal = icu::UnicodeString::fromUTF8(right.*m_field);
-			UErrorCode sortError = U_ZERO_ERROR;
-			UCollationResult result = UnicodeUtil::m_sortCollator.compare(leftVal, rightVal, sortError);
-			if (U_SUCCESS(sortError)) {
-			return (result == UCOL_LESS);
-			}
-			else {
-			throw std::runtime_error("unicode/error: Sorting comparison error in CmpByField<std::string> ");
-			}
-		}
-		/// Compare *left < *right
-		bool operator()(std::shared_ptr<Song> const& left, std::shared_ptr<Song> const& right) {
-			return operator()(*left, *right);
-		}
-	};
+	/// Sort songs by collation sort keys (compared as bytes, so ICU is only involved in creating missing keys).
+	/// The keys are copied, as another thread may update the songs meanwhile.
+	template <typename It> void sortByKey(It begin, It end, Song::SortField field, bool caseSensitive) {
+		std::vector<std::pair<std::string, std::shared_ptr<Song>>> keyed;
+		keyed.reserve(end - begin);
+		for (It it = begin; it != end; ++it) keyed.emplace_back((*it)->sortKey(field, caseSensitive), std::move(*it));
+		std::sort(keyed.begin(), keyed.end(), [](auto const& left, auto const& right) { return left.first < right.first; });
+		for (auto& k: keyed) *begin++ = std::move(k.second);
+	}
 
 	/// A helper for easily constructing CmpByField objects
 	template <typename T> CmpByField<T> customComparator(T Song::*field) { return CmpByField<T>(field); }
@@ -462,23 +398,6 @@ void Songs::sortChange(int diff) {
 	if (m_order < 0) m_order += orders;
 	RestoreSel restore(*this);
 	config["songs/sort-order"].i() = m_order;
-	switch (m_order) {
-		case 1:
-		 [[fallthrough]];
-		case 2:
-		 [[fallthrough]];
-		case 3:
-		 [[fallthrough]];
-		case 4:
-		 [[fallthrough]];
-		case 6:
-			UErrorCode collatorError = U_ZERO_ERROR;
-			UnicodeUtil::m_sortCollator.setAttribute(UCOL_STRENGTH, (config["game/case-sorting"].b()) ? UCOL_TERTIARY : UCOL_SECONDARY, collatorError);
-			if (U_FAILURE(collatorError)) {
-				std::clog << "sorting/error: Unable to change collator strength." << std::endl;
-			}
-			break;		
-		}
 	sort_internal();
 	writeConfig(false);
 }
@@ -497,31 +416,55 @@ void Songs::sortSpecificChange(int sortOrder, bool descending) {
 }
 
 void Songs::sort_internal(bool descending) {
+	sortSongs(m_filtered, m_order, descending, config["game/case-sorting"].b());
+}
+
+void Songs::sortSongs(SongVector& songs, int order, bool descending, bool caseSensitive) {
 	if(descending) {
-		switch (m_order) {
-		  case 0: std::stable_sort(m_filtered.begin(), m_filtered.end(), customComparator(&Song::randomIdx)); break;
-		  case 1: std::sort(m_filtered.rbegin(), m_filtered.rend(), customComparator(&Song::collateByTitle)); break;
-		  case 2: std::sort(m_filtered.rbegin(), m_filtered.rend(), customComparator(&Song::collateByArtist)); break;
-		  case 3: std::sort(m_filtered.rbegin(), m_filtered.rend(), customComparator(&Song::edition)); break;
-		  case 4: std::sort(m_filtered.rbegin(), m_filtered.rend(), customComparator(&Song::genre)); break;
-		  case 5: std::sort(m_filtered.rbegin(), m_filtered.rend(), customComparator(&Song::path)); break;
-		  case 6: std::sort(m_filtered.rbegin(), m_filtered.rend(), customComparator(&Song::language)); break;
+		switch (order) {
+		  case 0: std::stable_sort(songs.begin(), songs.end(), customComparator(&Song::randomIdx)); break;
+		  case 1: sortByKey(songs.rbegin(), songs.rend(), Song::SortField::TITLE, caseSensitive); break;
+		  case 2: sortByKey(songs.rbegin(), songs.rend(), Song::SortField::ARTIST, caseSensitive); break;
+		  case 3: sortByKey(songs.rbegin(), songs.rend(), Song::SortField::EDITION, caseSensitive); break;
+		  case 4: sortByKey(songs.rbegin(), songs.rend(), Song::SortField::GENRE, caseSensitive); break;
+		  case 5: std::sort(songs.rbegin(), songs.rend(), customComparator(&Song::path)); break;
+		  case 6: sortByKey(songs.rbegin(), songs.rend(), Song::SortField::LANGUAGE, caseSensitive); break;
 		  default: throw std::logic_error("Internal error: unknown sort order in Songs::sortChange");
 		}
 	} else {
-		switch (m_order) {
-		  case 0: std::stable_sort(m_filtered.begin(), m_filtered.end(), customComparator(&Song::randomIdx)); break;
-		  case 1: std::sort(m_filtered.begin(), m_filtered.end(), customComparator(&Song::collateByTitle)); break;
-		  case 2: std::sort(m_filtered.begin(), m_filtered.end(), customComparator(&Song::collateByArtist)); break;
-		  case 3: std::sort(m_filtered.begin(), m_filtered.end(), customComparator(&Song::edition)); break;
-		  case 4: std::sort(m_filtered.begin(), m_filtered.end(), customComparator(&Song::genre)); break;
-		  case 5: std::sort(m_filtered.begin(), m_filtered.end(), customComparator(&Song::path)); break;
-		  case 6: std::sort(m_filtered.begin(), m_filtered.end(), customComparator(&Song::language)); break;
+		switch (order) {
+		  case 0: std::stable_sort(songs.begin(), songs.end(), customComparator(&Song::randomIdx)); break;
+		  case 1: sortByKey(songs.begin(), songs.end(), Song::SortField::TITLE, caseSensitive); break;
+		  case 2: sortByKey(songs.begin(), songs.end(), Song::SortField::ARTIST, caseSensitive); break;
+		  case 3: sortByKey(songs.begin(), songs.end(), Song::SortField::EDITION, caseSensitive); break;
+		  case 4: sortByKey(songs.begin(), songs.end(), Song::SortField::GENRE, caseSensitive); break;
+		  case 5: std::sort(songs.begin(), songs.end(), customComparator(&Song::path)); break;
+		  case 6: sortByKey(songs.begin(), songs.end(), Song::SortField::LANGUAGE, caseSensitive); break;
 		  default: throw std::logic_error("Internal error: unknown sort order in Songs::sortChange");
 		}
 	}
 }
 
+void Songs::assignId_internal(Song& song) {
+	auto it = m_ids.emplace(song.filename.string(), m_nextId);
+	if (it.second) ++m_nextId;
+	song.id = it.first->second;
+}
+
+void Songs::publish_internal() {
+	if (m_library->generation == m_generation) return;
+	auto library = std::make_shared<Library>();
+	library->generation = m_generation;
+	library->songs = m_songs;
+	library->byId.reserve(m_songs.size());
+	library->durations.reserve(m_songs.size());
+	for (auto const& song: m_songs) {
+		library->byId.emplace(song->id, song);
+		library->durations.emplace(song->id, song->m_duration);
+	}
+	std::atomic_store(&m_library, std::shared_ptr<Library const>(std::move(library)));
+}
+
 namespace {
 	void dumpCover(xmlpp::Element* song, Song const& s, size_t num) {
 		try {
@@ -558,7 +501,7 @@ namespace {
 void Songs::dumpSongs_internal() const {
 	if (m_songlist.empty()) return;
 	SongVector svec = m_songs;
-	std::sort(svec.begin(), svec.end(), customComparator(&Song::collateByArtist));
+	sortByKey(svec.begin(), svec.end(), Song::SortField::ARTIST, config["game/case-sorting"].b());
 	fs::path coverpath = fs::path(m_songlist) / "covers";
 	fs::create_directories(coverpath);
 	dumpXML(svec, m_songlist + "/songlist.xml");
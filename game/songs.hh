@@ -2,12 +2,15 @@
 
 #include "animvalue.hh"
 #include "fs.hh"
+#include "searchindex.hh"
 #include <atomic>
+#include <cstdint>
 #include <memory>
 #include <mutex>
 #include <set>
 #include <sstream>
 #include <thread>
+#include <unordered_map>
 #include <vector>
 #include "screen.hh"
 
@@ -70,6 +73,18 @@ class Songs {
 	/// Change sorting mode (diff is normally -1 or 1)
 	void sortChange(int diff);
 	void sortSpecificChange(int sortOrder, bool descending = false);
+	typedef std::vector<std::shared_ptr<Song> > SongVector;
+	/// Sort songs like the song list does in given sort mode (see sortDesc), caseSensitive as in game/case-sorting
+	static void sortSongs(SongVector& songs, int order, bool descending, bool caseSensitive);
+	/// Immutable view of all songs regardless of the filters, for other threads (e.g. the webserver)
+	struct Library {
+		std::uint64_t generation = 0;  ///< Changes whenever songs are added, replaced or removed
+		SongVector songs;
+		std::unordered_map<unsigned, std::shared_ptr<Song>> byId;  ///< By Song::id
+		std::unordered_map<unsigned, double> durations;  ///< Seconds by Song::id, as measured when loading (0 if unknown)
+	};
+	/// The latest published Library (readers never take the song list lock)
+	std::shared_ptr<Library const> library() const { return std::atomic_load(&m_library); }
 	/// parses file into Song &tmp
 	void parseFile(Song& tmp);
 	std::atomic<bool> doneLoading{ false };
@@ -81,9 +96,9 @@ class Songs {
 	void CacheSonglist();
 
 	class RestoreSel;
-	typedef std::vector<std::shared_ptr<Song> > SongVector;
 	std::string m_songlist;
 	SongVector m_songs, m_filtered;
+	SearchIndex<Song> m_search;  ///< Text search over m_songs
 	AnimValue m_updateTimer;
 	AnimAcceleration math_cover;
 	std::string m_filter;
@@ -92,11 +107,19 @@ class Songs {
 	int m_order;  // Set by constructor
 	void dumpSongs_internal() const;
 	void reload_internal();
-	void reload_internal(fs::path const& p);
+	struct Scan;
+	void reload_internal(Scan& scan, fs::path const& p);
+	void loadSong(Scan& scan, fs::path const& p);
 	void randomize_internal();
 	void filter_internal();
 	void sort_internal(bool descending = false);
 	std::atomic<bool> m_dirty{ false };
+	std::atomic<std::uint64_t> m_generation{ 0 };
+	std::shared_ptr<Library const> m_library = std::make_shared<Library>();  ///< Accessed atomically
+	std::unordered_map<std::string, unsigned> m_ids;  ///< Song ids by filename, kept across reloads
+	unsigned m_nextId = 1;
+	void assignId_internal(Song& song);
+	void publish_internal();  ///< Update m_library if songs have changed
 	std::atomic<bool> m_loading{ false };
 	std::unique_ptr<std::thread> m_thread;
 	mutable std::mutex m_mutex;
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <utility>
+
+/**
+* Bounded wait-free queue for handing objects from exactly one producer thread to exactly one consumer thread.
+* All slots are preallocated, so neither side allocates: push() move-assigns into a free slot and pop() only
+* releases the slot, leaving the consumed value in place until the producer overwrites it. Anything that the
+* consumed value still owns is thus freed on the producer side, which keeps destructors out of e.g. the audio
+* callback as long as the consumer moves out what it wants to keep.
+**/
+template <typename T, std::size_t SIZE> class SPSCQueue {
+	static_assert(SIZE >= 2 && (SIZE & (SIZE - 1)) == 0, "SPSCQueue SIZE must be a power of two");
+  public:
+	/// Producer: add a value, returns false (leaving value untouched) if the queue is full
+	bool push(T&& value) {
+		std::size_t w = m_write.load(std::memory_order_relaxed);
+		if (w - m_read.load(std::memory_order_acquire) == SIZE) return false;
+		m_slots[w % SIZE] = std::move(value);
+		m_write.store(w + 1, std::memory_order_release);
+		return true;
+	}
+	bool push(T const& value) { T tmp = value; return push(std::move(tmp)); }
+	/// Consumer: the oldest value or nullptr if empty; it remains valid until pop()
+	T* front() {
+		std::size_t r = m_read.load(std::memory_order_relaxed);
+		if (r == m_write.load(std::memory_order_acquire)) return nullptr;
+		return &m_slots[r % SIZE];
+	}
+	/// Consumer: release the slot returned by front()
+	void pop() { m_read.store(m_read.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+	/// Number of queued values (exact only when called by the producer or the consumer)
+	std::size_t size() const { return m_write.load(std::memory_order_acquire) - m_read.load(std::memory_order_acquire); }
+	bool empty() const { return size() == 0; }
+	static constexpr std::size_t capacity() { return SIZE; }
+  private:
+	std::array<T, SIZE> m_slots{};
+	std::atomic<std::size_t> m_read{ 0 };  ///< Written by the consumer only
+	std::atomic<std::size_t> m_write{ 0 };  ///< Written by the producer only
+};
@@ -1,17 +1,17 @@
 #include "texture.hh"
 
 #include "configuration.hh"
+#include "loadqueue.hh"
 #include "video_driver.hh"
 #include "screen.hh"
 #include "svg.hh"
+#include "util.hh"
 #include <boost/algorithm/string/case_conv.hpp>
 #include <boost/filesystem.hpp>
-#include <atomic>
 #include <cctype>
-#include <condition_variable>
+#include <map>
 #include <stdexcept>
 #include <sstream>
-#include <thread>
 #include <vector>
 
 using std::uint32_t;
@@ -29,22 +29,21 @@ float Dimensions::screenY() const {
 	throw std::logic_error("Dimensions::screenY(): unknown m_screenAnchor value");
 }
 
-struct Job {
-	fs::path name;
-	typedef std::function<void (Bitmap& bitmap)> ApplyFunc;
-	ApplyFunc apply;
-	Bitmap bitmap;
-	Job() {}
-	Job(fs::path const& n, ApplyFunc const& a): name(n), apply(a) {}
-};
-
 class TextureLoader::Impl {
-	/// Load a file from disk into a buffer
-	static void load(Bitmap& bitmap, fs::path const& name) {
+	/// Bytes of completed images uploaded to OpenGL per frame (at least one image is uploaded regardless)
+	static const std::size_t UPLOAD_BUDGET = 4 << 20;
+	std::mutex m_svgMutex;
+	LoadQueue<Bitmap> m_queue;
+	/// Load a file from disk into a buffer (called by the workers)
+	void load(Bitmap& bitmap, fs::path const& name) {
 		try {
 			std::string ext = boost::algorithm::to_lower_copy(name.extension().string());
 			if (!fs::is_regular_file(name)) throw std::runtime_error("File not found: " + name.string());
-			else if (ext == ".svg") loadSVG(bitmap, name);
+			else if (ext == ".svg") {
+				// librsvg (text rendering in particular) and the SVG cache are not safe for concurrent use
+				std::lock_guard<std::mutex> l(m_svgMutex);
+				loadSVG(bitmap, name);
+			}
 			else if (ext == ".jpg" || ext == ".jpeg") loadJPEG(bitmap, name);
 			else if (ext == ".png") loadPNG(bitmap, name);
 			else throw std::runtime_error("Unknown image file format: " + name.string());
@@ -52,69 +51,20 @@ class TextureLoader::Impl {
 			std::clog << "image/error: " << e.what() << std::endl;
 		}
 	}
-	std::atomic<bool> m_quit{ false };
-	std::mutex m_mutex;
-	std::condition_variable m_condition;
-	typedef std::map<void const*, Job> Jobs;
-	Jobs m_jobs;
-	std::thread m_thread;
-public:
-	Impl(): m_quit(), m_thread(&Impl::run, this) {}
-	~Impl() { m_quit = true; m_condition.notify_one(); m_thread.join(); }
-	/// The loader main loop: poll for image load jobs and load into RAM
-	void run() {
-		while (!m_quit) {
-			void const* target = nullptr;
-			fs::path name;
-			{
-				// Poll for jobs to be done
-				std::unique_lock<std::mutex> l(m_mutex);
-				for (auto& job: m_jobs) {
-					if (job.second.name.empty()) continue;  // Job already done
-					name = job.second.name;
-					target = job.first;
-					break;
-				}
-				// If not found, wait for one
-				if (!target) {
-					m_condition.wait(l);
-					continue;
-				}
-			}
-			// Load image file into buffer
-			Bitmap bitmap;
-			load(bitmap, name);
-			// Store the result
-			std::lock_guard<std::mutex> l(m_mutex);
-			auto it = m_jobs.find(target);
-			if (it == m_jobs.end()) continue;  // The job has been removed already
-			it->second.name.clear();  // Mark the job completed
-			it->second.bitmap.swap(bitmap);  // Store the bitmap (if we got any)
-		}
+	/// Leave a core for the main thread, more workers than a few would only compete for the disk
+	static unsigned workers() {
+		unsigned n = std::thread::hardware_concurrency();
+		return clamp(n > 1 ? n - 1 : 1, 1u, 4u);
 	}
+public:
+	Impl(): m_queue([this](Bitmap& bitmap, fs::path const& name) { load(bitmap, name); }, workers()) {}
 	/// Add a new job, using calling Texture's address as unique ID.
-	void push(void const* t, Job const& job) {
-		std::lock_guard<std::mutex> l(m_mutex);
-		m_jobs[t] = job;
-		m_condition.notify_one();
-	}
-	/// Cancel a job in progress (no effect if the job has already completed)
-	void remove(void const* t) {
-		std::lock_guard<std::mutex> l(m_mutex);
-		m_jobs.erase(t);
-	}
-	/// Upload all completed jobs to OpenGL (must be called from a valid OpenGL context)
-	void apply() {
-		std::lock_guard<std::mutex> l(m_mutex);
-		for (auto it = m_jobs.begin(); it != m_jobs.end();) {
-			{
-				Job& j = it->second;
-				if (!j.name.empty()) { ++it; continue; }  // Job incomplete, skip it
-				j.apply(j.bitmap);  // Upload to OpenGL
-			}
-			m_jobs.erase(it++);
-		}
-	}
+	void push(void const* t, fs::path const& name, LoadQueue<Bitmap>::ApplyFunc const& apply) { m_queue.push(t, name, apply); }
+	void prioritize(void const* t, int priority) { m_queue.prioritize(t, priority); }
+	bool pending(void const* t) { return m_queue.pending(t); }
+	void remove(void const* t) { m_queue.remove(t); }
+	/// Upload completed jobs to OpenGL, as many as fit in the budget (must be called from a valid OpenGL context)
+	void apply() { m_queue.apply(UPLOAD_BUDGET, [](Bitmap const& bitmap) { return bitmap.buf.size(); }); }
 };
 
 std::unique_ptr<TextureLoader::Impl> ldr = nullptr;
@@ -135,11 +85,13 @@ template <typename T> void loader(T* target, fs::path const& name) {
 	bitmap.resize(1, 1);
 	target->load(bitmap);
 	// Ask the loader to retrieve the image
-	ldr->push(target, Job(name, [target](Bitmap& bitmap){ target->load(bitmap); }));
+	ldr->push(target, name, [target](Bitmap& bitmap){ target->load(bitmap); });
 }
 
 Texture::Texture(fs::path const& filename) { loader(this, filename); }
 Texture::~Texture() { ldr->remove(this); }
+void Texture::prioritize(int priority) { ldr->prioritize(this, priority); }
+bool Texture::loading() const { return ldr->pending(this); }
 
 // Stuff for converting pix::Format into OpenGL enum values & other flags
 namespace {
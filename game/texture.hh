@@ -188,9 +188,13 @@ public:
 	/// texture coordinates
 	TexCoords tex;
 	Texture(): m_width(0), m_height(0), m_premultiplied(true) {}
-	/// creates texture from file
+	/// creates texture from file (loaded in background, black until then)
 	Texture(fs::path const& filename);
 	~Texture();
+	/// Change the priority of loading from file (higher first, 0 by default); no effect once loading has started
+	void prioritize(int priority);
+	/// Test if the image from file is still on its way (the texture is a placeholder until then)
+	bool loading() const;
 	bool empty() const { return m_width * m_height == 0; } ///< Test if the loading has failed
 	/// draws texture
 	void draw() const;
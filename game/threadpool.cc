@@ -0,0 +1,59 @@
+#include "threadpool.hh"
+
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+
+ThreadPool::ThreadPool(unsigned threads) {
+	if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+	m_threads.reserve(threads);
+	for (unsigned i = 0; i < threads; ++i) m_threads.emplace_back(&ThreadPool::worker, this);
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> l(m_mutex);
+		m_quit = true;
+	}
+	m_cond.notify_all();
+	for (auto& t: m_threads) t.join();
+}
+
+void ThreadPool::run(Task task) {
+	{
+		std::lock_guard<std::mutex> l(m_mutex);
+		m_tasks.push_back(std::move(task));
+	}
+	m_cond.notify_one();
+}
+
+void ThreadPool::wait() {
+	std::unique_lock<std::mutex> l(m_mutex);
+	m_idle.wait(l, [this]{ return m_tasks.empty() && m_busy == 0; });
+}
+
+unsigned ThreadPool::defaultSize(unsigned max) {
+	// Leave one hardware thread for the caller
+	unsigned hw = std::thread::hardware_concurrency();
+	return std::max(1u, std::min(max, hw > 1 ? hw - 1 : 1u));
+}
+
+void ThreadPool::worker() {
+	std::unique_lock<std::mutex> l(m_mutex);
+	while (true) {
+		m_cond.wait(l, [this]{ return m_quit || !m_tasks.empty(); });
+		if (m_tasks.empty()) return;  // Quitting and nothing left to do
+		Task task = std::move(m_tasks.front());
+		m_tasks.pop_front();
+		++m_busy;
+		l.unlock();
+		try {
+			task();
+		} catch (std::exception& e) {
+			std::clog << "core/error: Uncaught exception in worker thread: " << e.what() << std::endl;
+		}
+		l.lock();
+		--m_busy;
+		if (m_tasks.empty() && m_busy == 0) m_idle.notify_all();
+	}
+}
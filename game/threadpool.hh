@@ -0,0 +1,37 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/// A fixed set of worker threads executing queued tasks in FIFO order.
+class ThreadPool {
+  public:
+	typedef std::function<void()> Task;
+	/// Start the given number of worker threads (0 = one per hardware thread)
+	explicit ThreadPool(unsigned threads = 0);
+	ThreadPool(ThreadPool const&) = delete;
+	ThreadPool& operator=(ThreadPool const&) = delete;
+	/// Finish all queued tasks and join the workers
+	~ThreadPool();
+	/// Queue a task for execution by any worker
+	void run(Task task);
+	/// Block until the queue is empty and no task is executing
+	void wait();
+	/// Number of worker threads
+	unsigned size() const { return m_threads.size(); }
+	/// Default number of worker threads for a pool that should not take over the whole machine
+	static unsigned defaultSize(unsigned max);
+  private:
+	void worker();
+	std::mutex m_mutex;
+	std::condition_variable m_cond;  ///< Signalled when a task is queued or when quitting
+	std::condition_variable m_idle;  ///< Signalled when all work has been completed
+	std::deque<Task> m_tasks;
+	unsigned m_busy = 0;
+	bool m_quit = false;
+	std::vector<std::thread> m_threads;
+};
@@ -4,13 +4,16 @@
 #include "regex.hh"
 #include <sstream>
 #include <stdexcept>
+#include <unicode/normalizer2.h>
+#include <unicode/uchar.h>
 #include <unicode/unistr.h>
 #include <unicode/ustream.h>
 #include "../3rdparty/ced/compact_enc_det/compact_enc_det.h"
 
 UErrorCode UnicodeUtil::m_staticIcuError = U_ZERO_ERROR;
 icu::RuleBasedCollator UnicodeUtil::m_dummyCollator (icu::UnicodeString (""), icu::Collator::PRIMARY, m_staticIcuError);
-icu::RuleBasedCollator UnicodeUtil::m_sortCollator  (nullptr, icu::Collator::SECONDARY, m_staticIcuError);
+icu::RuleBasedCollator const UnicodeUtil::m_sortCollator  (nullptr, icu::Collator::SECONDARY, m_staticIcuError);
+icu::RuleBasedCollator const UnicodeUtil::m_caseSortCollator  (nullptr, icu::Collator::TERTIARY, m_staticIcuError);
 
 std::string UnicodeUtil::getCharset (std::string const& str) {
 	const char* text = str.c_str();
@@ -89,6 +92,35 @@ std::string UnicodeUtil::toUpper (std::string const& str, size_t length) {
 	return ret;
 }
 
+std::string UnicodeUtil::sortKey (std::string const& str, bool caseSensitive) {
+	icu::RuleBasedCollator const& collator = (caseSensitive ? m_caseSortCollator : m_sortCollator);
+	icu::UnicodeString ustr = icu::UnicodeString::fromUTF8(str);
+	std::string key(ustr.length() * 4 + 16, '\0');  // Usually enough, otherwise the required length is returned
+	int32_t length = collator.getSortKey(ustr, reinterpret_cast<uint8_t*>(&key[0]), key.size());
+	if (length > int32_t(key.size())) {
+		key.resize(length);
+		length = collator.getSortKey(ustr, reinterpret_cast<uint8_t*>(&key[0]), key.size());
+	}
+	if (length == 0) throw std::runtime_error("unicode/error: Unable to create sort key");
+	key.resize(length - 1);  // Without the terminating null byte
+	return key;
+}
+
+std::string UnicodeUtil::searchFold (std::string const& str) {
+	UErrorCode icuError = U_ZERO_ERROR;
+	static icu::Normalizer2 const* nfd = icu::Normalizer2::getNFDInstance(icuError);
+	icu::UnicodeString decomposed = nfd->normalize(icu::UnicodeString::fromUTF8(str), icuError);
+	if (U_FAILURE(icuError)) throw std::runtime_error("unicode/error: Unable to normalize string");
+	icu::UnicodeString folded;
+	for (int32_t i = 0; i < decomposed.length(); i = decomposed.moveIndex32(i, 1)) {
+		UChar32 c = decomposed.char32At(i);
+		if (u_charType(c) != U_NON_SPACING_MARK) folded.append(c);
+	}
+	std::string ret;
+	folded.foldCase().toUTF8String(ret);
+	return ret;
+}
+
 void UnicodeUtil::collate (songMetadata& stringmap) {
 	for (auto& kv: stringmap) { 
 		ConfigItem::StringList termsToCollate = config["game/sorting_ignore"].sl();
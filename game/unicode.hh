@@ -18,7 +18,13 @@ struct UnicodeUtil {
 	static std::string convertToUTF8 (std::string const& str);
 	static std::string toLower (std::string const& str, size_t length = 0);
 	static std::string toUpper (std::string const& str, size_t length = 0);
+	/// Collation key of str for m_sortCollator (m_caseSortCollator if caseSensitive), byte-wise comparison of keys equals comparing the strings with it
+	static std::string sortKey (std::string const& str, bool caseSensitive);
+	/// Case folded str without accents (combining marks), for substring search that matches like m_dummyCollator
+	static std::string searchFold (std::string const& str);
 	static icu::RuleBasedCollator m_dummyCollator;
-	static icu::RuleBasedCollator m_sortCollator;
+	/// Secondary and tertiary strength sort collators, never modified so that the UI and the webserver can share them
+	static icu::RuleBasedCollator const m_sortCollator;
+	static icu::RuleBasedCollator const m_caseSortCollator;
 	static UErrorCode m_staticIcuError;
 };
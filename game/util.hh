@@ -21,6 +21,13 @@ template <typename Numeric> struct MinMax {
 	bool matches(Numeric val) const { return val >= min && val <= max; }
 };
 
+/** 64-bit FNV-1a hash, for names and tags that must stay the same across runs (unlike std::hash) **/
+static inline std::uint64_t fnv1a64(std::string const& data) {
+	std::uint64_t hash = 14695981039346656037ULL;
+	for (unsigned char c: data) { hash ^= c; hash *= 1099511628211ULL; }
+	return hash;
+}
+
 /** A convenient way for getting NaNs **/
 static inline constexpr double getNaN() { return std::numeric_limits<double>::quiet_NaN(); }
 
@@ -7,12 +7,13 @@ Video::Video(fs::path const& _videoFile, double videoGap): m_mpeg(_videoFile), m
 
 void Video::prepare(double time) {
 	time += m_videoGap;
+	m_mpeg.videoQueue.demand(time);
 	Bitmap& fr = m_videoFrame;
 	// Time to switch frame?
 	if (!fr.buf.empty() && time >= fr.timestamp) {
 		m_texture.load(fr);
 		m_textureTime = fr.timestamp;
-		fr.resize(0, 0);
+		m_mpeg.videoQueue.release(fr);  // For decoding another frame into
 	}
 	// Preload the next future frame
 	if (fr.buf.empty()) while (m_mpeg.videoQueue.tryPop(fr) && fr.timestamp < time) {};
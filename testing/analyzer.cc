@@ -0,0 +1,104 @@
+#include "pitch.hh"
+
+#include "bench.hh"
+#include "probe.hh"
+#include <gtest/gtest.h>
+#include <cmath>
+#include <random>
+#include <vector>
+
+namespace {
+	double const rate = 48000.0;
+
+	/// Feed the analyzer seconds of signal in audio callback sized chunks, processing after each one
+	template <typename Signal> void feed(Analyzer& analyzer, Signal signal, double seconds) {
+		std::vector<float> chunk(256);
+		std::size_t t = 0;
+		for (std::size_t n = 0; n < seconds * rate; n += chunk.size()) {
+			for (auto& s: chunk) s = signal(t++);
+			analyzer.input(chunk.begin(), chunk.end());
+			analyzer.process();
+		}
+	}
+
+	float sine(std::size_t t, double freq, double amplitude) { return amplitude * std::sin(da::TAU * freq * t / rate); }
+}
+
+TEST(Analyzer, FindsSineFrequency) {
+	for (double freq: { 110.0, 220.0, 440.0, 880.0 }) {
+		Analyzer analyzer(rate, "test");
+		feed(analyzer, [freq](std::size_t t) { return sine(t, freq, 0.5); }, 0.5);
+		Tone const* tone = analyzer.findTone();
+		ASSERT_NE(nullptr, tone) << freq << " Hz";
+		EXPECT_NEAR(freq, tone->freq, freq * 0.01);
+		EXPECT_NEAR(20.0 * std::log10(0.5), analyzer.getPeak(), 1.0);
+	}
+}
+
+TEST(Analyzer, FindsFundamentalOfHarmonicTone) {
+	Analyzer analyzer(rate, "test", 2048);
+	double const freq = 196.0;
+	feed(analyzer, [freq](std::size_t t) {
+		float s = 0.0f;
+		for (unsigned h = 1; h <= 8; ++h) s += sine(t, h * freq, 0.3 / h);
+		return s;
+	}, 0.5);
+	Tone const* tone = analyzer.findTone();
+	ASSERT_NE(nullptr, tone);
+	EXPECT_NEAR(freq, tone->freq, freq * 0.01);
+}
+
+TEST(Analyzer, SilenceHasNoTone) {
+	Analyzer analyzer(rate, "test");
+	feed(analyzer, [](std::size_t) { return 0.0f; }, 0.2);
+	EXPECT_EQ(nullptr, analyzer.findTone());
+	EXPECT_TRUE(analyzer.getTones().empty());
+}
+
+TEST(Analyzer, NoiseStaysWithinPreallocatedTones) {
+	Analyzer analyzer(rate, "test");
+	auto capacity = analyzer.getTones().capacity();
+	std::mt19937 gen(1);
+	std::uniform_real_distribution<float> dist(-0.5f, 0.5f);
+	feed(analyzer, [&](std::size_t) { return dist(gen); }, 1.0);
+	EXPECT_LE(analyzer.getTones().size(), std::size_t(Analyzer::MAXTONES));
+	EXPECT_EQ(capacity, analyzer.getTones().capacity());  // The engine thread must not have reallocated
+}
+
+/// Steady-state cost of a hop (FFT, peaks, addTone and merging with the previous tones) for a harmonic tone and for
+/// noise, which tracks dozens of tones
+TEST(Analyzer, BenchHops) {
+	std::mt19937 gen(1);
+	std::uniform_real_distribution<float> dist(-0.5f, 0.5f);
+	auto harmonic = [](std::size_t t) {
+		float s = 0.0f;
+		for (unsigned h = 1; h <= 8; ++h) s += sine(t, h * 196.0, 0.3 / h);
+		return s;
+	};
+	auto noise = [&](std::size_t) { return dist(gen); };
+	for (std::size_t fftSize: { FFT_N, FFT_MAXN }) {
+		for (bool isNoise: { false, true }) {
+			Analyzer analyzer(rate, "test", fftSize);
+			std::size_t t = 0;
+			auto signal = [&](std::size_t) { return isNoise ? noise(t++) : harmonic(t++); };
+			feed(analyzer, signal, 0.5);  // Warm up, so that tones have been tracked already
+			// One hop (the default step of 200 samples) per process() call, as the engine runs every 10 ms or so
+			unsigned const hops = 200;
+			std::vector<float> chunk(200);
+			double elapsed = 0.0;
+			unsigned long allocations = 0;
+			for (unsigned hop = 0; hop < hops; ++hop) {
+				for (auto& s: chunk) s = signal(0);
+				analyzer.input(chunk.begin(), chunk.end());
+				probe::Scope scope;
+				elapsed += bench::seconds([&] { analyzer.process(); });
+				allocations += scope.allocated();
+			}
+			EXPECT_EQ(0u, allocations);
+			std::string name = std::string("analyzer_hop_") + (isNoise ? "noise" : "harmonic") + "_fft" + std::to_string(fftSize);
+			bench::report(name + "_us", 1e6 * elapsed / hops, "us");
+			bench::report(name + "_allocations", double(allocations) / hops, "per hop");
+			bench::report(name + "_tones", double(analyzer.getTones().size()), "tones");
+		}
+	}
+}
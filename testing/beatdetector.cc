@@ -0,0 +1,86 @@
+#include "beatdetector.hh"
+
+#include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+namespace {
+	struct Target { std::vector<double> beats; };
+
+	/// Call update() until target gets beats (or give up after a few seconds)
+	bool waitForBeats(BeatDetector<Target>& detector, Target const& target) {
+		for (int i = 0; i < 500 && target.beats.empty(); ++i) {
+			detector.update();
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		}
+		return !target.beats.empty();
+	}
+}
+
+TEST(BeatDetector, DeliversResultsOnUpdate) {
+	std::atomic<unsigned> calls{ 0 };
+	BeatDetector<Target> detector([&](fs::path const& music, double start, std::atomic<bool> const&, std::vector<double>& beats) {
+		++calls;
+		EXPECT_EQ("song.ogg", music.string());
+		beats = { start, start + 0.5 };
+		return true;
+	});
+	auto target = std::make_shared<Target>();
+	detector.request(target, "song.ogg", 12.0);
+	ASSERT_TRUE(waitForBeats(detector, *target));
+	EXPECT_EQ((std::vector<double>{ 12.0, 12.5 }), target->beats);
+	detector.request(target, "song.ogg", 12.0);  // Has beats already
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	EXPECT_EQ(1u, calls);
+}
+
+TEST(BeatDetector, NewRequestCancelsAnalysisInProgress) {
+	std::atomic<bool> started{ false }, cancelled{ false };
+	BeatDetector<Target> detector([&](fs::path const& music, double, std::atomic<bool> const& abort, std::vector<double>& beats) {
+		if (music == "slow.ogg") {
+			started = true;
+			while (!abort) std::this_thread::yield();
+			cancelled = true;
+			return false;
+		}
+		beats = { 1.0 };
+		return true;
+	});
+	auto slow = std::make_shared<Target>(), fast = std::make_shared<Target>();
+	detector.request(slow, "slow.ogg", 0.0);
+	while (!started) std::this_thread::yield();
+	detector.request(fast, "fast.ogg", 0.0);
+	ASSERT_TRUE(waitForBeats(detector, *fast));
+	EXPECT_TRUE(cancelled);
+	EXPECT_TRUE(slow->beats.empty());
+}
+
+TEST(BeatDetector, FailedAnalysisIsNotDelivered) {
+	std::atomic<unsigned> calls{ 0 };
+	BeatDetector<Target> detector([&](fs::path const&, double, std::atomic<bool> const&, std::vector<double>& beats) {
+		beats = { 1.0 };
+		if (++calls == 1) throw std::runtime_error("cannot decode");
+		return false;
+	});
+	auto target = std::make_shared<Target>();
+	detector.request(target, "a.ogg", 0.0);
+	detector.request(target, "b.ogg", 0.0);
+	for (int i = 0; i < 20 && calls < 2; ++i) std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	detector.update();
+	EXPECT_TRUE(target->beats.empty());
+}
+
+TEST(BeatDetector, DestructionAbortsAnalysis) {
+	std::atomic<bool> started{ false };
+	{
+		BeatDetector<Target> detector([&](fs::path const&, double, std::atomic<bool> const& abort, std::vector<double>&) {
+			started = true;
+			while (!abort) std::this_thread::yield();
+			return false;
+		});
+		detector.request(std::make_shared<Target>(), "endless.ogg", 0.0);
+		while (!started) std::this_thread::yield();
+	}  // Must not hang
+	SUCCEED();
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include "chrono.hh"
+#include <gtest/gtest.h>
+#include <iostream>
+#include <string>
+
+/**
+* Measurements of benchmark-style tests. They are printed with the test output and recorded as test properties,
+* so that --gtest_output=xml collects them. Workloads are kept small enough for every ctest run.
+**/
+namespace bench {
+	inline void report(std::string const& name, double value, std::string const& unit) {
+		std::cout << "[ bench    ] " << name << ": " << value << " " << unit << std::endl;
+		::testing::Test::RecordProperty(name, std::to_string(value) + " " + unit);
+	}
+	/// Wall time taken by f() in seconds
+	template <typename F> double seconds(F&& f) {
+		Time begin = Clock::now();
+		f();
+		return Seconds(Clock::now() - begin).count();
+	}
+}
@@ -0,0 +1,51 @@
+#include "bufferpool.hh"
+#include "probe.hh"
+
+#include <gtest/gtest.h>
+#include <vector>
+
+namespace {
+	typedef std::vector<unsigned char> Buffer;
+}
+
+TEST(BufferPool, BoundedAndReleasesEmpty) {
+	BufferPool<Buffer> pool(2);
+	for (int i = 0; i < 3; ++i) {
+		Buffer buf(100);
+		pool.release(buf);
+		EXPECT_EQ(0u, buf.capacity());
+	}
+	EXPECT_EQ(2u, pool.size());  // The third one was freed
+	Buffer empty;
+	pool.release(empty);  // Nothing to keep
+	EXPECT_EQ(2u, pool.size());
+	Buffer buf;
+	pool.reuse(buf);
+	EXPECT_EQ(100u, buf.capacity());
+	EXPECT_EQ(1u, pool.size());
+}
+
+/// Decode video frames the way FFmpeg and Video do: take a buffer from the pool, fill it, queue it, and give
+/// the frame displayed before back once the next one is shown
+TEST(BufferPool, SteadyStateDecodingDoesNotAllocate) {
+	unsigned const queueLength = 20;
+	std::size_t const frameSize = 1920 * 1080 * 3;  // 1080p RGB
+	BufferPool<Buffer> pool(queueLength + 2);
+	std::vector<Buffer> queue(queueLength);  // Ring of decoded frames
+	Buffer displayed;
+	probe::Scope scope;
+	unsigned const warmup = 2 * queueLength, frames = 500;
+	for (unsigned i = 0; i < warmup + frames; ++i) {
+		if (i == warmup) scope = probe::Scope();
+		Buffer& slot = queue[i % queueLength];
+		if (i >= queueLength) {  // Display the oldest frame, recycling the previous one
+			pool.release(displayed);
+			displayed.swap(slot);
+		}
+		Buffer frame;
+		pool.reuse(frame);
+		frame.resize(frameSize);
+		slot.swap(frame);
+	}
+	EXPECT_EQ(0ul, scope.allocated()) << "allocations per frame: " << double(scope.allocated()) / frames;
+}
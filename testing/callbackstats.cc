@@ -0,0 +1,53 @@
+#include "callbackstats.hh"
+
+#include "bench.hh"
+#include "probe.hh"
+#include <gtest/gtest.h>
+
+namespace {
+	Seconds const block = 128.0s / 48000.0;  // A low-latency block
+}
+
+TEST(CallbackStats, BucketsByLoad) {
+	CallbackStats stats;
+	stats.add(0.1 * block, block, false);
+	stats.add(0.2 * block, block, false);
+	stats.add(0.3 * block, block, false);
+	stats.add(0.6 * block, block, false);
+	stats.add(0.9 * block, block, true);
+	stats.add(1.5 * block, block, true);
+	stats.add(3.0 * block, block, false);
+	EXPECT_EQ(2u, stats.count(0));
+	EXPECT_EQ(1u, stats.count(1));
+	EXPECT_EQ(1u, stats.count(2));
+	EXPECT_EQ(1u, stats.count(3));
+	EXPECT_EQ(2u, stats.count(4));
+	EXPECT_EQ(2u, stats.xruns());
+	EXPECT_DOUBLE_EQ(3.0, stats.worst());
+	EXPECT_EQ("callback load <25%: 2 <50%: 1 <75%: 1 <100%: 1 >=100%: 2, worst: 300%, xruns: 2", stats.dump());
+}
+
+TEST(CallbackStats, AddDoesNotAllocateOrLock) {
+	CallbackStats stats;
+	probe::Scope scope;
+	for (int i = 0; i < 1000; ++i) stats.add(0.001 * i * block, block, i % 100 == 0);
+	EXPECT_EQ(0u, scope.allocated());
+	EXPECT_EQ(0u, scope.locked());
+}
+
+/// What the histogram costs the callback: two clock reads and add() per callback, as Device's callback Timer does
+TEST(CallbackStats, BenchOverheadPerCallback) {
+	CallbackStats stats;
+	unsigned const callbacks = 1000000;
+	double elapsed = bench::seconds([&] {
+		for (unsigned i = 0; i < callbacks; ++i) {
+			Time start = Clock::now();
+			stats.add(Clock::now() - start, block, false);
+		}
+	});
+	unsigned recorded = 0;
+	for (unsigned b = 0; b < CallbackStats::BUCKETS; ++b) recorded += stats.count(b);
+	EXPECT_EQ(callbacks, recorded);  // Mostly in the first bucket, but the thread may get preempted between clock reads
+	bench::report("callback_stats_ns_per_callback", 1e9 * elapsed / callbacks, "ns");
+	bench::report("callback_stats_share_of_128_frame_block", 100.0 * elapsed / callbacks / block.count(), "%");
+}
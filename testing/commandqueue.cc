@@ -0,0 +1,164 @@
+#include "commandqueue.hh"
+
+#include "bench.hh"
+#include "probe.hh"
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace {
+	struct Command {
+		unsigned seq = 0;
+		Time sent{};
+		std::unique_ptr<int> payload;  ///< Replaces the callback's current payload
+	};
+	struct Garbage {
+		std::unique_ptr<int> payload;
+	};
+	using Queue = CommandQueue<Command, Garbage, 16>;
+
+	/// Callback side: apply one command, releasing what it replaces
+	void apply(Queue& queue, Command& cmd, std::unique_ptr<int>& current) {
+		Garbage g;
+		g.payload = std::move(current);
+		current = std::move(cmd.payload);
+		if (g.payload) queue.release(std::move(g));
+		queue.pop();
+	}
+}
+
+TEST(CommandQueue, ReleasedObjectsGoToTheSender) {
+	Queue queue;
+	std::unique_ptr<int> current;
+	for (int i = 0; i < 3; ++i) {
+		Queue::Lock l(queue);
+		Command cmd;
+		cmd.payload.reset(new int(i));
+		EXPECT_TRUE(queue.send(l, std::move(cmd)));
+	}
+	while (Command* cmd = queue.front()) apply(queue, *cmd, current);
+	EXPECT_EQ(2, *current);
+	Queue::Lock l(queue);
+	queue.collect(l);
+	ASSERT_EQ(2u, l.trash().size());
+	EXPECT_EQ(0, *l.trash()[0].payload);
+	EXPECT_EQ(1, *l.trash()[1].payload);
+}
+
+TEST(CommandQueue, CallbackWaitsForRoomToRelease) {
+	Queue queue;
+	std::unique_ptr<int> current;
+	for (int i = 0; i < 16; ++i) {
+		Queue::Lock l(queue);
+		Command cmd;
+		cmd.payload.reset(new int(i));
+		queue.send(l, std::move(cmd));
+	}
+	{
+		probe::Scope scope;
+		for (int i = 0; i < 15; ++i) apply(queue, *queue.front(), current);  // The first one releases nothing
+		EXPECT_TRUE(queue.release(Garbage()));
+		EXPECT_TRUE(queue.release(Garbage()));
+		EXPECT_FALSE(queue.canRelease());
+		EXPECT_FALSE(queue.release(Garbage()));
+		EXPECT_EQ(nullptr, queue.front());  // A command is pending, but not taken while garbage is full
+		EXPECT_EQ(0u, scope.allocated());
+		EXPECT_EQ(0u, scope.locked());
+	}
+	Queue::Lock l(queue);
+	queue.collect(l);
+	EXPECT_EQ(16u, l.trash().size());
+	ASSERT_NE(nullptr, queue.front());
+	EXPECT_EQ(15, *queue.front()->payload);
+}
+
+TEST(CommandQueue, SenderWaitsForRoomWhileCallbackRuns) {
+	Queue queue;
+	std::atomic<bool> quit{ false };
+	std::atomic<unsigned> applied{ 0 };
+	std::thread callback([&] {
+		std::unique_ptr<int> current;
+		while (!quit) {
+			while (Command* cmd = queue.front()) { apply(queue, *cmd, current); ++applied; }
+			std::this_thread::sleep_for(2ms);
+		}
+	});
+	unsigned const count = 100;  // Many times the queue size
+	for (unsigned i = 0; i < count; ++i) {
+		Queue::Lock l(queue);
+		EXPECT_TRUE(queue.send(l, Command()));
+	}
+	while (applied < count) std::this_thread::sleep_for(1ms);
+	quit = true;
+	callback.join();
+	EXPECT_FALSE(queue.stalled());
+}
+
+TEST(CommandQueue, StalledCallbackFailsFastAfterTimeout) {
+	Queue queue(20ms);
+	Queue::Lock l(queue);
+	for (unsigned i = 0; i < 16; ++i) EXPECT_TRUE(queue.send(l, Command()));
+	double first = bench::seconds([&] { EXPECT_FALSE(queue.send(l, Command())); });
+	EXPECT_GE(first, 0.020);
+	EXPECT_TRUE(queue.stalled());
+	double second = bench::seconds([&] { EXPECT_FALSE(queue.send(l, Command())); });
+	EXPECT_LT(second, 0.010);  // Does not wait again
+	queue.pop();  // The callback resumes
+	EXPECT_TRUE(queue.send(l, Command()));
+	EXPECT_FALSE(queue.stalled());
+}
+
+/**
+* Command-to-audible latency under UI load: the UI thread renders 8 ms frames (busy) and sends a command per
+* frame, while the callback runs every 256 frames at 48 kHz. A command is audible at the end of the first
+* block computed after taking it.
+**/
+TEST(CommandQueue, BenchCommandToAudibleLatency) {
+	Queue queue;
+	Seconds const period(256.0 / 48000.0);
+	unsigned const frames = 60;
+	std::vector<double> latencies;
+	latencies.reserve(frames);
+	std::atomic<bool> quit{ false };
+	std::thread callback([&] {
+		std::unique_ptr<int> current;
+		Time next = Clock::now();
+		while (!quit) {
+			Time now = Clock::now();
+			while (Command* cmd = queue.front()) {
+				latencies.push_back(Seconds(now + clockDur(period) - cmd->sent).count());  // Preallocated
+				apply(queue, *cmd, current);
+			}
+			next += clockDur(period);
+			std::this_thread::sleep_until(next);
+		}
+	});
+	double sendMax = 0.0;
+	for (unsigned f = 0; f < frames; ++f) {
+		Time frameEnd = Clock::now() + 8ms;
+		Command cmd;
+		cmd.seq = f;
+		cmd.payload.reset(new int(f));
+		cmd.sent = Clock::now();
+		sendMax = std::max(sendMax, bench::seconds([&] {
+			Queue::Lock l(queue);
+			queue.send(l, std::move(cmd));
+		}));
+		while (Clock::now() < frameEnd) {}  // Rendering
+	}
+	std::this_thread::sleep_for(20ms);
+	quit = true;
+	callback.join();
+	ASSERT_EQ(frames, latencies.size());
+	std::sort(latencies.begin(), latencies.end());
+	double avg = 0.0;
+	for (double l: latencies) avg += l / frames;
+	EXPECT_GE(latencies.front(), period.count());
+	bench::report("audio_command_latency_avg_ms", 1e3 * avg, "ms");
+	bench::report("audio_command_latency_p95_ms", 1e3 * latencies[frames * 95 / 100], "ms");
+	bench::report("audio_command_latency_max_ms", 1e3 * latencies.back(), "ms");
+	bench::report("audio_command_send_max_ms", 1e3 * sendMax, "ms");
+}
@@ -0,0 +1,145 @@
+#include "controllers-nav.hh"
+
+#include "bench.hh"
+#include <gtest/gtest.h>
+#include <set>
+
+using namespace input;
+
+namespace {
+	Event makeEvent(Button button, double value, Time time, DevType devType = DEVTYPE_GENERIC, unsigned device = 0) {
+		Event ev;
+		ev.source = SourceId(SOURCETYPE_JOYSTICK, device);
+		ev.devType = devType;
+		ev.button = button;
+		ev.value = value;
+		ev.time = time;
+		ev.nav = navigation(ev);
+		return ev;
+	}
+	unsigned countNav(NavEvents& nav) {
+		unsigned count = 0;
+		NavEvent ne;
+		while (nav.get(ne)) ++count;
+		return count;
+	}
+}
+
+TEST(Controllers, ButtonIndicesAreDenseAndDistinct) {
+	// Instruments share button numbers, so only the buttons of one DevType must differ
+	std::set<std::pair<DevType, unsigned>> indices;
+	#define DEFINE_BUTTON(dt, btn, num, nav) \
+		EXPECT_LT(buttonIndex(dt##_##btn), BUTTON_INDICES); \
+		EXPECT_TRUE(indices.emplace(DEVTYPE_##dt, buttonIndex(dt##_##btn)).second) << #dt " " #btn;
+	#include "controllers-buttons.ii"
+	EXPECT_EQ(instrumentPlanes() << 8, buttonIndex(GENERIC_UNASSIGNED));
+	EXPECT_THROW(buttonIndex(Button(0x200, 0)), std::logic_error);
+}
+
+TEST(Controllers, NavigationDependsOnDevType) {
+	Time t = Clock::now();
+	EXPECT_EQ(NAV_START, makeEvent(GENERIC_START, 1.0, t).nav);
+	EXPECT_EQ(NAV_UP, makeEvent(GUITAR_PICK_UP, 1.0, t, DEVTYPE_GUITAR).nav);
+	EXPECT_EQ(NAV_NONE, makeEvent(GUITAR_PICK_UP, 1.0, t, DEVTYPE_DRUMS).nav);
+}
+
+TEST(Controllers, ButtonValuesReportChangesOnly) {
+	ButtonValues values;
+	Time t = Clock::now();
+	EXPECT_TRUE(values.changed(makeEvent(GENERIC_UP, 0.0, t)));  // Not seen before
+	EXPECT_FALSE(values.changed(makeEvent(GENERIC_UP, 0.0, t)));
+	EXPECT_TRUE(values.changed(makeEvent(GENERIC_UP, 1.0, t)));
+	EXPECT_FALSE(values.changed(makeEvent(GENERIC_UP, 1.0, t)));
+	EXPECT_TRUE(values.changed(makeEvent(GENERIC_DOWN, 1.0, t)));  // Other button
+	EXPECT_TRUE(values.changed(makeEvent(GENERIC_UP, 1.0, t, DEVTYPE_GENERIC, 1)));  // Other source
+}
+
+TEST(Controllers, NavMenuMappingFollowsOrientation) {
+	NavEvents nav;
+	Time t = Clock::now();
+	NavEvent ne;
+	nav.push(makeEvent(GENERIC_UP, 1.0, t));
+	ASSERT_TRUE(nav.get(ne));
+	EXPECT_EQ(NAV_UP, ne.button);
+	EXPECT_EQ(NAVMENU_B_PREV, ne.menu);
+	EXPECT_EQ(0u, ne.repeat);
+	nav.push(makeEvent(GUITAR_PICK_UP, 1.0, t, DEVTYPE_GUITAR));
+	ASSERT_TRUE(nav.get(ne));
+	EXPECT_EQ(NAVMENU_A_PREV, ne.menu);
+	nav.push(makeEvent(GENERIC_UP, 0.0, t));  // Releases emit nothing
+	EXPECT_FALSE(nav.get(ne));
+}
+
+TEST(Controllers, HeldButtonAutoRepeatsUntilReleased) {
+	NavEvents nav;
+	Time t = Clock::now();
+	nav.repeat(t);
+	nav.push(makeEvent(GENERIC_DOWN, 1.0, t));
+	EXPECT_EQ(1u, countNav(nav));
+	// Repeats after 2/10 s, then 2/11 s, 2/12 s... checked once per 10 ms frame
+	unsigned repeats = 0;
+	NavEvent ne;
+	for (int ms = 10; ms <= 500; ms += 10) {
+		nav.repeat(t + std::chrono::milliseconds(ms));
+		while (nav.get(ne)) { ++repeats; EXPECT_EQ(repeats, ne.repeat); EXPECT_EQ(NAV_DOWN, ne.button); }
+		if (ms == 190) { EXPECT_EQ(0u, repeats); }
+		if (ms == 200) { EXPECT_EQ(1u, repeats); }
+	}
+	EXPECT_EQ(2u, repeats);  // 0.2 s and 0.38 s
+	nav.push(makeEvent(GENERIC_DOWN, 0.0, t + 500ms));
+	for (int ms = 510; ms <= 1500; ms += 10) nav.repeat(t + std::chrono::milliseconds(ms));
+	EXPECT_EQ(0u, countNav(nav));
+}
+
+TEST(Controllers, NonRepeatingButtonsDoNotRepeat) {
+	NavEvents nav;
+	Time t = Clock::now();
+	nav.repeat(t);
+	nav.push(makeEvent(GENERIC_START, 1.0, t));
+	for (int ms = 10; ms <= 1000; ms += 10) nav.repeat(t + std::chrono::milliseconds(ms));
+	EXPECT_EQ(1u, countNav(nav));
+}
+
+TEST(Controllers, LatencySpikeRestartsRepeatTimers) {
+	NavEvents nav;
+	Time t = Clock::now();
+	nav.repeat(t);
+	nav.push(makeEvent(GENERIC_LEFT, 1.0, t));
+	EXPECT_EQ(1u, countNav(nav));
+	nav.repeat(t + 2s);  // Frame stalled for two seconds
+	EXPECT_EQ(0u, countNav(nav));
+	for (int ms = 10; ms < 200; ms += 10) nav.repeat(t + 2s + std::chrono::milliseconds(ms));
+	EXPECT_EQ(0u, countNav(nav));
+	nav.repeat(t + 2s + 200ms);
+	EXPECT_EQ(1u, countNav(nav));
+}
+
+/// The mapped-event path of Controllers::Impl::pushHWEvent: value change filter, nav mapping and auto-repeat
+TEST(Controllers, BenchMappedEventsPerSecond) {
+	ButtonValues values;
+	NavEvents nav;
+	Button const buttons[] = { GENERIC_UP, GENERIC_DOWN, GUITAR_GREEN, GUITAR_PICK_DOWN, GENERIC_START };
+	unsigned const frames = 20000, eventsPerFrame = 10;
+	unsigned navEvents = 0, repeats = 0;
+	Time t = Clock::now();
+	double s = bench::seconds([&] {
+		for (unsigned f = 0; f < frames; ++f) {
+			t += 5ms;
+			for (unsigned i = 0; i < eventsPerFrame; ++i) {
+				// Press, hold over several frames and release, on four sources
+				Button b = buttons[(f + i) % 5];
+				Event ev = makeEvent(b, (f / 50 + i) % 2, t, b.layer() == 0 ? DEVTYPE_GUITAR : DEVTYPE_GENERIC, i % 4);
+				if (!values.changed(ev)) continue;
+				if (ev.nav != NAV_NONE) nav.push(ev);
+			}
+			nav.repeat(t);
+			NavEvent ne;
+			while (nav.get(ne)) { ++navEvents; if (ne.repeat) ++repeats; }
+		}
+	});
+	EXPECT_GT(navEvents, 0u);
+	EXPECT_GT(repeats, 0u);
+	bench::report("controllers_mapped_events_per_second", frames * eventsPerFrame / s, "events/s");
+	bench::report("controllers_nav_events", navEvents, "events");
+	bench::report("controllers_auto_repeats", repeats, "events");
+}
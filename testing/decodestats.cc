@@ -0,0 +1,95 @@
+#include "decodestats.hh"
+
+#include "bench.hh"
+#include "util.hh"
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cmath>
+
+namespace {
+	/// The lag thresholds of the video decoder's quality levels (see ffmpeg.cc)
+	struct Level { double lag; };
+	Level const levels[] = { { 0.0 }, { 0.1 }, { 0.5 }, { 2.0 } };
+
+	/// Result of simulating a decoder (see simulate)
+	struct Simulation {
+		DecodeStats stats;
+		double maxLag = 0.0;
+		unsigned maxLevel = 0;
+		unsigned level = 0;  ///< At the end
+	};
+
+	/**
+	* Decode a 25 fps video that is displayed in real time, one frame after another, adapting the quality like
+	* FFmpeg::adaptDecoding does. load(t) is the time to decode a frame at full quality (in frame durations) at
+	* time t; each level cuts that by skipping more work. The decoder waits while its queue of 20 frames is full.
+	**/
+	template <typename Load> Simulation simulate(double seconds, Load load) {
+		double const frameTime = 1.0 / 25.0;
+		double const work[] = { 1.0, 0.8, 0.5, 0.2 };  // Decoding time at each level relative to full quality
+		Simulation sim;
+		double now = 0.0;  // Also the displayed position
+		for (unsigned frame = 0; frame * frameTime < seconds; ++frame) {
+			double position = frame * frameTime;
+			now = std::max(now, position - 20 * frameTime);  // Queue full
+			double cost = load(now) * frameTime * work[sim.level];
+			sim.stats.decoding(clockDur(Seconds(cost)));
+			sim.stats.frame(sim.level > 0);
+			now += cost;
+			double lag = now - position;
+			sim.maxLag = std::max(sim.maxLag, lag);
+			sim.level = degradeLevel(sim.level, lag, levels);
+			sim.maxLevel = std::max(sim.maxLevel, sim.level);
+		}
+		return sim;
+	}
+}
+
+TEST(DecodeStats, AttributesDecodingTimeToFrames) {
+	DecodeStats stats;
+	EXPECT_EQ("0 frames", stats.dump());
+	stats.decoding(clockDur(Seconds(0.002)));
+	stats.decoding(clockDur(Seconds(0.003)));  // Same frame (e.g. the decoder needed more packets)
+	stats.frame(false);
+	stats.decoding(clockDur(Seconds(0.001)));
+	stats.converting(clockDur(Seconds(0.004)));
+	stats.frame(true);
+	EXPECT_EQ(2u, stats.frames());
+	EXPECT_EQ(1u, stats.degraded());
+	EXPECT_NEAR(0.005, stats.worst().count(), 1e-6);
+	EXPECT_NEAR(0.003, stats.average().count(), 1e-6);
+	EXPECT_EQ("2 frames, decode avg 3.00 ms, worst 5.00 ms, convert avg 2.00 ms, degraded: 1", stats.dump());
+}
+
+TEST(DecodeStats, DegradeLevelSteps) {
+	EXPECT_EQ(0u, degradeLevel(0, 0.05, levels));
+	EXPECT_EQ(1u, degradeLevel(0, 0.2, levels));
+	EXPECT_EQ(3u, degradeLevel(0, 3.0, levels));  // All the way at once
+	EXPECT_EQ(2u, degradeLevel(2, 0.05, levels));  // Still behind, keep the level
+	EXPECT_EQ(1u, degradeLevel(2, -0.1, levels));  // Caught up, one step better
+	EXPECT_EQ(0u, degradeLevel(1, 0.0, levels));
+	EXPECT_EQ(0u, degradeLevel(0, -1.0, levels));
+	EXPECT_EQ(2u, degradeLevel(2, getNaN(), levels));  // Nothing displayed
+	EXPECT_EQ(0u, degradeLevel(0, getNaN(), levels));
+}
+
+TEST(DecodeStats, KeepsUpWithoutLoad) {
+	Simulation sim = simulate(60.0, [](double) { return 0.5; });
+	EXPECT_EQ(0u, sim.stats.degraded());
+	EXPECT_EQ(0u, sim.maxLevel);
+}
+
+/// Decoding at full quality takes 1.5 frame durations for 20 seconds, then load ends
+TEST(DecodeStats, BenchDegradesUnderLoadAndRecovers) {
+	Simulation sim = simulate(60.0, [](double t) { return t < 20.0 ? 1.5 : 0.5; });
+	EXPECT_GT(sim.stats.degraded(), 0u);
+	EXPECT_GT(sim.maxLevel, 0u);
+	EXPECT_LT(sim.maxLag, 0.6);  // The skipping non-reference frames level suffices
+	EXPECT_EQ(0u, sim.level);  // Full quality after the load ended
+	bench::report("decode_frames", sim.stats.frames(), "frames");
+	bench::report("decode_degraded_frames", sim.stats.degraded(), "frames");
+	bench::report("decode_max_level", sim.maxLevel, "level");
+	bench::report("decode_max_lag_ms", 1e3 * sim.maxLag, "ms");
+	bench::report("decode_avg_ms", 1e3 * sim.stats.average().count(), "ms");
+	bench::report("decode_worst_ms", 1e3 * sim.stats.worst().count(), "ms");
+}
@@ -0,0 +1,71 @@
+#include "libda/fft.hpp"
+
+#include <gtest/gtest.h>
+#include <cmath>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+	/// Direct O(N^2) DFT of windowed real input, non-negative frequency bins only
+	std::vector<std::complex<double>> referenceDFT(std::vector<float> const& in, std::vector<float> const& window) {
+		std::size_t const n = in.size();
+		std::vector<std::complex<double>> out(n / 2 + 1);
+		for (std::size_t k = 0; k < out.size(); ++k) {
+			for (std::size_t i = 0; i < n; ++i) out[k] += double(in[i] * window[i]) * std::polar(1.0, -da::TAU * double(k * i % n) / n);
+		}
+		return out;
+	}
+
+	void compare(unsigned p, unsigned seed) {
+		std::size_t const n = std::size_t(1) << p;
+		std::mt19937 gen(seed);
+		std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+		std::vector<float> in(n), window(n);
+		for (auto& s: in) s = dist(gen);
+		for (std::size_t i = 0; i < n; ++i) window[i] = 0.53836 - 0.46164 * std::cos(da::TAU * i / (n - 1));  // Hamming, as in Analyzer
+		da::fft_plan plan(p);
+		ASSERT_EQ(n, plan.size());
+		ASSERT_EQ(n / 2 + 1, plan.bins());
+		std::vector<da::fft_plan::complex_t> out(plan.bins());
+		plan(in.data(), window.data(), out.data());
+		auto ref = referenceDFT(in, window);
+		double const tolerance = 1e-5 * std::sqrt(double(n));  // Single precision rounding grows with the size
+		for (std::size_t k = 0; k < ref.size(); ++k) {
+			EXPECT_NEAR(ref[k].real(), out[k].real(), tolerance) << "N = " << n << ", bin " << k;
+			EXPECT_NEAR(ref[k].imag(), out[k].imag(), tolerance) << "N = " << n << ", bin " << k;
+		}
+	}
+}
+
+TEST(FFTPlan, MatchesDirectDFT) {
+	for (unsigned p = 2; p <= 12; ++p) compare(p, p);
+}
+
+TEST(FFTPlan, PureTone) {
+	unsigned const p = 10, bin = 37;
+	std::size_t const n = std::size_t(1) << p;
+	std::vector<float> in(n), window(n, 1.0f);
+	for (std::size_t i = 0; i < n; ++i) in[i] = std::cos(da::TAU * bin * i / n);
+	da::fft_plan plan(p);
+	std::vector<da::fft_plan::complex_t> out(plan.bins());
+	plan(in.data(), window.data(), out.data());
+	for (std::size_t k = 0; k < out.size(); ++k) EXPECT_NEAR(k == bin ? n / 2.0 : 0.0, std::abs(out[k]), 1e-2) << "bin " << k;
+}
+
+TEST(FFTPlan, ReusedPlanGivesSameResult) {
+	unsigned const p = 9;
+	std::size_t const n = std::size_t(1) << p;
+	std::vector<float> a(n), b(n), window(n, 1.0f);
+	for (std::size_t i = 0; i < n; ++i) { a[i] = std::sin(0.1 * i); b[i] = std::sin(0.37 * i + 1.0); }
+	da::fft_plan plan(p);
+	std::vector<da::fft_plan::complex_t> first(plan.bins()), second(plan.bins());
+	plan(a.data(), window.data(), first.data());
+	plan(b.data(), window.data(), second.data());  // Must not be affected by the work buffer state
+	plan(a.data(), window.data(), second.data());
+	EXPECT_EQ(first, second);
+}
+
+TEST(FFTPlan, RejectsTooSmallSize) {
+	EXPECT_THROW(da::fft_plan(1), std::logic_error);
+}
@@ -0,0 +1,135 @@
+#include "hiscore.hh"
+
+#include "bench.hh"
+#include <gtest/gtest.h>
+#include <random>
+
+namespace {
+	/// The plain scan that Hiscore replaced with per song and per player buckets
+	struct ScanHiscore {
+		std::multiset<HiscoreItem> items;
+		bool reached(unsigned score, unsigned songid, std::string const& track) const {
+			if (score < 2000) return false;
+			unsigned position = 0;
+			for (auto const& elem: items) {
+				if (elem.songid != songid || elem.track != track) continue;
+				if (score > elem.score) return true;
+				if (++position == 3) return false;
+			}
+			return true;
+		}
+		void add(unsigned score, unsigned playerid, unsigned songid, std::string const& track) {
+			if (reached(score, songid, track)) items.insert(HiscoreItem(score, playerid, songid, track));
+		}
+		Hiscore::HiscoreVector query(unsigned max, unsigned playerid, unsigned songid, std::string const& track) const {
+			Hiscore::HiscoreVector hv;
+			for (auto const& h: items) {
+				if (playerid != unsigned(-1) && playerid != h.playerid) continue;
+				if (songid != unsigned(-1) && songid != h.songid) continue;
+				if (!track.empty() && track != h.track) continue;
+				if (--max == 0) break;
+				hv.push_back(h);
+			}
+			return hv;
+		}
+		bool has(unsigned songid) const {
+			for (auto const& h: items) if (songid == h.songid) return true;
+			return false;
+		}
+	};
+
+	bool same(Hiscore::HiscoreVector const& a, Hiscore::HiscoreVector const& b) {
+		if (a.size() != b.size()) return false;
+		for (std::size_t i = 0; i < a.size(); ++i) {
+			if (a[i].score != b[i].score || a[i].playerid != b[i].playerid || a[i].songid != b[i].songid || a[i].track != b[i].track) return false;
+		}
+		return true;
+	}
+
+	char const* const tracks[] = { "vocals", "guitar", "drums" };
+}
+
+TEST(Hiscore, KeepsTopThreePerSongAndTrack) {
+	Hiscore h;
+	EXPECT_FALSE(h.hasHiscore(1));
+	EXPECT_FALSE(h.reachedHiscore(1999, 1, "vocals"));
+	EXPECT_TRUE(h.reachedHiscore(2000, 1, "vocals"));
+	EXPECT_THROW(h.reachedHiscore(10001, 1, "vocals"), std::logic_error);
+	EXPECT_THROW(h.addHiscore(5000, 1, 1, ""), std::runtime_error);
+	h.addHiscore(5000, 1, 1, "vocals");
+	h.addHiscore(6000, 2, 1, "vocals");
+	h.addHiscore(7000, 3, 1, "vocals");
+	EXPECT_TRUE(h.hasHiscore(1));
+	EXPECT_FALSE(h.reachedHiscore(5000, 1, "vocals"));
+	EXPECT_TRUE(h.reachedHiscore(5001, 1, "vocals"));
+	EXPECT_TRUE(h.reachedHiscore(2000, 1, "guitar"));  // Other track
+	EXPECT_TRUE(h.reachedHiscore(2000, 2, "vocals"));  // Other song
+	h.addHiscore(4000, 4, 1, "vocals");  // Not in top 3, ignored
+	EXPECT_EQ(3u, h.size());
+	auto hv = h.queryHiscore(10, -1, 1, "vocals");
+	ASSERT_EQ(3u, hv.size());
+	EXPECT_EQ(7000u, hv[0].score);
+	EXPECT_EQ(5000u, hv[2].score);
+	hv = h.queryHiscore(10, 2, -1, std::string());
+	ASSERT_EQ(1u, hv.size());
+	EXPECT_EQ(6000u, hv[0].score);
+}
+
+/// Loading (a series of addHiscore) and then adding more, with queries in between, against the plain scan
+TEST(Hiscore, MatchesScanAfterLoadAndAdds) {
+	std::mt19937 rng(1234);
+	Hiscore h;
+	ScanHiscore ref;
+	auto add = [&] {
+		unsigned score = 1500 + rng() % 8500, player = rng() % 20, song = rng() % 300;
+		std::string track = tracks[rng() % 3];
+		h.addHiscore(score, player, song, track);
+		ref.add(score, player, song, track);
+	};
+	for (int i = 0; i < 3000; ++i) add();  // As Hiscore::load does
+	ASSERT_EQ(ref.items.size(), h.size());
+	for (int i = 0; i < 3000; ++i) {
+		add();
+		unsigned song = rng() % 310, player = rng() % 22, score = 1500 + rng() % 8500;
+		std::string track = (rng() % 4 ? tracks[rng() % 3] : "");
+		unsigned max = 1 + rng() % 20;
+		ASSERT_EQ(ref.reached(score, song, tracks[0]), h.reachedHiscore(score, song, tracks[0]));
+		ASSERT_EQ(ref.has(song), h.hasHiscore(song));
+		ASSERT_TRUE(same(ref.query(max, -1, song, track), h.queryHiscore(max, -1, song, track)));
+		ASSERT_TRUE(same(ref.query(max, player, -1, track), h.queryHiscore(max, player, -1, track)));
+		ASSERT_TRUE(same(ref.query(max, player, song, track), h.queryHiscore(max, player, song, track)));
+		ASSERT_TRUE(same(ref.query(max, -1, -1, track), h.queryHiscore(max, -1, -1, track)));
+	}
+	EXPECT_EQ(ref.items.size(), h.size());
+}
+
+/// Per song queries as the song browser does every frame, with a large hiscore list
+TEST(Hiscore, BenchPerSongQueries) {
+	std::mt19937 rng(42);
+	Hiscore h;
+	ScanHiscore ref;
+	for (int i = 0; i < 20000; ++i) {
+		unsigned score = 2000 + rng() % 8001, player = rng() % 50, song = rng() % 5000;
+		std::string track = tracks[rng() % 3];
+		h.addHiscore(score, player, song, track);
+		ref.add(score, player, song, track);
+	}
+	unsigned const queries = 2000;
+	std::size_t found = 0, foundRef = 0;
+	double indexed = bench::seconds([&] {
+		for (unsigned i = 0; i < queries; ++i) {
+			found += h.queryHiscore(4, -1, i % 5000, "vocals").size();
+			found += h.reachedHiscore(5000, i % 5000, "vocals");
+		}
+	}) / queries;
+	double scan = bench::seconds([&] {
+		for (unsigned i = 0; i < queries; ++i) {
+			foundRef += ref.query(4, -1, i % 5000, "vocals").size();
+			foundRef += ref.reached(5000, i % 5000, "vocals");
+		}
+	}) / queries;
+	EXPECT_EQ(foundRef, found);
+	bench::report("hiscore_entries", h.size(), "hiscores");
+	bench::report("hiscore_song_query_indexed_us", 1e6 * indexed, "us");
+	bench::report("hiscore_song_query_scan_us", 1e6 * scan, "us");
+}
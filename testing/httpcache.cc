@@ -0,0 +1,95 @@
+#include "httpcache.hh"
+
+#include "bench.hh"
+#include <gtest/gtest.h>
+#include <random>
+#include <zlib.h>
+
+namespace {
+	/// Decompress gzip data, as a client would
+	std::string gunzip(std::vector<unsigned char> const& data) {
+		z_stream z = {};
+		if (inflateInit2(&z, 15 + 16) != Z_OK) throw std::runtime_error("inflateInit2");
+		std::string out(1 << 20, '\0');
+		z.next_in = const_cast<Bytef*>(data.data());
+		z.avail_in = data.size();
+		z.next_out = reinterpret_cast<Bytef*>(&out[0]);
+		z.avail_out = out.size();
+		int ret = inflate(&z, Z_FINISH);
+		out.resize(z.total_out);
+		inflateEnd(&z);
+		if (ret != Z_STREAM_END) throw std::runtime_error("inflate");
+		return out;
+	}
+
+	std::string json(unsigned songs) {
+		std::string s = "[";
+		for (unsigned i = 0; i < songs; ++i) s += (i ? "," : "") + std::string("{\"Title\":\"Song ") + std::to_string(i) + "\",\"Artist\":\"Artist " + std::to_string(i % 97) + "\",\"Language\":\"English\"}";
+		return s + "]";
+	}
+}
+
+TEST(HttpCache, GzipRoundTrip) {
+	std::string body = json(1000);
+	auto fast = httpcache::gzip(body, Z_DEFAULT_COMPRESSION);
+	auto best = httpcache::gzip(body, Z_BEST_COMPRESSION);
+	ASSERT_FALSE(fast.empty());
+	ASSERT_FALSE(best.empty());
+	EXPECT_LT(fast.size(), body.size() / 4);
+	EXPECT_EQ(body, gunzip(fast));
+	EXPECT_EQ(body, gunzip(best));
+	EXPECT_EQ("", gunzip(httpcache::gzip("", Z_DEFAULT_COMPRESSION)));
+	EXPECT_TRUE(httpcache::gzip(body, 42).empty());  // Invalid level
+}
+
+TEST(HttpCache, Etag) {
+	std::string tag = httpcache::etag("body");
+	EXPECT_EQ('"', tag.front());
+	EXPECT_EQ('"', tag.back());
+	EXPECT_EQ(tag, httpcache::etag("body"));  // Stable
+	EXPECT_NE(tag, httpcache::etag("body2"));
+	std::string gz = httpcache::etag("body", "-gz");
+	EXPECT_NE(tag, gz);
+	EXPECT_EQ(tag.substr(0, tag.size() - 1) + "-gz\"", gz);
+}
+
+TEST(HttpCache, AcceptsGzip) {
+	EXPECT_TRUE(httpcache::acceptsGzip("gzip"));
+	EXPECT_TRUE(httpcache::acceptsGzip("gzip, deflate, br"));
+	EXPECT_TRUE(httpcache::acceptsGzip("deflate,gzip;q=0.5"));
+	EXPECT_TRUE(httpcache::acceptsGzip("*"));
+	EXPECT_TRUE(httpcache::acceptsGzip("x-gzip"));
+	EXPECT_FALSE(httpcache::acceptsGzip(""));
+	EXPECT_FALSE(httpcache::acceptsGzip("identity"));
+	EXPECT_FALSE(httpcache::acceptsGzip("gzip;q=0"));
+	EXPECT_FALSE(httpcache::acceptsGzip("gzip ; q=0.0, deflate"));
+	EXPECT_FALSE(httpcache::acceptsGzip("notgzip"));
+}
+
+TEST(HttpCache, EtagMatches) {
+	std::string tag = httpcache::etag("body");
+	EXPECT_TRUE(httpcache::etagMatches(tag, tag));
+	EXPECT_TRUE(httpcache::etagMatches("\"x\", " + tag, tag));
+	EXPECT_TRUE(httpcache::etagMatches(" " + tag + " ,\"x\"", tag));
+	EXPECT_TRUE(httpcache::etagMatches("W/" + tag, tag));
+	EXPECT_TRUE(httpcache::etagMatches("*", tag));
+	EXPECT_FALSE(httpcache::etagMatches("", tag));
+	EXPECT_FALSE(httpcache::etagMatches(httpcache::etag("body", "-gz"), tag));
+	EXPECT_FALSE(httpcache::etagMatches(tag.substr(1, tag.size() - 2), tag));  // Unquoted
+}
+
+TEST(HttpCache, BenchResponse) {
+	std::string body = json(20000);
+	std::vector<unsigned char> fast, best;
+	double tFast = bench::seconds([&] { fast = httpcache::gzip(body, Z_DEFAULT_COMPRESSION); });
+	double tBest = bench::seconds([&] { best = httpcache::gzip(body, Z_BEST_COMPRESSION); });
+	std::string tag;
+	double tEtag = bench::seconds([&] { tag = httpcache::etag(body); });
+	EXPECT_FALSE(tag.empty());
+	bench::report("http_body_bytes", double(body.size()), "bytes");
+	bench::report("http_gzip_default_bytes", double(fast.size()), "bytes");
+	bench::report("http_gzip_default_ms", 1e3 * tFast, "ms");
+	bench::report("http_gzip_best_bytes", double(best.size()), "bytes");
+	bench::report("http_gzip_best_ms", 1e3 * tBest, "ms");
+	bench::report("http_etag_ms", 1e3 * tEtag, "ms");
+}
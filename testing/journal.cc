@@ -0,0 +1,155 @@
+#include "journal.hh"
+
+#include "bench.hh"
+#include <boost/filesystem.hpp>
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <fstream>
+#include <memory>
+#include <sstream>
+
+namespace {
+	/// A journal file in a directory of its own, removed afterwards
+	struct TempJournal {
+		fs::path dir = fs::temp_directory_path() / fs::unique_path("performous-journal-%%%%-%%%%");
+		fs::path file = dir / "database.journal";
+		TempJournal() { fs::create_directories(dir); }
+		~TempJournal() { fs::remove_all(dir); }
+		std::string contents() const {
+			std::ifstream in(file.string(), std::ios::binary);
+			std::ostringstream ss;
+			ss << in.rdbuf();
+			return ss.str();
+		}
+		void write(std::string const& data) const { std::ofstream(file.string(), std::ios::binary) << data; }
+	};
+	std::vector<Journal::Fields> replayAll(fs::path const& file, Journal::Seq after, Journal::Seq* seq = nullptr) {
+		std::vector<Journal::Fields> records;
+		Journal j(file, after, [&](Journal::Fields const& f) { records.push_back(f); });
+		if (seq) *seq = j.seq();
+		return records;
+	}
+}
+
+TEST(Journal, ReplaysRecordsAfterSeq) {
+	TempJournal tmp;
+	{
+		Journal j(tmp.file, 10, [](Journal::Fields const&) { FAIL() << "Nothing to replay"; });
+		EXPECT_EQ(11u, j.append({ "player", "1", "Alice" }));
+		EXPECT_EQ(12u, j.append({ "player", "2", "Bob" }));
+		EXPECT_EQ(13u, j.append({ "hiscore", "9000", "1", "5", "vocals" }));
+		EXPECT_EQ(3u, j.size());
+	}
+	Journal::Seq seq;
+	auto records = replayAll(tmp.file, 11, &seq);  // The first one is already in the xml
+	ASSERT_EQ(2u, records.size());
+	EXPECT_EQ((Journal::Fields{ "player", "2", "Bob" }), records[0]);
+	EXPECT_EQ((Journal::Fields{ "hiscore", "9000", "1", "5", "vocals" }), records[1]);
+	EXPECT_EQ(13u, seq);
+	EXPECT_TRUE(replayAll(tmp.file, 13).empty());
+}
+
+TEST(Journal, IgnoresTornLastLine) {
+	TempJournal tmp;
+	tmp.write("1\tplayer\t1\tAlice\n2\tplayer\t2\tBo");  // Crashed while writing the second record
+	{
+		Journal::Seq seq;
+		auto records = replayAll(tmp.file, 0, &seq);
+		ASSERT_EQ(1u, records.size());
+		EXPECT_EQ(1u, seq);
+	}
+	EXPECT_EQ("1\tplayer\t1\tAlice\n", tmp.contents());  // Partial record removed, so that appending works
+	{
+		Journal j(tmp.file, 0, [](Journal::Fields const&) {});
+		EXPECT_EQ(2u, j.append({ "player", "2", "Bob" }));
+	}
+	EXPECT_EQ(2u, replayAll(tmp.file, 0).size());
+}
+
+TEST(Journal, IgnoresMalformedAndFailingRecords) {
+	TempJournal tmp;
+	tmp.write("1\tbad\nnot a number\tx\n2\tgood\n");
+	std::vector<std::string> replayed;
+	Journal j(tmp.file, 0, [&](Journal::Fields const& f) {
+		if (f.at(0) == "bad") throw std::runtime_error("Unknown record type");
+		replayed.push_back(f.at(0));
+	});
+	EXPECT_EQ(std::vector<std::string>{ "good" }, replayed);
+	EXPECT_EQ(2u, j.seq());
+}
+
+TEST(Journal, DropRewritesFile) {
+	TempJournal tmp;
+	{
+		Journal j(tmp.file, 0, [](Journal::Fields const&) {});
+		for (int i = 1; i <= 5; ++i) j.append({ "song", std::to_string(i) });
+		j.drop(3);  // Records up to 3 are now in the xml
+		EXPECT_EQ(2u, j.size());
+		j.drop(2);  // Going back does nothing
+		EXPECT_EQ(2u, j.size());
+		j.append({ "song", "6" });
+	}
+	EXPECT_EQ("4\tsong\t4\n5\tsong\t5\n6\tsong\t6\n", tmp.contents());
+	EXPECT_FALSE(fs::exists(tmp.file.string() + ".tmp"));
+	Journal::Seq seq;
+	auto records = replayAll(tmp.file, 3, &seq);
+	ASSERT_EQ(3u, records.size());
+	EXPECT_EQ("4", records[0].at(1));
+	EXPECT_EQ(6u, seq);
+}
+
+TEST(Journal, EscapesSeparators) {
+	TempJournal tmp;
+	Journal::Fields fields{ "tab\there", "new\nline", "back\\slash", "\\t literal", "", "trailing\\" };
+	{
+		Journal j(tmp.file, 0, [](Journal::Fields const&) {});
+		j.append(fields);
+	}
+	std::string contents = tmp.contents();
+	EXPECT_EQ(1, std::count(contents.begin(), contents.end(), '\n'));  // One line
+	auto records = replayAll(tmp.file, 0);
+	ASSERT_EQ(1u, records.size());
+	EXPECT_EQ(fields, records[0]);
+}
+
+/**
+* Appending a hiscore to the journal against what saving did before it: writing the whole database as xml.
+* The xml is built as text like libxml++ formats it (libxml++ is not needed for the tests) and written to a
+* temporary file that replaces the old one, as Database::save does.
+**/
+TEST(Journal, BenchAgainstXmlSave) {
+	TempJournal tmp;
+	unsigned const records = 1000;  // Hiscores already in the database
+	unsigned const changes = 50;
+	std::string xml = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<performous>\n  <hiscores>\n";
+	for (unsigned i = 0; i < records; ++i) xml += "    <hiscore score=\"" + std::to_string(5000 + i) + "\" playerid=\"" + std::to_string(i % 10) + "\" songid=\"" + std::to_string(i) + "\" track=\"vocals\"/>\n";
+	xml += "  </hiscores>\n</performous>\n";
+	fs::path xmlFile = tmp.dir / "database.xml";
+	double xmlSave = bench::seconds([&] {
+		for (unsigned i = 0; i < changes; ++i) {
+			fs::path tmpFile = xmlFile.string() + ".tmp";
+			std::ofstream(tmpFile.string(), std::ios::binary) << xml;
+			fs::rename(tmpFile, xmlFile);
+		}
+	}) / changes;
+	double append = 0.0;
+	auto j = std::make_unique<Journal>(tmp.file, 0, [](Journal::Fields const&) {});
+	double durable = bench::seconds([&] {
+		append = bench::seconds([&] {
+			for (unsigned i = 0; i < changes; ++i) j->append({ "hiscore", std::to_string(9000 + i), "1", std::to_string(i), "vocals" });
+		}) / changes;
+		j.reset();  // Waits until everything is written and synced
+	}) / changes;
+	// Startup: replaying the longest journal that is left before compaction (Database COMPACT_RECORDS)
+	{
+		Journal j(tmp.file, 0, [](Journal::Fields const&) {});
+		for (unsigned i = changes; i < 100; ++i) j.append({ "hiscore", std::to_string(9000 + i), "1", std::to_string(i), "vocals" });
+	}
+	unsigned replayed = 0;
+	double replay = bench::seconds([&] { Journal j(tmp.file, 0, [&](Journal::Fields const&) { ++replayed; }); });
+	EXPECT_EQ(100u, replayed);
+	bench::report("journal_append_us", 1e6 * append, "us");
+	bench::report("journal_append_until_synced_us", 1e6 * durable, "us");
+	bench::report("xml_save_per_change_us", 1e6 * xmlSave, "us");
+	bench::report("journal_replay_100_records_us", 1e6 * replay, "us");
+}
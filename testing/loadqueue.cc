@@ -0,0 +1,144 @@
+#include "loadqueue.hh"
+
+#include "bench.hh"
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <limits>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+	/// Stand-in for Bitmap
+	struct Image {
+		std::vector<unsigned char> buf;
+	};
+	std::size_t bytes(Image const& img) { return img.buf.size(); }
+	/// Pretends to decode an image whose size in bytes is given by the file name
+	void decode(Image& img, fs::path const& name) { img.buf.assign(std::stoul(name.string()), 0x42); }
+	/// Apply until count jobs have been applied (waiting for the workers as needed)
+	void applyAll(LoadQueue<Image>& queue, std::vector<std::size_t> const& applied, std::size_t count) {
+		for (unsigned i = 0; applied.size() < count && i < 5000; ++i) {
+			queue.apply(std::numeric_limits<std::size_t>::max(), bytes);
+			std::this_thread::sleep_for(1ms);
+		}
+		ASSERT_EQ(count, applied.size());
+	}
+	/// Wait until loaded reaches count
+	void waitLoaded(std::atomic<unsigned> const& loaded, unsigned count) {
+		for (unsigned i = 0; loaded < count && i < 5000; ++i) std::this_thread::sleep_for(1ms);
+		ASSERT_EQ(count, loaded.load());
+	}
+}
+
+TEST(LoadQueue, AppliesWithinTheBudget) {
+	std::atomic<unsigned> loaded{ 0 };
+	LoadQueue<Image> queue([&loaded](Image& img, fs::path const& name) { decode(img, name); ++loaded; }, 2);
+	std::vector<int> targets(11);
+	std::vector<std::size_t> applied;
+	auto record = [&applied](Image& img) { applied.push_back(img.buf.size()); };
+	for (unsigned i = 0; i < 10; ++i) queue.push(&targets[i], "1048576", record);
+	waitLoaded(loaded, 10);
+	EXPECT_TRUE(queue.pending(&targets[0]));
+	EXPECT_EQ(4u << 20, queue.apply(4 << 20, bytes));
+	EXPECT_EQ(4u, applied.size());
+	EXPECT_EQ(3u << 20, queue.apply(3 << 20, bytes));
+	EXPECT_EQ(3u << 20, queue.apply(5 << 19, bytes));  // The last one applied may exceed the budget
+	EXPECT_EQ(10u, applied.size());
+	queue.push(&targets[10], "5242880", record);
+	waitLoaded(loaded, 11);
+	EXPECT_EQ(5u << 20, queue.apply(4 << 20, bytes));  // Larger than the budget but applied, not stuck forever
+	EXPECT_EQ(0u, queue.apply(4 << 20, bytes));
+	EXPECT_EQ(11u, applied.size());
+	for (auto& t: targets) EXPECT_FALSE(queue.pending(&t));
+}
+
+TEST(LoadQueue, LoadsHighestPriorityFirst) {
+	std::mutex mutex;
+	std::condition_variable cond;
+	bool open = false;
+	std::atomic<unsigned> started{ 0 }, loaded{ 0 };
+	LoadQueue<Image> queue([&](Image& img, fs::path const& name) {
+		++started;
+		if (name == "0") {  // Hold the only worker until everything else is queued
+			std::unique_lock<std::mutex> l(mutex);
+			cond.wait(l, [&] { return open; });
+		}
+		img.buf.assign(1, static_cast<unsigned char>(std::stoul(name.string())));
+		++loaded;
+	}, 1);
+	int targets[5];
+	std::vector<std::size_t> applied;
+	auto record = [&applied](Image& img) { applied.push_back(img.buf[0]); };
+	queue.push(&targets[0], "0", record);
+	waitLoaded(started, 1);  // The worker has taken it
+	for (int i = 1; i < 5; ++i) queue.push(&targets[i], std::to_string(i), record);
+	queue.prioritize(&targets[3], 2);
+	queue.prioritize(&targets[1], 1);
+	queue.prioritize(&targets[4], -1);
+	{
+		std::lock_guard<std::mutex> l(mutex);
+		open = true;
+	}
+	cond.notify_all();
+	waitLoaded(loaded, 5);
+	applyAll(queue, applied, 5);
+	EXPECT_EQ((std::vector<std::size_t>{ 0, 3, 1, 2, 4 }), applied);
+}
+
+TEST(LoadQueue, DropsCancelledAndReplacedJobs) {
+	std::atomic<unsigned> loaded{ 0 };
+	LoadQueue<Image> queue([&loaded](Image& img, fs::path const& name) { decode(img, name); ++loaded; }, 2);
+	int a, b, c;
+	std::vector<std::size_t> applied;
+	auto record = [&applied](Image& img) { applied.push_back(img.buf.size()); };
+	queue.push(&a, "10", record);
+	queue.push(&b, "20", record);
+	queue.push(&b, "30", record);  // Replaces the previous job, whether it was loaded already or not
+	queue.push(&c, "40", record);
+	queue.remove(&c);
+	EXPECT_FALSE(queue.pending(&c));
+	EXPECT_TRUE(queue.pending(&a));
+	applyAll(queue, applied, 2);
+	std::sort(applied.begin(), applied.end());
+	EXPECT_EQ((std::vector<std::size_t>{ 10, 30 }), applied);
+	queue.apply(std::numeric_limits<std::size_t>::max(), bytes);
+	EXPECT_EQ(2u, applied.size());
+	queue.remove(&a);  // Already applied
+}
+
+/// Uploads of a screenful of song covers all completing together: per-frame upload with the budget that
+/// TextureLoader uses and without any, the upload being a copy to a preallocated buffer standing in for the GPU
+TEST(LoadQueue, BenchUploadBudget) {
+	unsigned const covers = 100;
+	std::size_t const size = 512 * 384 * 4;  // 768 KiB RGBA
+	std::vector<unsigned char> gpu(size);
+	for (std::size_t budget: { std::size_t(4) << 20, std::numeric_limits<std::size_t>::max() }) {
+		std::atomic<unsigned> loaded{ 0 };
+		LoadQueue<Image> queue([&loaded](Image& img, fs::path const& name) { decode(img, name); ++loaded; }, 2);
+		std::vector<int> targets(covers);
+		unsigned uploaded = 0;
+		for (auto& t: targets) queue.push(&t, std::to_string(size), [&gpu, &uploaded](Image& img) {
+			std::memcpy(gpu.data(), img.buf.data(), img.buf.size());
+			++uploaded;
+		});
+		waitLoaded(loaded, covers);
+		unsigned frames = 0;
+		std::size_t maxBytes = 0;
+		double worst = 0.0;
+		while (uploaded < covers) {
+			std::size_t used = 0;
+			worst = std::max(worst, bench::seconds([&] { used = queue.apply(budget, bytes); }));
+			maxBytes = std::max(maxBytes, used);
+			++frames;
+		}
+		std::string name = std::string("upload_") + (budget == std::numeric_limits<std::size_t>::max() ? "unbudgeted" : "budget_4MiB");
+		bench::report(name + "_frames", frames, "frames");
+		bench::report(name + "_max_per_frame", maxBytes / 1048576.0, "MiB");
+		bench::report(name + "_worst_frame", 1e3 * worst, "ms");
+	}
+}
@@ -0,0 +1,122 @@
+#include "logqueue.hh"
+
+#include "bench.hh"
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+	/**
+	* Producers logging as fast as they can, either through the queue and a writer thread that writes batches
+	* (as Logger does) or by writing each message under a lock (as Logger did before). Reports messages per
+	* second and the mean and worst time that a caller spends handing over one message.
+	**/
+	void benchLogging(bool queued, unsigned producers) {
+		unsigned const count = 20000;  // Per producer
+		std::ofstream sink("/dev/null");
+		std::mutex mutex;
+		LogQueue<4096> queue;
+		std::atomic<bool> quit{ false };
+		std::thread writer;
+		if (queued) writer = std::thread([&] {
+			while (true) {
+				bool last = quit;  // Read before draining, so that nothing is left behind
+				std::string batch;
+				while (queue.pop(batch) && batch.size() < 1 << 16) {}
+				if (!batch.empty()) sink << batch << std::flush;
+				else if (last) return;
+				else std::this_thread::yield();
+			}
+		});
+		std::vector<double> total(producers), worst(producers);
+		std::vector<std::thread> threads;
+		double elapsed = bench::seconds([&] {
+			for (unsigned p = 0; p < producers; ++p) {
+				threads.emplace_back([&, p] {
+					for (unsigned i = 0; i < count; ++i) {
+						std::string msg = "bench/info: message " + std::to_string(i) + " from producer " + std::to_string(p) + "\n";
+						double t = bench::seconds([&] {
+							if (!queued) {
+								std::lock_guard<std::mutex> l(mutex);
+								sink << msg << std::flush;
+								return;
+							}
+							while (!queue.push(msg)) std::this_thread::yield();  // Flooded: wait for the writer
+						});
+						total[p] += t;
+						worst[p] = std::max(worst[p], t);
+					}
+				});
+			}
+			for (auto& t: threads) t.join();
+			quit = true;
+			if (writer.joinable()) writer.join();
+		});
+		std::string name = std::string("log_") + (queued ? "queued_" : "locked_") + std::to_string(producers) + "_producers_";
+		double sum = 0.0;
+		for (double t: total) sum += t;
+		bench::report(name + "rate", producers * count / elapsed, "messages/s");
+		bench::report(name + "call_mean", 1e6 * sum / (producers * count), "us");
+		bench::report(name + "call_worst", 1e6 * *std::max_element(worst.begin(), worst.end()), "us");
+	}
+}
+
+TEST(LogQueue, FifoAndFull) {
+	LogQueue<4> queue;
+	for (int i = 0; i < 4; ++i) {
+		std::string msg = std::to_string(i) + "\n";
+		EXPECT_TRUE(queue.push(msg));
+	}
+	std::string msg = "4\n";
+	EXPECT_FALSE(queue.push(msg));
+	EXPECT_EQ("4\n", msg);  // Left for the caller
+	std::string out;
+	while (queue.pop(out)) {}
+	EXPECT_EQ("0\n1\n2\n3\n", out);
+	EXPECT_TRUE(queue.push(msg));  // Room again
+}
+
+TEST(LogQueue, ConcurrentProducers) {
+	LogQueue<64> queue;
+	unsigned const producers = 4, count = 20000;
+	std::vector<std::thread> threads;
+	for (unsigned p = 0; p < producers; ++p) {
+		threads.emplace_back([&queue, p] {
+			for (unsigned i = 0; i < count; ++i) {
+				std::string msg = std::to_string(p) + " " + std::to_string(i) + "\n";
+				while (!queue.push(msg)) std::this_thread::yield();
+			}
+		});
+	}
+	// Every message must arrive exactly once, and in order per producer
+	std::vector<unsigned> next(producers);
+	unsigned received = 0;
+	std::string out;
+	while (received < producers * count) {
+		out.clear();
+		if (!queue.pop(out)) { std::this_thread::yield(); continue; }
+		std::istringstream iss(out);
+		unsigned p, i;
+		ASSERT_TRUE(iss >> p >> i) << out;
+		ASSERT_LT(p, producers);
+		ASSERT_EQ(next[p], i) << "producer " << p;
+		++next[p];
+		++received;
+	}
+	for (auto& t: threads) t.join();
+	EXPECT_FALSE(queue.pop(out));
+}
+
+TEST(LogQueue, BenchThroughputAndLatency) {
+	bench::report("hardware_threads", std::thread::hardware_concurrency(), "threads");
+	for (unsigned producers: { 1u, 4u }) {
+		benchLogging(true, producers);
+		benchLogging(false, producers);
+	}
+}
@@ -0,0 +1,97 @@
+#include "controllers-midi.hh"
+
+#include "bench.hh"
+#include <gtest/gtest.h>
+#include <thread>
+
+using namespace input;
+
+TEST(Midi, ClockMapsTimestampsToGameTime) {
+	Time base = Clock::now();
+	MidiClock clock(base);
+	EXPECT_EQ(0, clock.timestamp(base));
+	EXPECT_EQ(1500, clock.timestamp(base + 1500ms));
+	EXPECT_EQ(base + 1500ms, clock.time(1500));
+	// Sub-millisecond arrival times are truncated, never moved later
+	Time arrival = base + 2ms + 700us;
+	EXPECT_EQ(base + 2ms, clock.time(clock.timestamp(arrival)));
+}
+
+TEST(Midi, DecodesNoteOnAndOff) {
+	Event ev;
+	ASSERT_TRUE(decodeMidi(0x7F2699, 3, ev));  // NOTE ON, channel 10, note 38, velocity 127
+	EXPECT_EQ(SOURCETYPE_MIDI, ev.source.type);
+	EXPECT_EQ(3u, ev.source.device);
+	EXPECT_EQ(10u, ev.source.channel);
+	EXPECT_EQ(38u, ev.hw);
+	EXPECT_DOUBLE_EQ(1.0, ev.value);
+	ASSERT_TRUE(decodeMidi(0x402689, 3, ev));  // NOTE OFF with release velocity
+	EXPECT_EQ(38u, ev.hw);
+	EXPECT_FALSE(ev.pressed());
+	ASSERT_TRUE(decodeMidi(0x002699, 3, ev));  // NOTE ON with zero velocity
+	EXPECT_FALSE(ev.pressed());
+	EXPECT_FALSE(decodeMidi(0x7F07B0, 3, ev));  // Control change
+}
+
+TEST(Midi, QueueCountsDroppedEvents) {
+	MidiQueue queue;
+	Event ev;
+	for (unsigned i = 0; i < 1024; ++i) EXPECT_TRUE(queue.push(ev));
+	EXPECT_FALSE(queue.push(ev));
+	EXPECT_FALSE(queue.push(ev));
+	EXPECT_EQ(2u, queue.dropped());
+	EXPECT_EQ(0u, queue.dropped());
+}
+
+TEST(Midi, QueueKeepsTimeAndDelayStatistics) {
+	MidiQueue queue;
+	Time t = Clock::now();
+	Event in;
+	ASSERT_TRUE(decodeMidi(0x402699, 1, in));
+	in.time = t;
+	queue.push(in);
+	in.time = t + 4ms;
+	queue.push(in);
+	Event out;
+	ASSERT_TRUE(queue.pop(out, t + 6ms));
+	EXPECT_EQ(t, out.time);
+	EXPECT_EQ(10u, out.source.channel);
+	ASSERT_TRUE(queue.pop(out, t + 6ms));
+	EXPECT_EQ(t + 4ms, out.time);
+	EXPECT_FALSE(queue.pop(out, t + 6ms));
+	EXPECT_EQ(2u, queue.events());
+	EXPECT_NEAR(0.004, queue.delayAvg(), 1e-9);
+	EXPECT_NEAR(0.006, queue.delayMax(), 1e-9);
+}
+
+/// Input thread stamping events as they arrive every millisecond, main thread consuming them once per frame
+TEST(Midi, BenchTimestampJitterAndDeliveryDelay) {
+	unsigned const count = 300;
+	MidiClock const clock;
+	MidiQueue queue;
+	double jitterMax = 0.0;  // Difference between arrival and the mapped timestamp
+	std::thread input([&] {
+		for (unsigned i = 0; i < count; ++i) {
+			Time arrival = Clock::now();
+			Event ev;
+			decodeMidi(0x7F2699, 0, ev);
+			ev.time = clock.time(clock.timestamp(arrival));
+			jitterMax = std::max(jitterMax, Seconds(arrival - ev.time).count());
+			queue.push(ev);
+			std::this_thread::sleep_for(1ms);
+		}
+	});
+	Event ev;
+	for (unsigned received = 0; received < count; ) {
+		std::this_thread::sleep_for(5ms);  // Frame period
+		while (queue.pop(ev)) ++received;
+	}
+	input.join();
+	EXPECT_EQ(0u, queue.dropped());
+	EXPECT_EQ(count, queue.events());
+	EXPECT_GE(jitterMax, 0.0);
+	EXPECT_LT(jitterMax, 0.001);  // Millisecond resolution of PortMidi timestamps
+	bench::report("midi_timestamp_error_max_ms", 1e3 * jitterMax, "ms");
+	bench::report("midi_delivery_delay_avg_ms", 1e3 * queue.delayAvg(), "ms");
+	bench::report("midi_delivery_delay_max_ms", 1e3 * queue.delayMax(), "ms");
+}
@@ -0,0 +1,157 @@
+#include "libda/mix.hpp"
+
+#include "bench.hh"
+#include <gtest/gtest.h>
+#include <limits>
+#include <random>
+#include <vector>
+
+namespace {
+	/// The per-frame fade loop that accumulate_fade_stereo replaces (returns false when faded out)
+	bool referenceFade(std::vector<float>& out, std::vector<float> const& in, float gain, double& level, double& rate) {
+		for (std::size_t i = 0; i < in.size(); ++i) {
+			if (i % 2 == 0) {
+				level += rate;
+				if (level <= 0.0) return false;
+				if (level > 1.0) { level = 1.0; rate = 0.0; }
+			}
+			out[i] += in[i] * level * gain;
+		}
+		return true;
+	}
+
+	std::vector<float> noise(std::size_t n) {
+		std::mt19937 gen(42);
+		std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+		std::vector<float> v(n);
+		for (auto& s: v) s = dist(gen);
+		return v;
+	}
+
+	/// Run the kernel and the reference on the same input and compare the results
+	void compareFade(double level, double rate, std::size_t frames = 128) {
+		std::vector<float> in = noise(2 * frames), out(2 * frames), ref(2 * frames);
+		double refLevel = level, refRate = rate;
+		bool refMore = referenceFade(ref, in, 0.5f, refLevel, refRate);
+		std::size_t mixed = da::accumulate_fade_stereo(out.data(), in.data(), frames, 0.5f, level, rate);
+		EXPECT_EQ(refMore, mixed == frames);
+		if (refMore) {
+			EXPECT_DOUBLE_EQ(refLevel, level);
+			EXPECT_EQ(refRate, rate);
+		} else {
+			EXPECT_LE(level, 0.0);
+		}
+		for (std::size_t i = 0; i < 2 * mixed; ++i) EXPECT_NEAR(ref[i], out[i], 1e-5f) << "sample " << i;
+		for (std::size_t i = 2 * mixed; i < out.size(); ++i) EXPECT_EQ(0.0f, out[i]) << "sample " << i;
+	}
+}
+
+TEST(MixTest, FadeOutInstantly) {
+	compareFade(1.0, -std::numeric_limits<double>::infinity());
+}
+
+TEST(MixTest, FadeInInstantly) {
+	compareFade(0.0, std::numeric_limits<double>::infinity());
+}
+
+TEST(MixTest, FadeOutEndsInsideBlock) {
+	compareFade(1.0, -1.0 / 100.0);
+	compareFade(0.3, -0.1);
+}
+
+TEST(MixTest, FadeOutEndsAtFirstFrame) {
+	compareFade(0.01, -0.01);
+}
+
+TEST(MixTest, FadeOutContinuesPastBlock) {
+	compareFade(1.0, -1.0 / 1000.0);
+}
+
+TEST(MixTest, FadeIn) {
+	compareFade(0.0, 1.0 / 50.0);
+	compareFade(0.5, 1.0 / 1000.0);
+	compareFade(0.95, 0.1);
+}
+
+TEST(MixTest, ConstantLevel) {
+	compareFade(0.7, 0.0);
+}
+
+TEST(MixTest, SilentStreamEnds) {
+	compareFade(0.0, 0.0);
+}
+
+TEST(MixTest, AccumulateS16) {
+	std::vector<std::int16_t> in = { 0, 32767, -32768, 1000, -1000 };
+	std::vector<float> out(in.size(), 1.0f);
+	da::accumulate_s16(out.data(), in.data(), in.size(), 2.0f);
+	for (std::size_t i = 0; i < in.size(); ++i) EXPECT_NEAR(1.0f + 2.0f * in[i] / 32767.0f, out[i], 1e-6f);
+}
+
+TEST(MixTest, SuppressCenter) {
+	std::vector<float> buf = { 1.0f, 1.0f, 0.5f, -0.5f };
+	da::suppress_center_stereo(buf.data(), 2);
+	EXPECT_EQ((std::vector<float>{ 0.0f, 0.0f, 1.0f, 1.0f }), buf);
+}
+
+namespace {
+	/// The per-sample loops that the kernels replaced in AudioBuffer::operator() and Music::operator()
+	void scalarMix(std::vector<std::vector<std::int16_t>> const& stems, std::size_t pos, std::vector<float>& mixbuf, float* block, std::size_t n, double& level, double& rate, bool suppress) {
+		std::fill(mixbuf.begin(), mixbuf.begin() + n, 0.0f);
+		for (auto const& stem: stems) {
+			std::size_t idx = pos;
+			for (std::size_t s = 0; s < n; ++s, ++idx) {
+				if (idx < stem.size()) mixbuf[s] += 0.8f * da::conv_from_s16(stem[idx]);
+			}
+		}
+		for (std::size_t i = 0; i != n; ++i) {
+			if (i % 2 == 0) {
+				level += rate;
+				if (level <= 0.0) return;
+				if (level > 1.0) { level = 1.0; rate = 0.0; }
+			}
+			block[i] += mixbuf[i] * level * 0.9f;
+		}
+		if (suppress) {
+			for (std::size_t i = 0; i < n; i += 2) {
+				float diffLR = block[i] - block[i+1];
+				block[i] = diffLR;
+				block[i+1] = diffLR;
+			}
+		}
+	}
+
+	/// The same with the kernels, as the mixer does now
+	void kernelMix(std::vector<std::vector<std::int16_t>> const& stems, std::size_t pos, std::vector<float>& mixbuf, float* block, std::size_t n, double& level, double& rate, bool suppress) {
+		std::fill(mixbuf.begin(), mixbuf.begin() + n, 0.0f);
+		for (auto const& stem: stems) da::accumulate_s16(mixbuf.data(), stem.data() + pos, n, 0.8f);
+		std::size_t frames = da::accumulate_fade_stereo(block, mixbuf.data(), n / 2, 0.9f, level, rate);
+		if (suppress) da::suppress_center_stereo(block, frames);
+	}
+}
+
+/// Mixes N synthetic stems for ten seconds in 128 frame blocks, with a fade-in and center suppression, and reports
+/// the cost per stem and second of audio for the scalar loops and for the kernels
+TEST(MixTest, BenchStems) {
+	std::size_t const rate = 48000, frames = 128, seconds = 10, n = 2 * frames;
+	std::mt19937 gen(7);
+	std::uniform_int_distribution<int> dist(-20000, 20000);
+	for (unsigned count: { 1u, 4u, 8u }) {
+		std::vector<std::vector<std::int16_t>> stems(count, std::vector<std::int16_t>(2 * rate * seconds));
+		for (auto& stem: stems) for (auto& s: stem) s = dist(gen);
+		std::vector<float> mixbuf(n), scalarOut(n), kernelOut(n);
+		double scalarLevel = 0.0, scalarRate = 1.0 / rate, kernelLevel = 0.0, kernelRate = 1.0 / rate;
+		double scalar = 0.0, kernel = 0.0, maxDiff = 0.0;
+		for (std::size_t pos = 0; pos + n <= 2 * rate * seconds; pos += n) {
+			std::fill(scalarOut.begin(), scalarOut.end(), 0.0f);
+			std::fill(kernelOut.begin(), kernelOut.end(), 0.0f);
+			scalar += bench::seconds([&] { scalarMix(stems, pos, mixbuf, scalarOut.data(), n, scalarLevel, scalarRate, true); });
+			kernel += bench::seconds([&] { kernelMix(stems, pos, mixbuf, kernelOut.data(), n, kernelLevel, kernelRate, true); });
+			for (std::size_t i = 0; i < n; ++i) maxDiff = std::max<double>(maxDiff, std::abs(scalarOut[i] - kernelOut[i]));
+		}
+		EXPECT_LT(maxDiff, 1e-4) << count << " stems";
+		std::string name = "mix_" + std::to_string(count) + "_stems_";
+		bench::report(name + "scalar_us_per_stem_second", 1e6 * scalar / count / seconds, "us");
+		bench::report(name + "kernel_us_per_stem_second", 1e6 * kernel / count / seconds, "us");
+	}
+}
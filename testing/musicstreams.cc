@@ -0,0 +1,94 @@
+#include "musicstreams.hh"
+#include "probe.hh"
+
+#include <gtest/gtest.h>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace {
+	/// Stand-in for Music
+	struct Stream {
+		bool ready = false;
+		double fadeRate = 0.0;
+		bool prepare() { return ready; }
+	};
+
+	std::unique_ptr<Stream> makeStream(double fadeRate, bool ready = true) {
+		auto s = std::make_unique<Stream>();
+		s->fadeRate = fadeRate;
+		s->ready = ready;
+		return s;
+	}
+}
+
+TEST(Probe, SeesAllocationsAndLocks) {
+	std::mutex mutex;
+	probe::Scope scope;
+	{ std::lock_guard<std::mutex> l(mutex); }
+	auto p = std::make_unique<int>(1);
+	EXPECT_EQ(1ul, scope.locked());
+	EXPECT_EQ(1ul, scope.allocated());
+}
+
+TEST(MusicStreams, PreloadReplacesEarlierPreload) {
+	MusicStreams<Stream> music(4);
+	EXPECT_FALSE(music.active());
+	Stream* first = makeStream(0.1, false).release();
+	EXPECT_EQ(nullptr, music.preload(std::unique_ptr<Stream>(first)));
+	EXPECT_TRUE(music.active());
+	EXPECT_FALSE(music.current());
+	auto disposed = music.preload(makeStream(0.2, false));
+	EXPECT_EQ(first, disposed.get());
+	EXPECT_EQ(nullptr, music.promote());  // Not ready
+}
+
+TEST(MusicStreams, PromoteFadesOutCurrent) {
+	MusicStreams<Stream> music(4);
+	music.preload(makeStream(0.1));
+	Stream* a = music.promote();
+	ASSERT_NE(nullptr, a);
+	EXPECT_TRUE(music.current());
+	music.preload(makeStream(0.25));
+	Stream* b = music.promote();
+	ASSERT_NE(nullptr, b);
+	EXPECT_EQ(b, music.playing[0].get());
+	EXPECT_EQ(a, music.playing[1].get());
+	EXPECT_EQ(-0.25, a->fadeRate);  // Fades out as fast as the new one fades in
+	EXPECT_FALSE(music.preloading);
+}
+
+TEST(MusicStreams, PromoteWaitsForRoom) {
+	MusicStreams<Stream> music(2);
+	for (int i = 0; i < 2; ++i) { music.preload(makeStream(0.1)); ASSERT_NE(nullptr, music.promote()); }
+	music.preload(makeStream(0.1));
+	EXPECT_EQ(nullptr, music.promote());  // Full until a faded out stream is removed
+	music.playing.pop_back();
+	EXPECT_NE(nullptr, music.promote());
+}
+
+/// What the audio callback does with the streams must neither allocate nor lock
+TEST(MusicStreams, CallbackPathDoesNotAllocateOrLock) {
+	std::size_t const maxPlaying = 16;
+	MusicStreams<Stream> music(maxPlaying);
+	// Streams are created and destroyed by other threads
+	std::vector<std::unique_ptr<Stream>> incoming, disposed;
+	for (int i = 0; i < 100; ++i) incoming.push_back(makeStream(0.01 * (i + 1), i % 3 != 0));
+	disposed.reserve(incoming.size());
+	probe::Scope scope;
+	for (auto& s: incoming) {
+		if (auto old = music.preload(std::move(s))) disposed.push_back(std::move(old));  // Command::PLAY_MUSIC
+		for (int block = 0; block < 3; ++block) {
+			music.promote();
+			if (music.playing.size() > 2) {  // Oldest one faded out
+				disposed.push_back(std::move(music.playing.back()));
+				music.playing.pop_back();
+			}
+			(void)music.current();
+			(void)music.active();
+		}
+	}
+	EXPECT_EQ(0ul, scope.allocated());
+	EXPECT_EQ(0ul, scope.locked());
+	EXPECT_LE(music.playing.size(), maxPlaying);
+}
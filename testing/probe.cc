@@ -0,0 +1,38 @@
+#include "probe.hh"
+
+#include <atomic>
+#include <cstdlib>
+#include <dlfcn.h>
+#include <new>
+#include <pthread.h>
+
+namespace {
+	thread_local unsigned long allocationCount = 0;
+	thread_local unsigned long lockCount = 0;
+	typedef int (*LockFunc)(pthread_mutex_t*);
+	std::atomic<LockFunc> realLock{ nullptr };  // No function-local static, as its guard may lock
+}
+
+unsigned long probe::allocations() { return allocationCount; }
+unsigned long probe::locks() { return lockCount; }
+
+void* operator new(std::size_t size) {
+	++allocationCount;
+	if (void* ptr = std::malloc(size ? size : 1)) return ptr;
+	throw std::bad_alloc();
+}
+void* operator new[](std::size_t size) { return operator new(size); }
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete[](void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, std::size_t) noexcept { std::free(ptr); }
+
+extern "C" int pthread_mutex_lock(pthread_mutex_t* mutex) {
+	LockFunc func = realLock.load(std::memory_order_relaxed);
+	if (!func) {
+		func = reinterpret_cast<LockFunc>(dlsym(RTLD_NEXT, "pthread_mutex_lock"));
+		realLock.store(func, std::memory_order_relaxed);
+	}
+	++lockCount;
+	return func(mutex);
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+/**
+* Probes for code that must neither allocate nor lock (e.g. the audio callback path). The test program
+* replaces operator new and interposes pthread_mutex_lock, counting the calls of each thread.
+**/
+namespace probe {
+	/// Allocations through operator new by the calling thread so far
+	unsigned long allocations();
+	/// Blocking mutex locks (pthread_mutex_lock, which std::mutex uses) by the calling thread so far
+	unsigned long locks();
+
+	/// Counts what the calling thread does from construction on
+	struct Scope {
+		unsigned long allocationsBefore = allocations();
+		unsigned long locksBefore = locks();
+		unsigned long allocated() const { return allocations() - allocationsBefore; }
+		unsigned long locked() const { return locks() - locksBefore; }
+	};
+}
@@ -0,0 +1,73 @@
+#include "pitch.hh"
+
+#include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+TEST(RingBufferTest, ReadAndPop) {
+	RingBuffer<8> buf;
+	std::vector<float> in = { 1, 2, 3, 4, 5 }, out(3);
+	buf.insert(in.begin(), in.end());
+	EXPECT_EQ(5u, buf.size());
+	ASSERT_TRUE(buf.read(out.begin(), out.end()));
+	EXPECT_EQ((std::vector<float>{ 1, 2, 3 }), out);
+	buf.pop(4);
+	EXPECT_FALSE(buf.read(out.begin(), out.end()));
+	buf.insert(in.begin(), in.end());  // Wraps around
+	ASSERT_TRUE(buf.read(out.begin(), out.end()));
+	EXPECT_EQ((std::vector<float>{ 5, 1, 2 }), out);
+}
+
+TEST(RingBufferTest, ResyncSkipsStaleData) {
+	RingBuffer<8> buf;
+	std::vector<float> stale(12, 1.0f), live = { 2, 3 }, out(2);
+	EXPECT_FALSE(buf.resync());
+	buf.insert(stale.begin(), stale.end());  // Overflows, newest 4 samples dropped
+	EXPECT_EQ(8u, buf.size());
+	buf.pop(4);
+	buf.insert(live.begin(), live.end());  // Dropped until resync
+	EXPECT_EQ(4u, buf.size());
+	EXPECT_TRUE(buf.resync());
+	EXPECT_EQ(0u, buf.size());
+	EXPECT_FALSE(buf.resync());
+	buf.insert(live.begin(), live.end());
+	ASSERT_TRUE(buf.read(out.begin(), out.end()));
+	EXPECT_EQ(live, out);
+}
+
+// Producer and consumer in separate threads (run under ThreadSanitizer for best effect)
+TEST(RingBufferTest, ConcurrentStress) {
+	static RingBuffer<1024> buf;
+	unsigned const total = 1 << 20;
+	std::atomic<bool> done{ false };
+	std::thread producer([&] {
+		std::vector<float> chunk(100);
+		for (unsigned value = 0; value < total;) {
+			for (auto& s: chunk) s = float(value++ % (1 << 24));  // Exactly representable
+			buf.insert(chunk.begin(), chunk.end());
+			std::this_thread::yield();  // Like a capture callback, one chunk at a time
+		}
+		done = true;
+	});
+	std::vector<float> out(64);
+	float last = -1.0f;
+	unsigned reads = 0, resyncs = 0;
+	bool resynced = false;  // Since the last successful read
+	while (!done || buf.size() >= out.size()) {
+		if (reads % 1000 == 999) std::this_thread::sleep_for(std::chrono::milliseconds(1));  // Let it overflow now and then
+		if (buf.resync()) { resynced = true; ++resyncs; }
+		if (!buf.read(out.begin(), out.end())) { std::this_thread::yield(); continue; }
+		++reads;
+		// Data is consecutive within a read and never goes backwards (nothing torn or repeated)
+		for (std::size_t i = 1; i < out.size(); ++i) ASSERT_EQ(out[i - 1] + 1.0f, out[i]);
+		ASSERT_GT(out[0], last);
+		if (!resynced && last >= 0.0f) { ASSERT_EQ(last + 1.0f, out[0]); }
+		last = out.back();
+		resynced = false;
+		buf.pop(out.size());
+	}
+	producer.join();
+	EXPECT_GT(reads, 0u);
+}
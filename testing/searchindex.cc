@@ -0,0 +1,117 @@
+#include "searchindex.hh"
+
+#include "bench.hh"
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <random>
+
+namespace {
+	/// Stands in for Song, whose searchText() is already folded
+	struct Item {
+		std::string text;
+		std::string const& searchText() const { return text; }
+	};
+	using Items = std::vector<std::shared_ptr<Item>>;
+
+	/// What the index must return: the items containing query, in the order they were added
+	Items scan(Items const& items, std::string const& query) {
+		Items ret;
+		for (auto const& item: items) if (item->text.find(query) != std::string::npos) ret.push_back(item);
+		return ret;
+	}
+
+	std::string randomText(std::mt19937& rng, std::size_t length) {
+		static char const letters[] = "aabcdeeefghiijklmnoopqrstuuvwxyz \xc3\xa4";  // Including a UTF-8 sequence
+		std::string s;
+		for (std::size_t i = 0; i < length; ++i) s += letters[rng() % (sizeof(letters) - 1)];
+		return s;
+	}
+}
+
+TEST(SearchIndex, FindsSubstrings) {
+	SearchIndex<Item> index;
+	auto a = std::make_shared<Item>(Item{ "abba\nwaterloo" });
+	auto b = std::make_shared<Item>(Item{ "queen\nbohemian rhapsody" });
+	auto c = std::make_shared<Item>(Item{ "queen\nwe will rock you" });
+	index.add(a);
+	index.add(b);
+	index.add(c);
+	index.add(b);  // Already there
+	EXPECT_EQ((Items{ b, c }), index.find("queen"));
+	EXPECT_EQ((Items{ b, c }), index.find("que"));  // Shorter, not a refinement
+	EXPECT_EQ((Items{ b }), index.find("queen\nboh"));  // Spans a line break
+	EXPECT_EQ((Items{ a, b, c }), index.find("e"));  // Shorter than a trigram
+	EXPECT_EQ((Items{ a, b, c }), index.find(""));
+	EXPECT_EQ(Items{}, index.find("xyz"));
+	index.remove(b.get());
+	EXPECT_EQ((Items{ c }), index.find("queen"));
+	index.clear();
+	EXPECT_EQ(Items{}, index.find(""));
+}
+
+TEST(SearchIndex, AddAfterQueryIsFound) {
+	SearchIndex<Item> index;
+	index.add(std::make_shared<Item>(Item{ "performous" }));
+	EXPECT_EQ(1u, index.find("perf").size());
+	index.add(std::make_shared<Item>(Item{ "perfect" }));
+	EXPECT_EQ(2u, index.find("perf").size());  // Same query again
+	EXPECT_EQ(1u, index.find("perfe").size());  // Refinement
+}
+
+/// Random adds, removes (triggering compaction) and typed queries against a plain scan
+TEST(SearchIndex, MatchesPlainSubstringSearch) {
+	std::mt19937 rng(5);
+	SearchIndex<Item> index;
+	Items items;
+	auto add = [&] {
+		auto item = std::make_shared<Item>(Item{ randomText(rng, 10 + rng() % 40) });
+		items.push_back(item);
+		index.add(item);
+	};
+	for (int i = 0; i < 500; ++i) add();  // As Songs::LoadCache does
+	for (int round = 0; round < 300; ++round) {
+		switch (rng() % 4) {
+		case 0: add(); break;
+		case 1:
+			if (!items.empty()) {
+				auto it = items.begin() + rng() % items.size();
+				index.remove(it->get());
+				items.erase(it);
+			}
+			break;
+		default: break;
+		}
+		// Type a query letter by letter, like the song browser search does
+		std::string source = items.empty() ? std::string("abc") : items[rng() % items.size()]->text;
+		std::size_t pos = rng() % source.size();
+		std::string typed;
+		for (std::size_t i = pos; i < std::min(source.size(), pos + 6); ++i) {
+			typed += source[i];
+			ASSERT_EQ(scan(items, typed), index.find(typed)) << "query " << typed;
+		}
+		std::string other = randomText(rng, 1 + rng() % 5);
+		ASSERT_EQ(scan(items, other), index.find(other)) << "query " << other;
+	}
+}
+
+TEST(SearchIndex, BenchTypedQueries) {
+	std::mt19937 rng(7);
+	SearchIndex<Item> index;
+	Items items;
+	for (int i = 0; i < 20000; ++i) {
+		items.push_back(std::make_shared<Item>(Item{ randomText(rng, 60) }));
+		index.add(items.back());
+	}
+	char const* const queries[] = { "q", "qu", "que", "quee", "queen", "w", "wa", "wat", "wate", "water" };
+	std::size_t found = 0, foundScan = 0;
+	unsigned const rounds = 20;
+	double indexed = bench::seconds([&] {
+		for (unsigned r = 0; r < rounds; ++r) for (auto q: queries) found += index.find(q).size();
+	}) / (rounds * 10);
+	double plain = bench::seconds([&] {
+		for (unsigned r = 0; r < rounds; ++r) for (auto q: queries) foundScan += scan(items, q).size();
+	}) / (rounds * 10);
+	EXPECT_EQ(foundScan, found);
+	bench::report("search_typed_query_indexed_us", 1e6 * indexed, "us");
+	bench::report("search_typed_query_scan_us", 1e6 * plain, "us");
+}
@@ -0,0 +1,108 @@
+#include "seqlock.hh"
+
+#include "bench.hh"
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+	/// Larger than one word so that a torn copy would show up as mismatching fields
+	struct Status {
+		double time;
+		unsigned long long seq;
+		unsigned long long check;
+		bool playing;
+	};
+	/// The mutex that SeqLock replaced, for comparison
+	class MutexLock {
+	  public:
+		void store(Status const& value) { std::lock_guard<std::mutex> l(m_mutex); m_value = value; }
+		Status load() const { std::lock_guard<std::mutex> l(m_mutex); return m_value; }
+	  private:
+		mutable std::mutex m_mutex;
+		Status m_value{};
+	};
+	/**
+	* A writer storing once per simulated audio callback period while readers poll as fast as they can.
+	* Reports the writer's mean and worst store time and the readers' total loads per second.
+	**/
+	template <typename Lock> void benchContention(std::string const& name, unsigned readerCount) {
+		Lock lock;
+		unsigned const periods = 200;
+		std::atomic<bool> done{ false };
+		std::atomic<unsigned long long> loads{ 0 };
+		std::vector<std::thread> readers;
+		for (unsigned r = 0; r < readerCount; ++r) {
+			readers.emplace_back([&] {
+				unsigned long long n = 0;
+				while (!done.load(std::memory_order_relaxed)) { lock.load(); ++n; }
+				loads += n;
+			});
+		}
+		double total = 0.0, worst = 0.0;
+		double elapsed = bench::seconds([&] {
+			for (unsigned long long i = 1; i <= periods; ++i) {
+				double t = bench::seconds([&] { lock.store(Status{ i * 0.5, i, ~i, i % 2 == 1 }); });
+				total += t;
+				worst = std::max(worst, t);
+				std::this_thread::sleep_for(1ms);  // Until the next callback
+			}
+		});
+		done = true;
+		for (auto& t: readers) t.join();
+		std::string prefix = name + "_" + std::to_string(readerCount) + "_readers_";
+		bench::report(prefix + "store_mean", 1e9 * total / periods, "ns");
+		bench::report(prefix + "store_worst", 1e9 * worst, "ns");
+		if (readerCount) bench::report(prefix + "loads", loads / elapsed, "loads/s");
+	}
+}
+
+TEST(SeqLock, LoadReturnsLastStore) {
+	SeqLock<Status> lock(Status{ 1.5, 1, ~1ULL, true });
+	EXPECT_EQ(1.5, lock.load().time);
+	lock.store(Status{ 2.5, 2, ~2ULL, false });
+	Status s = lock.load();
+	EXPECT_EQ(2.5, s.time);
+	EXPECT_EQ(2u, s.seq);
+	EXPECT_FALSE(s.playing);
+}
+
+TEST(SeqLock, ConcurrentReadersSeeCompleteValues) {
+	SeqLock<Status> lock(Status{ 0.0, 0, ~0ULL, false });
+	unsigned long long const count = 100000;
+	std::atomic<bool> failed{ false };
+	std::atomic<bool> done{ false };
+	std::vector<std::thread> readers;
+	for (int r = 0; r < 3; ++r) {
+		readers.emplace_back([&] {
+			unsigned long long last = 0;
+			while (!done.load()) {
+				Status s = lock.load();
+				if (s.check != ~s.seq || s.time != s.seq * 0.5 || s.playing != (s.seq % 2 == 1) || s.seq < last) failed = true;
+				last = s.seq;
+				std::this_thread::yield();
+			}
+		});
+	}
+	for (unsigned long long i = 1; i <= count; ++i) {
+		lock.store(Status{ i * 0.5, i, ~i, i % 2 == 1 });
+		if (i % 64 == 0) std::this_thread::yield();  // Let the readers run on a single core too
+	}
+	done = true;
+	for (auto& t: readers) t.join();
+	EXPECT_FALSE(failed);
+	EXPECT_EQ(count, lock.load().seq);
+}
+
+/// Status publishing of the audio callback under polling readers, SeqLock against the mutex it replaced
+TEST(SeqLock, BenchContention) {
+	bench::report("hardware_threads", std::thread::hardware_concurrency(), "threads");
+	for (unsigned readers: { 0u, 1u, 4u }) {
+		benchContention<SeqLock<Status>>("seqlock", readers);
+		benchContention<MutexLock>("mutex", readers);
+	}
+}
@@ -0,0 +1,139 @@
+#include "songcache.hh"
+
+#include "bench.hh"
+#include <gtest/gtest.h>
+#include <boost/filesystem.hpp>
+#include <fstream>
+
+namespace {
+	struct TempCache {
+		fs::path dir = fs::temp_directory_path() / fs::unique_path("performous-songcache-%%%%-%%%%");
+		fs::path file = dir / "songs.cache";
+		TempCache() { fs::create_directories(dir); }
+		~TempCache() { fs::remove_all(dir); }
+	};
+
+	/// A record as Song::cacheRecord builds it, numbered by i
+	cache::SongRecord record(cache::SongCacheWriter& cache, unsigned i) {
+		cache::SongRecord r = {};
+		std::string n = std::to_string(i);
+		r.path = cache.str("/songs/Artist " + n + "/");
+		r.filename = cache.str("/songs/Artist " + n + "/song.txt");
+		r.title = cache.str("Title " + n);
+		r.artist = cache.str("Artist " + n);
+		r.edition = cache.str(i % 2 ? "SingStar" : "");  // Shared strings are stored once
+		r.language = cache.str("English");
+		r.cover = cache.str("cover.jpg");
+		r.videoGap = 0.25 * i;
+		r.start = 1.5;
+		r.previewStart = 30.0 + i;
+		r.duration = 180.0;
+		r.bpm = i % 3 ? 120.0 + i : 0.0;
+		r.fileTime = 1500000000 + i;
+		r.fileSize = 1000 + i;
+		r.vocalTracks = 1 + i % 2;
+		r.guitarTracks = i % 4;
+		r.drums = i % 2;
+		return r;
+	}
+
+	void write(fs::path const& file, unsigned count) {
+		cache::SongCacheWriter cache;
+		for (unsigned i = 0; i < count; ++i) cache.add(record(cache, i));
+		cache.save(file);
+	}
+
+	/// Overwrite bytes of a file at offset
+	void patch(fs::path const& file, std::size_t offset, std::string const& bytes) {
+		std::fstream f(file.string(), std::ios::binary | std::ios::in | std::ios::out);
+		f.seekp(offset);
+		f.write(bytes.data(), bytes.size());
+	}
+}
+
+TEST(SongCache, RoundTrip) {
+	TempCache tmp;
+	write(tmp.file, 100);
+	EXPECT_FALSE(fs::exists(tmp.file.string() + ".tmp"));
+	cache::SongCacheFile file(tmp.file);
+	ASSERT_EQ(100u, file.size());
+	for (unsigned i = 0; i < file.size(); ++i) {
+		cache::SongRecord const& r = file[i];
+		std::string n = std::to_string(i);
+		EXPECT_EQ("/songs/Artist " + n + "/", file.str(r.path));
+		EXPECT_EQ("/songs/Artist " + n + "/song.txt", file.str(r.filename));
+		EXPECT_EQ("Title " + n, file.str(r.title));
+		EXPECT_EQ("Artist " + n, file.str(r.artist));
+		EXPECT_EQ(i % 2 ? "SingStar" : "", file.str(r.edition));
+		EXPECT_EQ("English", file.str(r.language));
+		EXPECT_EQ("", file.str(r.video));
+		EXPECT_EQ(0.25 * i, r.videoGap);
+		EXPECT_EQ(30.0 + i, r.previewStart);
+		EXPECT_EQ(i % 3 ? 120.0 + i : 0.0, r.bpm);
+		EXPECT_EQ(1500000000 + i, r.fileTime);
+		EXPECT_EQ(1000u + i, r.fileSize);
+		EXPECT_EQ(1 + i % 2, r.vocalTracks);
+		EXPECT_EQ(i % 4, r.guitarTracks);
+		EXPECT_EQ(i % 2, r.drums);
+	}
+	// Equal strings share their place in the string table
+	EXPECT_EQ(file[0].language.offset, file[99].language.offset);
+	EXPECT_EQ(file[1].edition.offset, file[3].edition.offset);
+}
+
+TEST(SongCache, Empty) {
+	TempCache tmp;
+	write(tmp.file, 0);
+	EXPECT_EQ(0u, cache::SongCacheFile(tmp.file).size());
+}
+
+TEST(SongCache, RejectsMissingAndIncompatible) {
+	TempCache tmp;
+	EXPECT_THROW(cache::SongCacheFile(tmp.file), std::runtime_error);
+	{ std::ofstream(tmp.file.string()) << "short"; }
+	EXPECT_THROW(cache::SongCacheFile(tmp.file), std::runtime_error);
+	write(tmp.file, 10);
+	patch(tmp.file, 0, "X");  // Magic
+	EXPECT_THROW(cache::SongCacheFile(tmp.file), std::runtime_error);
+	write(tmp.file, 10);
+	patch(tmp.file, 8, std::string("\x63\0\0\0", 4));  // Version
+	EXPECT_THROW(cache::SongCacheFile(tmp.file), std::runtime_error);
+	write(tmp.file, 10);
+	patch(tmp.file, 12, std::string("\x08\0\0\0", 4));  // Record size
+	EXPECT_THROW(cache::SongCacheFile(tmp.file), std::runtime_error);
+}
+
+TEST(SongCache, RejectsDamaged) {
+	TempCache tmp;
+	write(tmp.file, 10);
+	auto size = fs::file_size(tmp.file);
+	fs::resize_file(tmp.file, size - 1);  // Truncated
+	EXPECT_THROW(cache::SongCacheFile(tmp.file), std::runtime_error);
+	write(tmp.file, 10);
+	{ std::ofstream(tmp.file.string(), std::ios::binary | std::ios::app) << "garbage"; }
+	EXPECT_THROW(cache::SongCacheFile(tmp.file), std::runtime_error);
+	write(tmp.file, 10);
+	cache::SongCacheFile file(tmp.file);
+	EXPECT_THROW(file.str(cache::StringRef{ 0, std::uint32_t(size) }), std::runtime_error);
+	EXPECT_THROW(file.str(cache::StringRef{ 0xFFFFFFFFu, 1 }), std::runtime_error);
+}
+
+TEST(SongCache, BenchLoad) {
+	TempCache tmp;
+	unsigned const count = 20000;
+	write(tmp.file, count);
+	std::size_t chars = 0;
+	double load = bench::seconds([&] {
+		cache::SongCacheFile file(tmp.file);
+		for (std::size_t i = 0; i < file.size(); ++i) {
+			auto const& r = file[i];
+			// The strings that Song's cache constructor copies
+			for (auto ref: { r.path, r.filename, r.title, r.artist, r.edition, r.language, r.creator, r.genre, r.cover, r.background, r.music, r.vocals, r.video }) {
+				chars += file.str(ref).size();
+			}
+		}
+	});
+	EXPECT_GT(chars, 0u);
+	bench::report("songcache_file_bytes", double(fs::file_size(tmp.file)), "bytes");
+	bench::report("songcache_load_us_per_song", 1e6 * load / count, "us");
+}
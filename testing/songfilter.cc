@@ -0,0 +1,101 @@
+#include "songfilter.hh"
+
+#include "bench.hh"
+#include <gtest/gtest.h>
+#include <random>
+
+namespace {
+	std::string text(std::string const& title, std::string const& artist, std::string const& genre = "", std::string const& edition = "", std::string const& path = "/songs/") {
+		return songfilter::join({{ title, artist, genre, edition, path }});
+	}
+}
+
+TEST(SongFilter, JoinsLinesInOrder) {
+	EXPECT_EQ("title\nartist\ngenre\nedition\n/path/", songfilter::join({{ "title", "artist", "genre", "edition", "/path/" }}));
+}
+
+TEST(SongFilter, FieldsMatchOnlyTheirOwnLine) {
+	std::string song = text("waterloo", "abba", "pop", "singstar abba", "/songs/abba/");
+	songfilter::Filter filter;
+	EXPECT_TRUE(filter.matches(song, "english"));  // No filters
+	filter.fields[songfilter::ARTIST] = "abba";
+	EXPECT_TRUE(filter.matches(song, ""));
+	filter.fields[songfilter::ARTIST] = "water";  // On the title line
+	EXPECT_FALSE(filter.matches(song, ""));
+	filter.fields[songfilter::ARTIST] = "";
+	filter.fields[songfilter::EDITION] = "abba";  // Also on the artist line, before the edition line
+	EXPECT_TRUE(filter.matches(song, ""));
+	filter.fields[songfilter::GENRE] = "abba";  // Neither on the genre line nor within a later one
+	EXPECT_FALSE(filter.matches(song, ""));
+	filter = songfilter::Filter();
+	filter.fields[songfilter::TITLE] = "loo\nab";  // Must not span lines
+	EXPECT_FALSE(filter.matches(song, ""));
+	filter.fields[songfilter::TITLE] = "";
+	filter.fields[songfilter::EDITION] = "songs";  // Only in the path
+	EXPECT_FALSE(filter.matches(song, ""));
+	filter.fields[songfilter::EDITION] = "";
+	filter.query = "songs/abba";  // Anywhere
+	EXPECT_TRUE(filter.matches(song, ""));
+}
+
+TEST(SongFilter, MissingLinesDoNotMatch) {
+	songfilter::Filter filter;
+	filter.fields[songfilter::EDITION] = "x";
+	EXPECT_FALSE(filter.matches("x", ""));
+	EXPECT_FALSE(filter.matches("x\nx", ""));
+	EXPECT_TRUE(filter.matches("\n\n\nx", ""));
+	filter.fields[songfilter::EDITION] = "";
+	filter.fields[songfilter::TITLE] = "x";
+	EXPECT_TRUE(filter.matches("x", ""));
+}
+
+TEST(SongFilter, Language) {
+	songfilter::Filter filter;
+	filter.language = "engl";
+	EXPECT_TRUE(filter.matches(text("a", "b"), "english"));
+	EXPECT_FALSE(filter.matches(text("a", "b"), "finnish"));
+	EXPECT_FALSE(filter.matches(text("english", "b"), ""));  // Not from the search text
+}
+
+TEST(SongFilter, Page) {
+	songfilter::Page all(10, 0);
+	EXPECT_EQ(0u, all.offset);
+	EXPECT_EQ(10u, all.count);
+	songfilter::Page middle(10, 3, 4);
+	EXPECT_EQ(3u, middle.offset);
+	EXPECT_EQ(4u, middle.count);
+	songfilter::Page last(10, 8, 4);
+	EXPECT_EQ(8u, last.offset);
+	EXPECT_EQ(2u, last.count);
+	songfilter::Page past(10, 20, 4);
+	EXPECT_EQ(10u, past.offset);
+	EXPECT_EQ(0u, past.count);
+	songfilter::Page negative(10, -5, 0);
+	EXPECT_EQ(0u, negative.offset);
+	EXPECT_EQ(0u, negative.count);
+	songfilter::Page empty(0, 0, 20);
+	EXPECT_EQ(0u, empty.offset);
+	EXPECT_EQ(0u, empty.count);
+}
+
+TEST(SongFilter, BenchFieldSearch) {
+	std::mt19937 rng(3);
+	auto word = [&rng] {
+		std::string s;
+		for (unsigned i = 0, n = 3 + rng() % 8; i < n; ++i) s += char('a' + rng() % 26);
+		return s;
+	};
+	std::vector<std::string> texts;
+	for (unsigned i = 0; i < 20000; ++i) texts.push_back(text(word() + " " + word(), word(), word(), word(), "/songs/" + word() + "/"));
+	songfilter::Filter filter;
+	filter.query = "a";
+	filter.fields[songfilter::ARTIST] = "e";
+	filter.fields[songfilter::EDITION] = "o";
+	std::size_t found = 0;
+	unsigned const rounds = 10;
+	double t = bench::seconds([&] {
+		for (unsigned r = 0; r < rounds; ++r) for (auto const& s: texts) found += filter.matches(s, "english");
+	});
+	EXPECT_GT(found, 0u);
+	bench::report("songfilter_us_per_20k_songs", 1e6 * t / rounds, "us");
+}
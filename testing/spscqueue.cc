@@ -0,0 +1,65 @@
+#include "spscqueue.hh"
+
+#include <gtest/gtest.h>
+#include <memory>
+#include <thread>
+
+TEST(SPSCQueue, FifoAndCapacity) {
+	SPSCQueue<int, 4> queue;
+	EXPECT_TRUE(queue.empty());
+	EXPECT_EQ(nullptr, queue.front());
+	for (int i = 0; i < 4; ++i) EXPECT_TRUE(queue.push(i));
+	EXPECT_FALSE(queue.push(4));  // Full
+	EXPECT_EQ(4u, queue.size());
+	for (int i = 0; i < 4; ++i) {
+		ASSERT_NE(nullptr, queue.front());
+		EXPECT_EQ(i, *queue.front());
+		queue.pop();
+	}
+	EXPECT_TRUE(queue.empty());
+}
+
+TEST(SPSCQueue, FailedPushLeavesValue) {
+	SPSCQueue<std::unique_ptr<int>, 2> queue;
+	EXPECT_TRUE(queue.push(std::unique_ptr<int>(new int(1))));
+	EXPECT_TRUE(queue.push(std::unique_ptr<int>(new int(2))));
+	std::unique_ptr<int> value(new int(3));
+	EXPECT_FALSE(queue.push(std::move(value)));
+	ASSERT_TRUE(value);
+	EXPECT_EQ(3, *value);
+}
+
+TEST(SPSCQueue, ConsumedValueIsFreedByProducer) {
+	SPSCQueue<std::shared_ptr<int>, 2> queue;
+	auto value = std::make_shared<int>(1);
+	std::weak_ptr<int> weak = value;
+	queue.push(std::move(value));
+	queue.pop();  // Consumer does not move it out, so the slot keeps it...
+	EXPECT_FALSE(weak.expired());
+	queue.push(std::make_shared<int>(2));
+	queue.push(std::make_shared<int>(3));  // ...until the producer overwrites the slot
+	EXPECT_TRUE(weak.expired());
+}
+
+TEST(SPSCQueue, ConcurrentProducerAndConsumer) {
+	struct Item { unsigned seq; unsigned check; };  // Torn or reordered items would show as a mismatch
+	SPSCQueue<Item, 64> queue;
+	unsigned const count = 200000;
+	std::thread producer([&] {
+		for (unsigned i = 0; i < count; ) {
+			if (queue.push(Item{ i, ~i })) ++i;
+			else std::this_thread::yield();
+		}
+	});
+	unsigned expected = 0;
+	while (expected < count) {
+		Item* item = queue.front();
+		if (!item) { std::this_thread::yield(); continue; }
+		ASSERT_EQ(expected, item->seq);
+		ASSERT_EQ(~expected, item->check);
+		queue.pop();
+		++expected;
+	}
+	producer.join();
+	EXPECT_TRUE(queue.empty());
+}
@@ -0,0 +1,70 @@
+#include "threadpool.hh"
+
+#include "bench.hh"
+#include "pitch.hh"
+#include <gtest/gtest.h>
+#include <atomic>
+#include <cmath>
+#include <memory>
+#include <string>
+#include <vector>
+
+TEST(ThreadPool, WaitReturnsWhenAllTasksAreDone) {
+	ThreadPool pool(3);
+	EXPECT_EQ(3u, pool.size());
+	std::atomic<unsigned> done{ 0 };
+	for (unsigned round = 1; round <= 3; ++round) {
+		for (unsigned i = 0; i < 100; ++i) pool.run([&done] { std::this_thread::yield(); ++done; });
+		pool.wait();
+		EXPECT_EQ(100 * round, done.load());
+	}
+	pool.wait();  // Nothing queued
+}
+
+TEST(ThreadPool, SurvivesThrowingTasksAndFinishesOnDestruction) {
+	std::atomic<unsigned> done{ 0 };
+	{
+		ThreadPool pool(2);
+		pool.run([] { throw std::runtime_error("test"); });  // Logged as core/error
+		for (unsigned i = 0; i < 50; ++i) pool.run([&done] { ++done; });
+	}
+	EXPECT_EQ(50u, done.load());
+}
+
+TEST(ThreadPool, DefaultSizeLeavesRoomForTheCaller) {
+	EXPECT_EQ(1u, ThreadPool::defaultSize(1));
+	EXPECT_GE(ThreadPool::defaultSize(11), 1u);
+	EXPECT_LE(ThreadPool::defaultSize(11), std::max(1u, std::thread::hardware_concurrency()));
+}
+
+/// Engine::prepare for a growing number of microphones, serial and on a pool as Engine sets it up
+TEST(ThreadPool, BenchAnalysisScaling) {
+	double const rate = 48000.0;
+	std::vector<float> chunk(480);  // 10 ms of input per engine step for every microphone
+	unsigned const steps = 100;
+	bench::report("hardware_threads", std::thread::hardware_concurrency(), "threads");
+	for (unsigned mics: { 1u, 4u, 11u }) {  // Up to AUDIO_MAX_ANALYZERS
+		for (bool pooled: { false, true }) {
+			std::vector<std::unique_ptr<Analyzer>> analyzers;
+			for (unsigned i = 0; i < mics; ++i) analyzers.emplace_back(new Analyzer(rate, "mic" + std::to_string(i)));
+			std::unique_ptr<ThreadPool> pool;
+			if (pooled) pool.reset(new ThreadPool(std::max(2u, ThreadPool::defaultSize(mics))));
+			double total = 0.0;
+			std::size_t t = 0;
+			for (unsigned step = 0; step < steps; ++step) {
+				for (auto& s: chunk) { s = 0.3f * std::sin(da::TAU * 220.0 * t / rate); ++t; }
+				for (auto& a: analyzers) a->input(chunk.begin(), chunk.end());  // As the audio callback does
+				total += bench::seconds([&] {
+					if (!pool) {
+						for (auto& a: analyzers) a->process();
+						return;
+					}
+					for (auto& a: analyzers) { Analyzer* ptr = a.get(); pool->run([ptr] { ptr->process(); }); }
+					pool->wait();
+				});
+			}
+			std::string name = "analysis_" + std::to_string(mics) + "_mics_" + (pooled ? "pool" : "serial") + "_us_per_step";
+			bench::report(name, 1e6 * total / steps, "us");
+		}
+	}
+}